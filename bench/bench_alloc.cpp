@@ -0,0 +1,87 @@
+// Frame cost of an allocation heavy script under the default allocator
+// luaL_newstate uses, memoryAlloc's counting realloc and the size class
+// pools of memoryPoolAlloc. Each frame builds short lived tables, closures
+// and strings the way game scripts do and throws them away.
+
+#include "../src/lua/src/lua.h"
+#include "../src/lua/src/lualib.h"
+#include "../src/lua/src/lauxlib.h"
+#include "../src/memory.h"
+#include "../src/timer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+static const char* script =
+  "local entities = {}\n"
+  "for i = 1, 2000 do entities[i] = {x = i, y = -i, name = 'entity' .. i} end\n"
+  "function frame()\n"
+  "  local visible = {}\n"
+  "  for i, e in ipairs(entities) do\n"
+  "    local p = {x = e.x * 0.5, y = e.y * 0.5}\n"
+  "    local scale = function(s) return p.x * s, p.y * s end\n"
+  "    if (i % 3) == 0 then\n"
+  "      visible[#visible + 1] = {p, scale(2), e.name .. ':' .. i}\n"
+  "    end\n"
+  "  end\n"
+  "  return #visible\n"
+  "end\n";
+
+static lua_State* newState(lua_Alloc alloc, void* ud)
+{
+  lua_State* L = alloc != NULL ? lua_newstate(alloc, ud) : luaL_newstate();
+  luaL_openlibs(L);
+  if (luaL_dostring(L, script))
+  {
+    fprintf(stderr, "%s\n", lua_tostring(L, -1));
+    exit(1);
+  }
+  return L;
+}
+
+static void run(const char* name, lua_State* L, int frames)
+{
+  for (int i = 0; i < 50; ++i)
+  {
+    lua_getglobal(L, "frame");
+    lua_call(L, 0, 1);
+    lua_pop(L, 1);
+  }
+
+  uint64_t start = timerNow();
+  for (int i = 0; i < frames; ++i)
+  {
+    lua_getglobal(L, "frame");
+    lua_call(L, 0, 1);
+    lua_pop(L, 1);
+  }
+  double us = (double)(timerNow() - start) / frames / 1000.0;
+  printf("%-24s %8.1f us/frame, heap %.0f KB\n", name, us,
+    lua_gc(L, LUA_GCCOUNT, 0) + lua_gc(L, LUA_GCCOUNTB, 0) / 1024.0);
+}
+
+int main(int argc, char* argv[])
+{
+  int frames = argc > 1 ? atoi(argv[1]) : 500;
+
+  lua_State* L = newState(NULL, NULL);
+  run("luaL_newstate", L, frames);
+  lua_close(L);
+
+  MemoryStats stats = MemoryStats();
+  L = newState(memoryAlloc, &stats);
+  run("memoryAlloc", L, frames);
+  lua_close(L);
+
+  MemoryPool pool;
+  memoryPoolInit(&pool);
+  L = newState(memoryPoolAlloc, &pool);
+  run("memoryPoolAlloc", L, frames);
+  printf("%24s %.1f%% of %llu allocs pooled, %llu slabs\n", "",
+    pool.pooled * 100.0 / pool.stats.allocs, (unsigned long long)pool.stats.allocs,
+    (unsigned long long)pool.slabs);
+  lua_close(L);
+  memoryPoolRelease(&pool);
+
+  return 0;
+}
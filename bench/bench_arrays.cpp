@@ -0,0 +1,144 @@
+// Copying a 100k element table to and from a float array: one element at a
+// time through the stack, as the bindings did, against lua_getarray and
+// lua_setarray. Tables of floats, of integers, and one whose entries are
+// all in the hash part, which both go through luaH_getint for.
+
+#include "../src/lua/src/lua.h"
+#include "../src/lua/src/lualib.h"
+#include "../src/lua/src/lauxlib.h"
+#include "../src/timer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+static const char* script =
+  "local count = ...\n"
+  "floats, integers = {}, {}\n"
+  "for i = 1, count do floats[i] = i * 0.5; integers[i] = i end\n";
+
+static void stackGet(lua_State* L, int table, float* out, int count)
+{
+  for (int i = 0; i < count; ++i)
+  {
+    int isnum = 0;
+    lua_rawgeti(L, table, i + 1);
+    out[i] = (float)lua_tonumberx(L, -1, &isnum);
+    if (!isnum)
+    {
+      luaL_error(L, "not a number");
+    }
+    lua_pop(L, 1);
+  }
+}
+
+static void stackSet(lua_State* L, int table, const float* in, int count)
+{
+  for (int i = 0; i < count; ++i)
+  {
+    lua_pushnumber(L, in[i]);
+    lua_rawseti(L, table, i + 1);
+  }
+}
+
+static void report(const char* name, uint64_t start, int rounds, int count)
+{
+  double ns = (double)(timerNow() - start) / rounds / count;
+  printf("%-28s %6.2f ns/element\n", name, ns);
+}
+
+static void measureGet(lua_State* L, const char* global, int count, int rounds)
+{
+  std::vector<float> out(count);
+  lua_getglobal(L, global);
+  int table = lua_gettop(L);
+  char name[64];
+
+  uint64_t start = timerNow();
+  for (int r = 0; r < rounds; ++r)
+  {
+    stackGet(L, table, out.data(), count);
+  }
+  snprintf(name, sizeof(name), "%s stack", global);
+  report(name, start, rounds, count);
+
+  start = timerNow();
+  for (int r = 0; r < rounds; ++r)
+  {
+    if (lua_getarray(L, table, LUA_AFLOAT, out.data(), 1, count) != 0)
+    {
+      luaL_error(L, "not a number");
+    }
+  }
+  snprintf(name, sizeof(name), "%s lua_getarray", global);
+  report(name, start, rounds, count);
+  lua_pop(L, 1);
+}
+
+int main(int argc, char* argv[])
+{
+  int count = argc > 1 ? atoi(argv[1]) : 100000;
+  int rounds = 50;
+
+  lua_State* L = luaL_newstate();
+  luaL_openlibs(L);
+  lua_pushinteger(L, count);
+  if (luaL_loadstring(L, script) || (lua_insert(L, -2), lua_pcall(L, 1, 0, 0)))
+  {
+    fprintf(stderr, "%s\n", lua_tostring(L, -1));
+    return 1;
+  }
+
+  //a hash part with room for every key is never rehashed, so none of them
+  //move to the array part
+  lua_createtable(L, 0, count);
+  for (int i = 1; i <= count; ++i)
+  {
+    lua_pushnumber(L, i * 0.5);
+    lua_rawseti(L, -2, i);
+  }
+  lua_setglobal(L, "hashed");
+
+  measureGet(L, "floats", count, rounds);
+  measureGet(L, "integers", count, rounds);
+  measureGet(L, "hashed", count, rounds);
+
+  std::vector<float> in(count, 0.25f);
+  lua_createtable(L, count, 0);
+  int table = lua_gettop(L);
+  uint64_t start = timerNow();
+  for (int r = 0; r < rounds; ++r)
+  {
+    stackSet(L, table, in.data(), count);
+  }
+  report("set stack", start, rounds, count);
+
+  start = timerNow();
+  for (int r = 0; r < rounds; ++r)
+  {
+    lua_setarray(L, table, LUA_AFLOAT, in.data(), 1, count);
+  }
+  report("set lua_setarray", start, rounds, count);
+
+  //growing an empty table
+  start = timerNow();
+  for (int r = 0; r < rounds; ++r)
+  {
+    lua_newtable(L);
+    stackSet(L, lua_gettop(L), in.data(), count);
+    lua_pop(L, 1);
+  }
+  report("new table stack", start, rounds, count);
+
+  start = timerNow();
+  for (int r = 0; r < rounds; ++r)
+  {
+    lua_newtable(L);
+    lua_setarray(L, -1, LUA_AFLOAT, in.data(), 1, count);
+    lua_pop(L, 1);
+  }
+  report("new table lua_setarray", start, rounds, count);
+
+  lua_close(L);
+  return 0;
+}
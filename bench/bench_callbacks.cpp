@@ -0,0 +1,92 @@
+// Per call cost of entering a Lua callback from the host: the old
+// lua_getglobal + lua_pcall path against the registry cached fast path.
+
+#include "../src/lua/src/lua.h"
+#include "../src/lua/src/lualib.h"
+#include "../src/lua/src/lauxlib.h"
+#include "../src/callbacks.h"
+#include "../src/timer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+static const char* script =
+  "counter = 0\n"
+  "function update(dt) counter = counter + dt end\n";
+
+static int traceback(lua_State* L)
+{
+  return 1;
+}
+
+static void report(const char* name, uint64_t start, int iterations)
+{
+  double ns = (double)(timerNow() - start) / iterations;
+  printf("%-24s %8.1f ns/call\n", name, ns);
+}
+
+static lua_State* newState()
+{
+  lua_State* L = luaL_newstate();
+  luaL_openlibs(L);
+  lua_pushcfunction(L, traceback);
+  return L;
+}
+
+int main(int argc, char* argv[])
+{
+  int iterations = argc > 1 ? atoi(argv[1]) : 1000000;
+
+  //before: the script's globals are looked up by name every call
+  lua_State* L = newState();
+  if (luaL_dostring(L, script))
+  {
+    fprintf(stderr, "%s\n", lua_tostring(L, -1));
+    return 1;
+  }
+
+  for (int i = 0; i < 1000; ++i)
+  {
+    lua_getglobal(L, "update");
+    lua_pushnumber(L, 1);
+    lua_pcall(L, 1, 0, 0);
+  }
+
+  uint64_t start = timerNow();
+  for (int i = 0; i < iterations; ++i)
+  {
+    lua_getglobal(L, "update");
+    lua_pushnumber(L, 1);
+    lua_pcall(L, 1, 0, 0);
+  }
+  report("lua_getglobal+pcall", start, iterations);
+  lua_close(L);
+
+  //after: callbacks resolved into the registry with a persistent handler
+  L = newState();
+  Callbacks callbacks;
+  callbacksInit(L, &callbacks, -1);
+  if (luaL_dostring(L, script))
+  {
+    fprintf(stderr, "%s\n", lua_tostring(L, -1));
+    return 1;
+  }
+  callbacksResolve(L, &callbacks);
+
+  for (int i = 0; i < 1000; ++i)
+  {
+    lua_pushnumber(L, 1);
+    callbacksCall(L, &callbacks, CALLBACK_UPDATE, 1);
+  }
+
+  start = timerNow();
+  for (int i = 0; i < iterations; ++i)
+  {
+    lua_pushnumber(L, 1);
+    callbacksCall(L, &callbacks, CALLBACK_UPDATE, 1);
+  }
+  report("registry callback", start, iterations);
+  lua_close(L);
+
+  return 0;
+}
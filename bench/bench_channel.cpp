@@ -0,0 +1,134 @@
+// Worker channel costs: one way throughput between two threads at a few
+// message sizes, round trip latency, and the cost of flattening a typical
+// script message into bytes and back.
+
+#include "../src/lua/src/lua.h"
+#include "../src/lua/src/lualib.h"
+#include "../src/lua/src/lauxlib.h"
+#include "../src/channel.h"
+#include "../src/message.h"
+#include "../src/timer.h"
+
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+#include <vector>
+
+static void throughput(size_t size, int messages)
+{
+  Channel* c = channelCreate(256 * 1024);
+
+  std::thread producer([c, size, messages]() {
+    std::vector<uint8_t> payload(size, 1);
+    for (int i = 0; i < messages; ++i)
+    {
+      while (!channelSend(c, payload.data(), payload.size()))
+      {
+        std::this_thread::yield();
+      }
+    }
+  });
+
+  uint64_t start = timerNow();
+  std::vector<uint8_t> message;
+  for (int i = 0; i < messages; ++i)
+  {
+    while (!channelReceive(c, &message))
+    {
+      channelWait(c, 0.001);
+    }
+  }
+  double seconds = timerSeconds(timerNow() - start);
+  producer.join();
+  channelDestroy(c);
+
+  printf("%6d byte messages  %10.0f msg/s %9.1f MB/s\n", (int)size, messages / seconds,
+    messages * (double)size / seconds / (1024 * 1024));
+}
+
+static void latency(int trips)
+{
+  Channel* ping = channelCreate(4096);
+  Channel* pong = channelCreate(4096);
+
+  std::thread echo([ping, pong, trips]() {
+    std::vector<uint8_t> message;
+    for (int i = 0; i < trips; ++i)
+    {
+      while (!channelReceive(ping, &message))
+      {
+        channelWait(ping, -1);
+      }
+      channelSend(pong, message.data(), message.size());
+    }
+  });
+
+  std::vector<uint64_t> times(trips);
+  std::vector<uint8_t> message;
+  uint8_t payload[16] = {0};
+  for (int i = 0; i < trips; ++i)
+  {
+    uint64_t start = timerNow();
+    channelSend(ping, payload, sizeof(payload));
+    while (!channelReceive(pong, &message))
+    {
+      channelWait(pong, -1);
+    }
+    times[i] = timerNow() - start;
+  }
+  echo.join();
+  channelDestroy(ping);
+  channelDestroy(pong);
+
+  std::sort(times.begin(), times.end());
+  printf("round trip  p50 %8.2f us  p99 %8.2f us  max %8.2f us\n",
+    times[trips / 2] / 1e3, times[trips * 99 / 100] / 1e3, times[trips - 1] / 1e3);
+}
+
+static const char* script =
+  "return {from = {x = 12, y = 40}, to = {x = 96, y = 3}, unit = 'scout',"
+  " avoid = {1, 2, 3, 4, 5, 6, 7, 8}, urgent = true}\n";
+
+static void serialize(int iterations)
+{
+  lua_State* L = luaL_newstate();
+  luaL_openlibs(L);
+  if (luaL_dostring(L, script))
+  {
+    fprintf(stderr, "%s\n", lua_tostring(L, -1));
+    return;
+  }
+
+  std::vector<uint8_t> out;
+  uint64_t start = timerNow();
+  for (int i = 0; i < iterations; ++i)
+  {
+    out.clear();
+    messageWrite(L, -1, &out);
+  }
+  printf("%-24s %8.1f ns/message (%d bytes)\n", "write table",
+    (double)(timerNow() - start) / iterations, (int)out.size());
+
+  start = timerNow();
+  for (int i = 0; i < iterations; ++i)
+  {
+    messageRead(L, out.data(), 0);
+    lua_pop(L, 1);
+  }
+  printf("%-24s %8.1f ns/message\n", "read table", (double)(timerNow() - start) / iterations);
+
+  lua_close(L);
+}
+
+int main(int argc, char* argv[])
+{
+  int messages = argc > 1 ? atoi(argv[1]) : 1000000;
+
+  throughput(16, messages);
+  throughput(256, messages);
+  throughput(4096, messages / 10);
+  latency(10000);
+  serialize(100000);
+  return 0;
+}
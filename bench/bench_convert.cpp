@@ -0,0 +1,206 @@
+// Per element cost of gl.DataToTable and gl.TableToData for each GL type:
+// the type switched per element implementation they replaced, copied here
+// as it was, against the current one, with and without a table or buffer
+// to reuse. No GL context is needed.
+
+#include "../src/lua/src/lua.h"
+#include "../src/lua/src/lualib.h"
+#include "../src/lua/src/lauxlib.h"
+#include "../src/luagl.h"
+#include "../src/timer.h"
+
+#include "GL/glew.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char* script =
+  "local count, rounds = ...\n"
+  "local types = {'BYTE', 'UNSIGNED_BYTE', 'SHORT', 'UNSIGNED_SHORT', 'INT', 'UNSIGNED_INT', 'FLOAT'}\n"
+  "local values = {}\n"
+  "for i = 1, count do values[i] = i % 100 end\n"
+  "local function measure(type, label, f)\n"
+  "  f()\n"
+  "  local start = now()\n"
+  "  for i = 1, rounds do f() end\n"
+  "  local ns = (now() - start) / rounds / count * 1e9\n"
+  "  print(string.format('%-16s %-20s %7.2f ns/element', type, label, ns))\n"
+  "end\n"
+  "for _, name in ipairs(types) do\n"
+  "  local type = gl[name]\n"
+  "  local data = gl.TableToData(type, values)\n"
+  "  local reuse = {}\n"
+  "  local buffer = gl.Buffer('uint8', #data)\n"
+  "  measure(name, 'old DataToTable', function() legacyDataToTable(type, data) end)\n"
+  "  measure(name, 'DataToTable', function() gl.DataToTable(type, data) end)\n"
+  "  measure(name, 'DataToTable reuse', function() gl.DataToTable(type, data, reuse) end)\n"
+  "  measure(name, 'old TableToData', function() legacyTableToData(type, values) end)\n"
+  "  measure(name, 'TableToData', function() gl.TableToData(type, values) end)\n"
+  "  measure(name, 'TableToData buffer', function() gl.TableToData(type, values, buffer) end)\n"
+  "end\n";
+
+static int legacyDataToTable(lua_State *lua)
+{
+	size_t size = 0;
+	GLenum type = luaL_checkinteger(lua, 1);
+	const char *data = luaL_checklstring(lua, 2, &size);
+	if (data) {
+		GLsizei n_size = 1;
+		if (type == GL_BYTE) {
+			n_size = sizeof(char);
+		} else if (type == GL_UNSIGNED_BYTE) {
+			n_size = sizeof(unsigned char);
+		} else if (type == GL_SHORT) {
+			n_size = sizeof(short);
+		} else if (type == GL_UNSIGNED_SHORT) {
+			n_size = sizeof(unsigned short);
+		} else if (type == GL_INT) {
+			n_size = sizeof(int);
+		} else if (type == GL_UNSIGNED_INT) {
+			n_size = sizeof(unsigned int);
+		} else if (type == GL_FLOAT) {
+			n_size = sizeof(float);
+		}
+		lua_newtable(lua);
+		int i = 0;
+		while ((size_t)((i * n_size) + n_size) < size) {
+			double value = 0;
+			if (type == GL_BYTE) {
+				char v = 0;
+				memcpy(&v, &data[i * n_size], n_size);
+				value = v;
+			} else if (type == GL_UNSIGNED_BYTE) {
+				unsigned char v = 0;
+				memcpy(&v, &data[i * n_size], n_size);
+				value = v;
+			} else if (type == GL_SHORT) {
+				short v = 0;
+				memcpy(&v, &data[i * n_size], n_size);
+				value = v;
+			} else if (type == GL_UNSIGNED_SHORT) {
+				unsigned short v = 0;
+				memcpy(&v, &data[i * n_size], n_size);
+				value = v;
+			} else if (type == GL_INT) {
+				int v = 0;
+				memcpy(&v, &data[i * n_size], n_size);
+				value = v;
+			} else if (type == GL_UNSIGNED_INT) {
+				unsigned int v = 0;
+				memcpy(&v, &data[i * n_size], n_size);
+				value = v;
+			} else if (type == GL_FLOAT) {
+				float v = 0;
+				memcpy(&v, &data[i * n_size], n_size);
+				value = v;
+			}
+			lua_pushinteger(lua, i);
+			lua_pushnumber(lua, value);
+			lua_settable(lua, -3);
+			i = i + 1;
+		}
+	} else {
+		lua_pushnil(lua);
+	}
+	return 1;
+}
+static int legacyTableToData(lua_State *lua)
+{
+	char *data = NULL;
+	GLsizei n_size = 1;
+	GLenum type = luaL_checkinteger(lua, 1);
+	if (type == GL_BYTE) {
+		n_size = sizeof(char);
+	} else if (type == GL_UNSIGNED_BYTE) {
+		n_size = sizeof(unsigned char);
+	} else if (type == GL_SHORT) {
+		n_size = sizeof(short);
+	} else if (type == GL_UNSIGNED_SHORT) {
+		n_size = sizeof(unsigned short);
+	} else if (type == GL_INT) {
+		n_size = sizeof(int);
+	} else if (type == GL_UNSIGNED_INT) {
+		n_size = sizeof(unsigned int);
+	} else if (type == GL_FLOAT) {
+		n_size = sizeof(float);
+	}
+	luaL_checktype(lua, 2, LUA_TTABLE);
+	GLsizei n = lua_rawlen(lua, 2);
+	if ((lua_istable(lua, 2)) && (n > 0)) {
+		data = (char*)malloc(n_size * n);
+		int i = 0;
+		for (i = 0; i < n; i++) {
+			lua_rawgeti(lua, 2, i + 1);
+			if (type == GL_BYTE) {
+				char v = lua_tonumber(lua, -1);
+				memcpy(&data[i * n_size], &v, n_size);
+			} else if (type == GL_UNSIGNED_BYTE) {
+				unsigned char v = lua_tonumber(lua, -1);
+				memcpy(&data[i * n_size], &v, n_size);
+			} else if (type == GL_SHORT) {
+				short v = lua_tonumber(lua, -1);
+				memcpy(&data[i * n_size], &v, n_size);
+			} else if (type == GL_UNSIGNED_SHORT) {
+				unsigned short v = lua_tonumber(lua, -1);
+				memcpy(&data[i * n_size], &v, n_size);
+			} else if (type == GL_INT) {
+				int v = lua_tonumber(lua, -1);
+				memcpy(&data[i * n_size], &v, n_size);
+			} else if (type == GL_UNSIGNED_INT) {
+				unsigned int v = lua_tonumber(lua, -1);
+				memcpy(&data[i * n_size], &v, n_size);
+			} else if (type == GL_FLOAT) {
+				float v = lua_tonumber(lua, -1);
+				memcpy(&data[i * n_size], &v, n_size);
+			}
+			lua_pop(lua, 1);
+		}
+	}
+	if (data) {
+		luaL_Buffer buffer;
+		luaL_buffinit(lua, &buffer);
+		luaL_addlstring(&buffer, (char*)data, n_size * n);
+		luaL_pushresult(&buffer);
+		free(data);
+	} else {
+		lua_pushnil(lua);
+	}
+	return 1;
+}
+
+static int now(lua_State* L)
+{
+  lua_pushnumber(L, timerSeconds(timerNow()));
+  return 1;
+}
+
+int main(int argc, char* argv[])
+{
+  int count = argc > 1 ? atoi(argv[1]) : 100000;
+  int rounds = argc > 2 ? atoi(argv[2]) : 20;
+
+  lua_State* L = luaL_newstate();
+  luaL_openlibs(L);
+  luaL_opengl(L);
+  lua_register(L, "now", now);
+  lua_register(L, "legacyDataToTable", legacyDataToTable);
+  lua_register(L, "legacyTableToData", legacyTableToData);
+
+  printf("%d elements, %d conversions each\n", count, rounds);
+  if (luaL_loadstring(L, script) != LUA_OK)
+  {
+    fprintf(stderr, "%s\n", lua_tostring(L, -1));
+    return 1;
+  }
+  lua_pushinteger(L, count);
+  lua_pushinteger(L, rounds);
+  if (lua_pcall(L, 2, 0, 0) != LUA_OK)
+  {
+    fprintf(stderr, "%s\n", lua_tostring(L, -1));
+    return 1;
+  }
+
+  lua_close(L);
+  return 0;
+}
@@ -0,0 +1,103 @@
+// Loading a large generated script three ways: compiling it from source,
+// through the script cache once it holds an entry for it, and only reading
+// the file, the floor a cached load can get to.
+
+#include "../src/lua/src/lua.h"
+#include "../src/lua/src/lualib.h"
+#include "../src/lua/src/lauxlib.h"
+#include "../src/scriptcache.h"
+#include "../src/timer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <unistd.h>
+
+static void writeScript(const char* path, int functions)
+{
+  FILE* file = fopen(path, "w");
+  if (file == NULL)
+  {
+    perror(path);
+    exit(1);
+  }
+  for (int i = 0; i < functions; ++i)
+  {
+    fprintf(file,
+      "function f%d(a, b, t)\n"
+      "  local x = {a, b, a * b, name = 'f%d', scale = %d.5}\n"
+      "  for i = 1, #t do\n"
+      "    if t[i] > a then x[#x + 1] = t[i] * b + %d else x.name = x.name .. i end\n"
+      "  end\n"
+      "  return x, string.format('%%d %%s', #x, x.name)\n"
+      "end\n", i, i, i, i);
+  }
+  fclose(file);
+}
+
+static void report(const char* name, uint64_t start, int iterations)
+{
+  double ms = (double)(timerNow() - start) / iterations * 1e-6;
+  printf("%-12s %8.3f ms/load\n", name, ms);
+}
+
+int main(int argc, char* argv[])
+{
+  int functions = argc > 1 ? atoi(argv[1]) : 5000;
+  int iterations = 20;
+
+  char dir[] = "/tmp/bench_scriptsXXXXXX";
+  if (mkdtemp(dir) == NULL)
+  {
+    perror("mkdtemp");
+    return 1;
+  }
+  std::string path = std::string(dir) + "/script.lua";
+  std::string cacheDir = std::string(dir) + "/cache";
+  writeScript(path.c_str(), functions);
+
+  lua_State* L = luaL_newstate();
+  ScriptCache uncached;
+  scriptCacheInit(&uncached, NULL);
+  ScriptCache cached;
+  scriptCacheInit(&cached, cacheDir.c_str());
+  if (scriptCacheLoad(&cached, L, path.c_str(), "@script.lua") != LUA_OK)
+  {
+    fprintf(stderr, "%s\n", lua_tostring(L, -1));
+    return 1;
+  }
+  lua_pop(L, 1);
+  printf("%d functions, %.0f KB of source\n", functions, cached.stats.bytes / 1024.0);
+
+  uint64_t start = timerNow();
+  for (int i = 0; i < iterations; ++i)
+  {
+    scriptCacheLoad(&uncached, L, path.c_str(), "@script.lua");
+    lua_pop(L, 1);
+  }
+  report("compile", start, iterations);
+
+  start = timerNow();
+  for (int i = 0; i < iterations; ++i)
+  {
+    scriptCacheLoad(&cached, L, path.c_str(), "@script.lua");
+    lua_pop(L, 1);
+  }
+  report("cached", start, iterations);
+
+  start = timerNow();
+  for (int i = 0; i < iterations; ++i)
+  {
+    FILE* file = fopen(path.c_str(), "rb");
+    char buffer[65536];
+    while (fread(buffer, 1, sizeof(buffer), file) == sizeof(buffer))
+    {
+    }
+    fclose(file);
+  }
+  report("read only", start, iterations);
+
+  lua_close(L);
+  std::string clean = "rm -rf " + std::string(dir);
+  return system(clean.c_str()) == 0 ? 0 : 1;
+}
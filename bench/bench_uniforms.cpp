@@ -0,0 +1,114 @@
+// Uniform ring pushes: first checks that values land at the offsets GLSL
+// gives the same members in a std140 block, mixing scalars and vectors,
+// then times ring:push for a typical draw (a mat4 buffer, then vec4, vec3
+// and float tables). Runs without GL, the ring writes system memory only.
+
+#include "../src/lua/src/lua.h"
+#include "../src/lua/src/lualib.h"
+#include "../src/lua/src/lauxlib.h"
+#include "../src/buffer.h"
+#include "../src/uniforms.h"
+#include "../src/timer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+struct Block
+{
+  const char* glsl;
+  size_t sizes[8];    // in bytes, 0 ends the list
+  size_t offsets[8];  // from the std140 rules
+  size_t size;
+};
+
+static const Block blocks[] = {
+  {"mat4 m; float a; float b;", {64, 4, 4}, {0, 64, 68}, 72},
+  {"float a; vec3 b; float c; vec2 d; vec4 e;", {4, 12, 4, 8, 16}, {0, 16, 28, 32, 48}, 64},
+  {"vec2 a; float b; vec3 c; float d; vec4 e[2]; float f;", {8, 4, 12, 4, 32, 4},
+    {0, 8, 16, 28, 32, 64}, 68},
+  {"float a; vec2 b; vec3 c; vec2 d;", {4, 8, 12, 8}, {0, 8, 16, 32}, 40},
+  {"vec3 a; vec3 b; mat4 c; vec2 d;", {12, 12, 64, 8}, {0, 16, 32, 96}, 104},
+};
+
+static const char* script =
+  "local rounds = ...\n"
+  "local ring = gl.UniformRing(1024 * 1024)\n"
+  "local model = engine.shared('float32', 16)\n"
+  "local color, normal, scale = {1, 0.5, 0.25, 1}, {0, 1, 0}, {2}\n"
+  "local offset, size = ring:push(0, model, color, normal, scale)\n"
+  "assert(size == 96, 'mat4 vec4 vec3 float pushed as ' .. size .. ' bytes, expected 96')\n"
+  "local start = now()\n"
+  "for i = 1, rounds do\n"
+  "  ring:push(0, model, color, normal, scale)\n"
+  "end\n"
+  "local seconds = (now() - start) / rounds\n"
+  "print(string.format('%-12s %8.1f ns/push', 'push', seconds * 1e9))\n";
+
+static int now(lua_State* L)
+{
+  lua_pushnumber(L, timerSeconds(timerNow()));
+  return 1;
+}
+
+static bool check(const Block& block)
+{
+  size_t at = 0;
+  bool ok = true;
+  for (int i = 0; i < 8 && block.sizes[i] != 0; ++i)
+  {
+    size_t offset = uniformsPlace(at, block.sizes[i], &at);
+    if (offset != block.offsets[i])
+    {
+      fprintf(stderr, "{%s} member %d at %d, expected %d\n", block.glsl, i + 1, (int)offset,
+        (int)block.offsets[i]);
+      ok = false;
+    }
+  }
+  if (at != block.size)
+  {
+    fprintf(stderr, "{%s} takes %d bytes, expected %d\n", block.glsl, (int)at, (int)block.size);
+    ok = false;
+  }
+  return ok;
+}
+
+int main(int argc, char* argv[])
+{
+  int rounds = argc > 1 ? atoi(argv[1]) : 1000000;
+
+  bool ok = true;
+  for (size_t i = 0; i < sizeof(blocks) / sizeof(blocks[0]); ++i)
+  {
+    ok = check(blocks[i]) && ok;
+  }
+  if (!ok)
+  {
+    return 1;
+  }
+  printf("%d std140 layouts match\n", (int)(sizeof(blocks) / sizeof(blocks[0])));
+
+  lua_State* L = luaL_newstate();
+  luaL_openlibs(L);
+  lua_newtable(L);
+  lua_setglobal(L, "engine");
+  lua_newtable(L);
+  lua_setglobal(L, "gl");
+  bufferRegister(L);
+  uniformsRegister(L, STREAM_NULL);
+  lua_register(L, "now", now);
+
+  if (luaL_loadstring(L, script) != LUA_OK)
+  {
+    fprintf(stderr, "%s\n", lua_tostring(L, -1));
+    return 1;
+  }
+  lua_pushinteger(L, rounds);
+  if (lua_pcall(L, 1, 0, 0) != LUA_OK)
+  {
+    fprintf(stderr, "%s\n", lua_tostring(L, -1));
+    return 1;
+  }
+
+  lua_close(L);
+  return 0;
+}
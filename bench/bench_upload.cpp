@@ -0,0 +1,116 @@
+// Vertex upload throughput through gl.BufferData for a 1M vertex buffer
+// (xyz float32, 12 MB): a Lua table of numbers, converted per element,
+// against a gl.Buffer handed to GL as it is, and a plain memcpy of the same
+// bytes, the copy glBufferData makes of client memory before returning.
+// With a GL context this is the time to get the data to the driver. Without
+// one GL is stubbed as in --headless and the numbers are the bindings' part
+// of an upload, which the memcpy line gives the rest of.
+
+#include "../src/lua/src/lua.h"
+#include "../src/lua/src/lualib.h"
+#include "../src/lua/src/lauxlib.h"
+#include "../src/buffer.h"
+#include "../src/glnull.h"
+#include "../src/luagl.h"
+#include "../src/timer.h"
+
+#include "SDL/SDL.h"
+#include "GL/glew.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char* script =
+  "local vertices, rounds = ...\n"
+  "local data = {}\n"
+  "for i = 1, vertices * 3 do data[i] = (i % 1000) * 0.001 end\n"
+  "local buffer = gl.Buffer('float32', data)\n"
+  "local bytes = buffer:size()\n"
+  "local name = gl.GenBuffer()\n"
+  "gl.BindBuffer(gl.ARRAY_BUFFER, name)\n"
+  "local function measure(label, source)\n"
+  "  gl.BufferData(gl.ARRAY_BUFFER, source, gl.STATIC_DRAW)\n"
+  "  local start = now()\n"
+  "  for i = 1, rounds do\n"
+  "    gl.BufferData(gl.ARRAY_BUFFER, source, gl.STATIC_DRAW)\n"
+  "  end\n"
+  "  local seconds = (now() - start) / rounds\n"
+  "  print(string.format('%-12s %8.3f ms %9.1f MB/s', label, seconds * 1e3,\n"
+  "    bytes / seconds / (1024 * 1024)))\n"
+  "end\n"
+  "measure('table', data)\n"
+  "measure('gl.Buffer', buffer)\n"
+  "copy(buffer)\n"
+  "local start = now()\n"
+  "for i = 1, rounds do copy(buffer) end\n"
+  "local seconds = (now() - start) / rounds\n"
+  "print(string.format('%-12s %8.3f ms %9.1f MB/s', 'memcpy', seconds * 1e3,\n"
+  "  bytes / seconds / (1024 * 1024)))\n";
+
+static int now(lua_State* L)
+{
+  lua_pushnumber(L, timerSeconds(timerNow()));
+  return 1;
+}
+
+// copy(buffer), into memory kept between calls like a driver's staging copy
+static int copy(lua_State* L)
+{
+  static void* to = NULL;
+  static size_t size = 0;
+  Buffer* buffer = bufferCheck(L, 1);
+  if (size < buffer->size)
+  {
+    free(to);
+    size = buffer->size;
+    to = malloc(size);
+  }
+  memcpy(to, buffer->data, buffer->size);
+  return 0;
+}
+
+int main(int argc, char* argv[])
+{
+  int vertices = argc > 1 ? atoi(argv[1]) : 1000000;
+  int rounds = argc > 2 ? atoi(argv[2]) : 20;
+
+  bool context = SDL_Init(SDL_INIT_VIDEO) == 0 && SDL_SetVideoMode(64, 64, 24, SDL_OPENGL);
+  if (context)
+  {
+    glewExperimental = GL_TRUE;
+    context = glewInit() == GLEW_OK;
+  }
+  if (!context)
+  {
+    fprintf(stderr, "No GL context (%s), GL is stubbed\n", SDL_GetError());
+  }
+
+  lua_State* L = luaL_newstate();
+  luaL_openlibs(L);
+  luaL_opengl(L);
+  if (!context)
+  {
+    glnullInstall(L);
+  }
+  lua_register(L, "now", now);
+  lua_register(L, "copy", copy);
+
+  printf("%d vertices, %d uploads each\n", vertices, rounds);
+  if (luaL_loadstring(L, script) != LUA_OK)
+  {
+    fprintf(stderr, "%s\n", lua_tostring(L, -1));
+    return 1;
+  }
+  lua_pushinteger(L, vertices);
+  lua_pushinteger(L, rounds);
+  if (lua_pcall(L, 2, 0, 0) != LUA_OK)
+  {
+    fprintf(stderr, "%s\n", lua_tostring(L, -1));
+    return 1;
+  }
+
+  lua_close(L);
+  SDL_Quit();
+  return 0;
+}
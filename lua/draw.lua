@@ -57,11 +57,14 @@ function loadShaders(vertexShaderPath, fragmentShaderPath)
   return programID;
 end
 
-function update()
+-- Called at the fixed update rate, dt is the step length in seconds
+function update(dt)
 
 end
 
-function draw()
+-- Called once per rendered frame, alpha is how far we are between the last
+-- two updates and can be used to interpolate
+function draw(alpha)
 
   local verts = 
   {
@@ -0,0 +1,92 @@
+shaders = dofile("lua/shaders.lua");
+instances = dofile("lua/instances.lua");
+
+-- A 100x100 grid of cubes drawn with one instanced call a frame.
+-- Run with ./build-g++/application lua/instanced.lua
+
+local side = 100;
+
+local vertexShader = [[
+attribute vec3 position;
+attribute vec3 offset;
+attribute vec4 color;
+varying vec4 fragmentColor;
+
+void main()
+{
+  gl_Position = vec4(position * 0.004 + offset, 1.0);
+  fragmentColor = color;
+}
+]];
+
+local fragmentShader = [[
+varying vec4 fragmentColor;
+
+void main()
+{
+  gl_FragColor = fragmentColor;
+}
+]];
+
+local cube =
+{
+  -1.0,-1.0,-1.0, -1.0,-1.0, 1.0, -1.0, 1.0, 1.0,
+   1.0, 1.0,-1.0, -1.0,-1.0,-1.0, -1.0, 1.0,-1.0,
+   1.0,-1.0, 1.0, -1.0,-1.0,-1.0,  1.0,-1.0,-1.0,
+   1.0, 1.0,-1.0,  1.0,-1.0,-1.0, -1.0,-1.0,-1.0,
+  -1.0,-1.0,-1.0, -1.0, 1.0, 1.0, -1.0, 1.0,-1.0,
+   1.0,-1.0, 1.0, -1.0,-1.0, 1.0, -1.0,-1.0,-1.0,
+  -1.0, 1.0, 1.0, -1.0,-1.0, 1.0,  1.0,-1.0, 1.0,
+   1.0, 1.0, 1.0,  1.0,-1.0,-1.0,  1.0, 1.0,-1.0,
+   1.0,-1.0,-1.0,  1.0, 1.0, 1.0,  1.0,-1.0, 1.0,
+   1.0, 1.0, 1.0,  1.0, 1.0,-1.0, -1.0, 1.0,-1.0,
+   1.0, 1.0, 1.0, -1.0, 1.0,-1.0, -1.0, 1.0, 1.0,
+   1.0, 1.0, 1.0, -1.0, 1.0, 1.0,  1.0,-1.0, 1.0
+};
+
+local time = 0;
+local batch, cubeBuffer;
+
+function update(dt)
+  time = time + dt;
+end
+
+function draw(alpha)
+  gl.ClearColor(0, 0, 0.2, 0);
+  gl.Clear(gl.COLOR_BUFFER_BIT | gl.DEPTH_BUFFER_BIT);
+
+  batch:clear();
+  for y = 0, side - 1 do
+    for x = 0, side - 1 do
+      local wave = math.sin(time * 2 + (x + y) * 0.2);
+      batch:add(x / side * 1.9 - 0.95, y / side * 1.9 - 0.95, 0,
+        0.5 + wave * 0.5, x / side, y / side, 1);
+    end
+  end
+
+  gl.BindBuffer(gl.ARRAY_BUFFER, cubeBuffer);
+  gl.EnableVertexAttribArray(0);
+  gl.VertexAttribPointer(0, 3, gl.FLOAT, gl.FALSE, 0);
+  batch:draw(gl.TRIANGLES, 0, #cube / 3);
+  gl.DisableVertexAttribArray(0);
+end
+
+function awake()
+  CreateWindow();
+
+  local program = gl.CreateProgram();
+  gl.AttachShader(program, shaders.load(vertexShader, gl.VERTEX_SHADER));
+  gl.AttachShader(program, shaders.load(fragmentShader, gl.FRAGMENT_SHADER));
+  gl.BindAttribLocation(program, 0, "position");
+  gl.BindAttribLocation(program, 1, "offset");
+  gl.BindAttribLocation(program, 2, "color");
+  gl.LinkProgram(program);
+  gl.UseProgram(program);
+
+  gl.BindVertexArray(gl.GenVertexArray());
+  cubeBuffer = gl.GenBuffer();
+  gl.BindBuffer(gl.ARRAY_BUFFER, cubeBuffer);
+  gl.BufferData(gl.ARRAY_BUFFER, gl.Buffer(cube), gl.STATIC_DRAW);
+
+  batch = instances.new(side * side, {{1, 3}, {2, 4}});
+end
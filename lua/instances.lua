@@ -0,0 +1,124 @@
+--///////////////
+--// INSTANCES //
+--///////////////
+
+-- Per instance attributes (transforms, colors...) packed into one gl.Buffer
+-- and drawn with a single instanced call instead of one call per object.
+--
+--   local instances = dofile("lua/instances.lua");
+--   -- a vec3 offset at attribute location 1 and a color at 2
+--   local batch = instances.new(10000, {{1, 3}, {2, 4}});
+--
+--   batch:clear();
+--   for _, o in ipairs(objects) do
+--     batch:add(o.x, o.y, o.z, o.r, o.g, o.b, o.a);
+--   end
+--   batch:draw(gl.TRIANGLES, 0, 36); -- with the mesh attributes set up as usual
+--
+-- batch.data is the gl.Buffer itself, engine.jobs kernels, workers or
+-- data:set can fill it directly, then batch:fill(count) says how many
+-- instances it holds.
+
+local instances = {_TYPE='module', _NAME='instances', _VERSION='0.1'}
+
+local Batch = {}
+Batch.__index = Batch
+
+-- attributes is a list of {location, floats}. More than 4 floats take the
+-- following locations too, like a mat4 does in GLSL.
+function instances.new(capacity, attributes)
+  local batch = setmetatable({capacity = capacity, count = 0, stride = 0, dirty = false,
+    attributes = {}}, Batch);
+
+  for _, attribute in ipairs(attributes) do
+    local location, floats = attribute[1], attribute[2];
+    local offset = batch.stride;
+    while floats > 0 do
+      local size = math.min(floats, 4);
+      table.insert(batch.attributes, {location = location, size = size, offset = offset * 4});
+      location = location + 1;
+      floats = floats - size;
+      offset = offset + size;
+    end
+    batch.stride = batch.stride + attribute[2];
+  end
+
+  batch.data = gl.Buffer("float32", capacity * batch.stride);
+  batch.buffer = gl.GenBuffer();
+  return batch;
+end
+
+function Batch:clear()
+  self.count = 0;
+  self.dirty = true;
+end
+
+-- Appends one instance, stride numbers in attribute order, and returns its
+-- index.
+function Batch:add(...)
+  local count = self.count;
+  if count >= self.capacity then
+    error("instance batch is full (" .. self.capacity .. ")");
+  end
+  self.data:put(count * self.stride + 1, ...);
+  self.count = count + 1;
+  self.dirty = true;
+  return self.count;
+end
+
+-- For instances written through batch.data.
+function Batch:fill(count)
+  assert(count >= 0 and count <= self.capacity, "count out of range");
+  self.count = count;
+  self.dirty = true;
+end
+
+-- Uploads the instances if they changed and points the attributes at them,
+-- leaving the instance buffer bound to ARRAY_BUFFER.
+function Batch:bind()
+  gl.BindBuffer(gl.ARRAY_BUFFER, self.buffer);
+  if self.dirty then
+    -- orphan the store, last frame's draws may still be reading it
+    gl.BufferData(gl.ARRAY_BUFFER, self.capacity * self.stride * 4, gl.STREAM_DRAW);
+    gl.BufferSubData(gl.ARRAY_BUFFER, 0, self.count * self.stride * 4, self.data);
+    self.dirty = false;
+  end
+
+  local stride = self.stride * 4;
+  for _, a in ipairs(self.attributes) do
+    gl.EnableVertexAttribArray(a.location);
+    gl.VertexAttribPointer(a.location, a.size, gl.FLOAT, gl.FALSE, stride, a.offset);
+    gl.VertexAttribDivisor(a.location, 1);
+  end
+end
+
+-- Puts the attribute locations back to per vertex so later draws that use
+-- them aren't affected.
+function Batch:unbind()
+  for _, a in ipairs(self.attributes) do
+    gl.VertexAttribDivisor(a.location, 0);
+    gl.DisableVertexAttribArray(a.location);
+  end
+end
+
+-- One DrawArraysInstanced for every instance in the batch.
+function Batch:draw(mode, first, count)
+  if self.count == 0 then
+    return;
+  end
+  self:bind();
+  gl.DrawArraysInstanced(mode, first, count, self.count);
+  self:unbind();
+end
+
+-- The same with indices from the bound element array buffer, offset in bytes.
+function Batch:drawElements(mode, count, type, offset)
+  if self.count == 0 then
+    return;
+  end
+  self:bind();
+  gl.DrawElementInstanced(mode, count, type, offset or 0, self.count);
+  self:unbind();
+end
+
+return instances;
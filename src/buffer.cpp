@@ -0,0 +1,365 @@
+#include "buffer.h"
+#include "lua/src/lauxlib.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static const char* bufferName = "engine.buffer";
+
+static const size_t sizes[BUFFER_TYPES] = {1, 1, 2, 2, 4, 4, 4, 8};
+static const int arrayTypes[BUFFER_TYPES] = {
+  LUA_AINT8, LUA_AUINT8, LUA_AINT16, LUA_AUINT16,
+  LUA_AINT32, LUA_AUINT32, LUA_AFLOAT, LUA_ADOUBLE
+};
+static const char* names[BUFFER_TYPES + 1] = {
+  "int8",
+  "uint8",
+  "int16",
+  "uint16",
+  "int32",
+  "uint32",
+  "float32",
+  "float64",
+  NULL
+};
+
+Buffer* bufferCreate(BufferType type, size_t count)
+{
+  Buffer* buffer = new Buffer();
+  buffer->refs = 1;
+  buffer->type = type;
+  buffer->count = count;
+  buffer->size = count * sizes[type];
+  buffer->block = calloc(buffer->size + BUFFER_ALIGNMENT, 1);
+  if (buffer->block == NULL)
+  {
+    delete buffer;
+    return NULL;
+  }
+  uintptr_t address = (uintptr_t)buffer->block;
+  buffer->data = (uint8_t*)((address + BUFFER_ALIGNMENT - 1) & ~(uintptr_t)(BUFFER_ALIGNMENT - 1));
+  return buffer;
+}
+
+Buffer* bufferCreateView(BufferType type, void* data, size_t count)
+{
+  Buffer* buffer = new Buffer();
+  buffer->refs = 1;
+  buffer->type = type;
+  buffer->count = count;
+  buffer->size = count * sizes[type];
+  buffer->data = (uint8_t*)data;
+  buffer->block = NULL;
+  return buffer;
+}
+
+void bufferExpire(Buffer* buffer)
+{
+  buffer->count = 0;
+  buffer->size = 0;
+  buffer->data = NULL;
+}
+
+void bufferRetain(Buffer* buffer)
+{
+  buffer->refs.fetch_add(1, std::memory_order_relaxed);
+}
+
+void bufferRelease(Buffer* buffer)
+{
+  if (buffer->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+  {
+    free(buffer->block);
+    delete buffer;
+  }
+}
+
+size_t bufferElementSize(BufferType type)
+{
+  return sizes[type];
+}
+
+const char* bufferTypeName(BufferType type)
+{
+  return names[type];
+}
+
+BufferType bufferCheckType(lua_State* L, int index, const char* def)
+{
+  return (BufferType)luaL_checkoption(L, index, def, names);
+}
+
+static void pushMetatable(lua_State* L);
+
+void bufferPush(lua_State* L, Buffer* buffer)
+{
+  Buffer** ud = (Buffer**)lua_newuserdata(L, sizeof(Buffer*));
+  *ud = buffer;
+  pushMetatable(L);
+  lua_setmetatable(L, -2);
+}
+
+Buffer* bufferTest(lua_State* L, int index)
+{
+  Buffer** ud = (Buffer**)luaL_testudata(L, index, bufferName);
+  return ud != NULL ? *ud : NULL;
+}
+
+Buffer* bufferCheck(lua_State* L, int index)
+{
+  Buffer* buffer = *(Buffer**)luaL_checkudata(L, index, bufferName);
+  luaL_argcheck(L, buffer != NULL, index, "buffer has been released");
+  return buffer;
+}
+
+static double get(const Buffer* buffer, size_t i)
+{
+  switch (buffer->type)
+  {
+  case BUFFER_INT8: return ((int8_t*)buffer->data)[i];
+  case BUFFER_UINT8: return buffer->data[i];
+  case BUFFER_INT16: return ((int16_t*)buffer->data)[i];
+  case BUFFER_UINT16: return ((uint16_t*)buffer->data)[i];
+  case BUFFER_INT32: return ((int32_t*)buffer->data)[i];
+  case BUFFER_UINT32: return ((uint32_t*)buffer->data)[i];
+  case BUFFER_FLOAT32: return ((float*)buffer->data)[i];
+  case BUFFER_FLOAT64: return ((double*)buffer->data)[i];
+  default: return 0;
+  }
+}
+
+//integers truncate to int64 and wrap from there, like lua_getarray fills
+//them. NaN and values outside int64 store 0, casting them is undefined
+static void set(Buffer* buffer, size_t i, double value)
+{
+  lua_Integer integer = 0;
+  if (!lua_numbertointeger(value, &integer))
+  {
+    integer = 0;
+  }
+  switch (buffer->type)
+  {
+  case BUFFER_INT8: ((int8_t*)buffer->data)[i] = (int8_t)integer; break;
+  case BUFFER_UINT8: buffer->data[i] = (uint8_t)integer; break;
+  case BUFFER_INT16: ((int16_t*)buffer->data)[i] = (int16_t)integer; break;
+  case BUFFER_UINT16: ((uint16_t*)buffer->data)[i] = (uint16_t)integer; break;
+  case BUFFER_INT32: ((int32_t*)buffer->data)[i] = (int32_t)integer; break;
+  case BUFFER_UINT32: ((uint32_t*)buffer->data)[i] = (uint32_t)integer; break;
+  case BUFFER_FLOAT32: ((float*)buffer->data)[i] = (float)value; break;
+  case BUFFER_FLOAT64: ((double*)buffer->data)[i] = value; break;
+  default: break;
+  }
+}
+
+static void pushElement(lua_State* L, const Buffer* buffer, size_t i)
+{
+  if (buffer->type == BUFFER_FLOAT32 || buffer->type == BUFFER_FLOAT64)
+  {
+    lua_pushnumber(L, get(buffer, i));
+  }
+  else
+  {
+    lua_pushinteger(L, (lua_Integer)get(buffer, i));
+  }
+}
+
+const void* bufferCheckBytes(lua_State* L, int index, size_t* size)
+{
+  Buffer* buffer = bufferTest(L, index);
+  if (buffer != NULL)
+  {
+    *size = buffer->size;
+    return buffer->data;
+  }
+  if (lua_type(L, index) != LUA_TSTRING)
+  {
+    luaL_argerror(L, index, lua_pushfstring(L, "buffer or string expected, got %s",
+      luaL_typename(L, index)));
+  }
+  return lua_tolstring(L, index, size);
+}
+
+static size_t checkElement(lua_State* L, const Buffer* buffer, int index)
+{
+  lua_Integer i = luaL_checkinteger(L, index);
+  luaL_argcheck(L, i >= 1 && (size_t)i <= buffer->count, index, "index out of range");
+  return (size_t)i - 1;
+}
+
+// Copies the numbers of the table at index into buffer from element first
+static void fill(lua_State* L, Buffer* buffer, int index, size_t first)
+{
+  size_t count = lua_rawlen(L, index);
+  luaL_argcheck(L, first + count <= buffer->count, index, "doesn't fit in the buffer");
+  size_t bad = lua_getarray(L, index, arrayTypes[buffer->type],
+    buffer->data + first * sizes[buffer->type], 1, count);
+  if (bad != 0)
+  {
+    lua_rawgeti(L, index, (lua_Integer)bad);
+    luaL_error(L, "invalid entry #%d in array argument #%d (expected number, got %s)",
+      (int)bad, index, luaL_typename(L, -1));
+  }
+}
+
+// buffer[i], 1 based, or a method
+static int bufferIndex(lua_State* L)
+{
+  Buffer* buffer = bufferCheck(L, 1);
+  if (!lua_isinteger(L, 2))
+  {
+    lua_getmetatable(L, 1);
+    lua_pushvalue(L, 2);
+    lua_rawget(L, -2);
+    return 1;
+  }
+
+  pushElement(L, buffer, checkElement(L, buffer, 2));
+  return 1;
+}
+
+static int bufferNewIndex(lua_State* L)
+{
+  Buffer* buffer = bufferCheck(L, 1);
+  size_t i = checkElement(L, buffer, 2);
+  set(buffer, i, luaL_checknumber(L, 3));
+  return 0;
+}
+
+static int bufferLen(lua_State* L)
+{
+  lua_pushinteger(L, (lua_Integer)bufferCheck(L, 1)->count);
+  return 1;
+}
+
+// buffer:bytes() -> the contents as a string
+static int bufferBytes(lua_State* L)
+{
+  Buffer* buffer = bufferCheck(L, 1);
+  lua_pushlstring(L, (const char*)buffer->data, buffer->size);
+  return 1;
+}
+
+// buffer:write(bytes [, offset]) copies a string in at a byte offset
+static int bufferWrite(lua_State* L)
+{
+  Buffer* buffer = bufferCheck(L, 1);
+  size_t size = 0;
+  const char* bytes = luaL_checklstring(L, 2, &size);
+  lua_Integer offset = luaL_optinteger(L, 3, 0);
+  luaL_argcheck(L, offset >= 0 && (size_t)offset <= buffer->size && size <= buffer->size - offset,
+    2, "doesn't fit in the buffer");
+  memcpy(buffer->data + offset, bytes, size);
+  return 0;
+}
+
+// buffer:set(table [, first]) copies numbers in from element first (1)
+static int bufferSet(lua_State* L)
+{
+  Buffer* buffer = bufferCheck(L, 1);
+  luaL_checktype(L, 2, LUA_TTABLE);
+  lua_Integer first = luaL_optinteger(L, 3, 1);
+  luaL_argcheck(L, first >= 1, 3, "index out of range");
+  fill(L, buffer, 2, (size_t)first - 1);
+  return 0;
+}
+
+// buffer:put(first, ...) stores the numbers from element first on and
+// returns the index after them, so records can be appended in one call each:
+//   i = instances:put(i, x, y, z, r, g, b, a)
+static int bufferPut(lua_State* L)
+{
+  Buffer* buffer = bufferCheck(L, 1);
+  lua_Integer first = luaL_checkinteger(L, 2);
+  int count = lua_gettop(L) - 2;
+  luaL_argcheck(L, first >= 1 && (size_t)first - 1 + count <= buffer->count, 2,
+    "doesn't fit in the buffer");
+  for (int i = 0; i < count; ++i)
+  {
+    set(buffer, (size_t)first - 1 + i, luaL_checknumber(L, 3 + i));
+  }
+  lua_pushinteger(L, first + count);
+  return 1;
+}
+
+// buffer:type() -> "float32" etc, buffer:size() -> bytes
+static int bufferType(lua_State* L)
+{
+  lua_pushstring(L, names[bufferCheck(L, 1)->type]);
+  return 1;
+}
+
+static int bufferSize(lua_State* L)
+{
+  lua_pushinteger(L, (lua_Integer)bufferCheck(L, 1)->size);
+  return 1;
+}
+
+static int bufferGc(lua_State* L)
+{
+  Buffer** ud = (Buffer**)luaL_checkudata(L, 1, bufferName);
+  if (*ud != NULL)
+  {
+    bufferRelease(*ud);
+    *ud = NULL;
+  }
+  return 0;
+}
+
+// (type, count), (type, table) or (table) for float32. Zeroed, or a copy
+// of the table.
+int bufferLuaCreate(lua_State* L)
+{
+  if (lua_istable(L, 1))
+  {
+    lua_pushstring(L, names[BUFFER_FLOAT32]);
+    lua_insert(L, 1);
+  }
+
+  BufferType type = bufferCheckType(L, 1, NULL);
+  bool table = lua_istable(L, 2);
+  lua_Integer count = table ? (lua_Integer)lua_rawlen(L, 2) : luaL_checkinteger(L, 2);
+  luaL_argcheck(L, count >= 0 && count <= 0x7fffffff, 2, "invalid count");
+
+  Buffer* buffer = bufferCreate(type, (size_t)count);
+  if (buffer == NULL)
+  {
+    return luaL_error(L, "not enough memory for %d %s elements", (int)count, names[type]);
+  }
+  bufferPush(L, buffer);
+  if (table)
+  {
+    fill(L, *(Buffer**)lua_touserdata(L, -1), 2, 0);
+  }
+  return 1;
+}
+
+// created by whichever of gl.Buffer and engine.shared runs first
+static void pushMetatable(lua_State* L)
+{
+  static const luaL_Reg methods[] = {
+    {"__index", bufferIndex},
+    {"__newindex", bufferNewIndex},
+    {"__len", bufferLen},
+    {"__gc", bufferGc},
+    {"bytes", bufferBytes},
+    {"write", bufferWrite},
+    {"set", bufferSet},
+    {"put", bufferPut},
+    {"type", bufferType},
+    {"size", bufferSize},
+    {NULL, NULL}
+  };
+
+  if (luaL_newmetatable(L, bufferName))
+  {
+    luaL_setfuncs(L, methods, 0);
+  }
+}
+
+void bufferRegister(lua_State* L)
+{
+  lua_getglobal(L, "engine");
+  lua_pushcfunction(L, bufferLuaCreate);
+  lua_setfield(L, -2, "shared");
+  lua_pop(L, 1);
+}
@@ -0,0 +1,81 @@
+#ifndef __BUFFER_H__
+#define __BUFFER_H__
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include "lua/src/lua.h"
+
+// Typed arrays for scripts: packed elements in aligned memory that gl
+// functions, engine.jobs kernels and worker messages use directly, with no
+// per element trips through the VM. The same object is made by gl.Buffer
+// in the main state and engine.shared in workers:
+//
+//   local verts = gl.Buffer("float32", {-1, -1, 0,  1, -1, 0,  0, 1, 0})
+//   verts[4] = 0.5                    -- 1 based, like a table
+//   gl.BufferData(gl.ARRAY_BUFFER, verts, gl.STATIC_DRAW)
+//
+// Buffers are reference counted so they can be sent to workers, which see
+// the same memory. There is no locking, scripts hand buffers back and forth
+// or split them between writers.
+enum BufferType
+{
+  BUFFER_INT8,
+  BUFFER_UINT8,
+  BUFFER_INT16,
+  BUFFER_UINT16,
+  BUFFER_INT32,
+  BUFFER_UINT32,
+  BUFFER_FLOAT32,
+  BUFFER_FLOAT64,
+  BUFFER_TYPES
+};
+
+#define BUFFER_ALIGNMENT 64
+
+struct Buffer
+{
+  std::atomic<int> refs;
+  BufferType type;
+  size_t count;
+  size_t size;    // bytes
+  uint8_t* data;  // BUFFER_ALIGNMENT aligned, zeroed
+  void* block;    // what was allocated, NULL for views
+};
+
+// NULL when the memory can't be allocated.
+Buffer* bufferCreate(BufferType type, size_t count);
+
+// A buffer over memory owned by someone else, like a mapped GL buffer. The
+// owner calls bufferExpire before the memory goes away, after which the
+// view reads as empty.
+Buffer* bufferCreateView(BufferType type, void* data, size_t count);
+void bufferExpire(Buffer* buffer);
+void bufferRetain(Buffer* buffer);
+void bufferRelease(Buffer* buffer);
+
+size_t bufferElementSize(BufferType type);
+const char* bufferTypeName(BufferType type);
+
+// A type name argument, def when it is absent (NULL makes it required).
+BufferType bufferCheckType(lua_State* L, int index, const char* def);
+
+// Pushes a userdata for buffer, taking over one reference.
+void bufferPush(lua_State* L, Buffer* buffer);
+
+// The buffer at index, or NULL if it isn't one.
+Buffer* bufferTest(lua_State* L, int index);
+Buffer* bufferCheck(lua_State* L, int index);
+
+// Contents of a buffer or a string argument, raises an error for anything
+// else.
+const void* bufferCheckBytes(lua_State* L, int index, size_t* size);
+
+// Sets engine.shared(type, count | table), the engine table must be a
+// global.
+void bufferRegister(lua_State* L);
+
+// The constructor, for registering under other names (gl.Buffer).
+int bufferLuaCreate(lua_State* L);
+
+#endif
@@ -0,0 +1,83 @@
+#include "callbacks.h"
+#include "lua/src/lauxlib.h"
+
+#include <stdio.h>
+
+static const char* names[CALLBACK_COUNT] = {
+  "awake",
+  "update",
+  "draw",
+  "input"
+};
+
+// Stores a callback in its slot. Undefined is kept as false, a nil hole in
+// the registry's array part could be handed out again by luaL_ref.
+static void setSlot(lua_State* L, int ref, int value)
+{
+  if (lua_isnil(L, value))
+  {
+    lua_pushboolean(L, 0);
+  }
+  else
+  {
+    lua_pushvalue(L, value);
+  }
+  lua_rawseti(L, LUA_REGISTRYINDEX, ref);
+}
+
+void callbacksInit(lua_State* L, Callbacks* cb, int handler)
+{
+  cb->handler = lua_absindex(L, handler);
+
+  for (int i = 0; i < CALLBACK_COUNT; ++i)
+  {
+    //reserve a slot, luaL_ref won't give one out for nil
+    lua_pushboolean(L, 0);
+    cb->refs[i] = luaL_ref(L, LUA_REGISTRYINDEX);
+  }
+  callbacksResolve(L, cb);
+}
+
+void callbacksResolve(lua_State* L, Callbacks* cb)
+{
+  lua_pushglobaltable(L);
+  for (int i = 0; i < CALLBACK_COUNT; ++i)
+  {
+    lua_pushstring(L, names[i]);
+    lua_rawget(L, -2);
+    setSlot(L, cb->refs[i], -1);
+    lua_pop(L, 1);
+  }
+  lua_pop(L, 1);
+}
+
+int callbacksCall(lua_State* L, const Callbacks* cb, Callback which, int nargs)
+{
+  if (lua_rawgeti(L, LUA_REGISTRYINDEX, cb->refs[which]) != LUA_TFUNCTION)
+  {
+    lua_pop(L, nargs + 1);
+    return 0;
+  }
+  lua_insert(L, -(nargs + 1));
+
+  if (lua_pcall(L, nargs, 0, cb->handler) != 0)
+  {
+    fprintf(stderr, "%s: %s\n", names[which], lua_tostring(L, -1));
+    lua_pop(L, 1);  /* pop error message from the stack */
+    return -1;
+  }
+
+  return 0;
+}
+
+bool callbacksDefined(lua_State* L, const Callbacks* cb, Callback which)
+{
+  bool defined = lua_rawgeti(L, LUA_REGISTRYINDEX, cb->refs[which]) == LUA_TFUNCTION;
+  lua_pop(L, 1);
+  return defined;
+}
+
+const char* callbacksName(Callback which)
+{
+  return names[which];
+}
@@ -0,0 +1,44 @@
+#ifndef __CALLBACKS_H__
+#define __CALLBACKS_H__
+
+#include "lua/src/lua.h"
+
+// Engine entry points a script can define as globals.
+enum Callback
+{
+  CALLBACK_AWAKE,
+  CALLBACK_UPDATE,
+  CALLBACK_DRAW,
+  CALLBACK_INPUT,
+  CALLBACK_COUNT
+};
+
+// Each callback is cached in a fixed registry slot, so calling it never has
+// to look anything up by name. callbacksResolve copies the globals into the
+// slots. The engine runs it after the script and awake have run, after a
+// dofile, and on engine.ResolveCallbacks() for a script that replaces a
+// callback by assignment. _G itself is left alone, scripts are free to give
+// it a metatable of their own.
+struct Callbacks
+{
+  int refs[CALLBACK_COUNT];
+  int handler;   // absolute stack index of the error handler
+};
+
+// handler is the stack index of the message handler used for every call, it
+// has to stay on the stack.
+void callbacksInit(lua_State* L, Callbacks* cb, int handler);
+
+// Reads the callback globals, without metamethods, into their slots.
+void callbacksResolve(lua_State* L, Callbacks* cb);
+
+// Calls a callback with the nargs values on top of the stack, popping them.
+// An undefined callback is skipped. Returns non zero on a Lua error, which
+// has already been reported.
+int callbacksCall(lua_State* L, const Callbacks* cb, Callback which, int nargs = 0);
+
+bool callbacksDefined(lua_State* L, const Callbacks* cb, Callback which);
+
+const char* callbacksName(Callback which);
+
+#endif
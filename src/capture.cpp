@@ -0,0 +1,352 @@
+#include "capture.h"
+#include "cmdlist.h"
+#include "luagl.h"
+#include "lua/src/lauxlib.h"
+
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+static const char magic[6] = {'G', 'L', 'C', 'A', 'P', '\0'};
+#define CAPTURE_VERSION 1
+
+// Both live in userdata so the closures that point at them can't outlive
+// them, whatever lua_close collects first.
+struct Capture
+{
+  FILE* file;
+  CommandList list;
+  CaptureStats stats;
+  bool failed;
+};
+
+struct Replay
+{
+  std::vector<std::string> names;
+  std::vector<CommandList> frames;
+  size_t next;
+};
+
+template <typename T>
+static void write(Capture* c, T value)
+{
+  if (fwrite(&value, sizeof(T), 1, c->file) != 1)
+  {
+    c->failed = true;
+  }
+}
+
+static int captureCall(lua_State* L)
+{
+  Capture* c = (Capture*)lua_touserdata(L, lua_upvalueindex(1));
+  int nargs = lua_gettop(L);
+  if (c->file != NULL
+    && cmdlistAppend(L, &c->list, (uint16_t)lua_tointeger(L, lua_upvalueindex(2)), 1) != 0)
+  {
+    c->stats.dropped++;
+  }
+
+  lua_pushvalue(L, lua_upvalueindex(3));
+  lua_insert(L, 1);
+  lua_call(L, nargs, LUA_MULTRET);
+  return lua_gettop(L);
+}
+
+static int captureGc(lua_State* L)
+{
+  Capture* c = (Capture*)lua_touserdata(L, 1);
+  if (c->file != NULL)
+  {
+    fclose(c->file);
+  }
+  c->~Capture();
+  return 0;
+}
+
+Capture* captureStart(lua_State* L, const char* path)
+{
+  FILE* file = fopen(path, "wb");
+  if (file == NULL)
+  {
+    return NULL;
+  }
+
+  Capture* c = new (lua_newuserdata(L, sizeof(Capture))) Capture();
+  c->file = file;
+  c->stats = CaptureStats();
+  c->failed = false;
+  cmdlistInit(&c->list, 64 * 1024);
+  lua_newtable(L);
+  lua_pushcfunction(L, captureGc);
+  lua_setfield(L, -2, "__gc");
+  lua_setmetatable(L, -2);
+  lua_setfield(L, LUA_REGISTRYINDEX, "gl.capture");
+
+  //assigning to existing fields is allowed during lua_next
+  std::vector<std::string> names;
+  lua_getglobal(L, "gl");
+  int gl = lua_gettop(L);
+  lua_pushnil(L);
+  while (lua_next(L, gl))
+  {
+    if (lua_iscfunction(L, -1) && lua_type(L, -2) == LUA_TSTRING
+      && !luaL_opengl_islocal(lua_tostring(L, -2)))
+    {
+      names.push_back(lua_tostring(L, -2));
+
+      lua_pushvalue(L, -2);
+      lua_pushlightuserdata(L, c);
+      lua_pushinteger(L, names.size() - 1);
+      lua_pushvalue(L, -4);
+      lua_pushcclosure(L, captureCall, 3);
+      lua_rawset(L, gl);
+    }
+    lua_pop(L, 1);
+  }
+  lua_pop(L, 1);
+
+  fwrite(magic, sizeof(magic), 1, file);
+  write<uint16_t>(c, CAPTURE_VERSION);
+  write<uint32_t>(c, (uint32_t)names.size());
+  for (size_t i = 0; i < names.size(); ++i)
+  {
+    write<uint16_t>(c, (uint16_t)names[i].size());
+    fwrite(names[i].data(), 1, names[i].size(), file);
+  }
+  return c;
+}
+
+void captureFrame(Capture* c)
+{
+  if (c->file == NULL)
+  {
+    return;
+  }
+
+  write<uint32_t>(c, c->list.commands);
+  write<uint32_t>(c, (uint32_t)c->list.data.size());
+  if (!c->list.data.empty()
+    && fwrite(c->list.data.data(), c->list.data.size(), 1, c->file) != 1)
+  {
+    c->failed = true;
+  }
+
+  c->stats.frames++;
+  c->stats.commands += c->list.commands;
+  c->stats.bytes += c->list.data.size();
+  cmdlistReset(&c->list);
+}
+
+bool captureStop(Capture* c)
+{
+  if (c->list.commands > 0)
+  {
+    captureFrame(c);
+  }
+  if (c->file != NULL && fclose(c->file) != 0)
+  {
+    c->failed = true;
+  }
+  c->file = NULL;
+  return !c->failed;
+}
+
+CaptureStats captureStats(Capture* c)
+{
+  return c->stats;
+}
+
+int capturePushStats(lua_State* L, void* ud)
+{
+  CaptureStats stats = captureStats((Capture*)ud);
+  lua_createtable(L, 0, 4);
+  lua_pushinteger(L, (lua_Integer)stats.frames);
+  lua_setfield(L, -2, "frames");
+  lua_pushinteger(L, (lua_Integer)stats.commands);
+  lua_setfield(L, -2, "commands");
+  lua_pushinteger(L, (lua_Integer)stats.bytes);
+  lua_setfield(L, -2, "bytes");
+  lua_pushinteger(L, (lua_Integer)stats.dropped);
+  lua_setfield(L, -2, "dropped");
+  return 1;
+}
+
+static void play(lua_State* L, const CommandList* list)
+{
+  int functions = lua_upvalueindex(2);
+  size_t cursor = 0;
+  while (cursor < list->data.size())
+  {
+    uint16_t function = 0;
+    int nargs = 0;
+    cursor = cmdlistDecode(L, list, cursor, &function, &nargs);
+
+    lua_rawgeti(L, functions, function + 1);
+    lua_insert(L, -(nargs + 1));
+    lua_call(L, nargs, 0);
+  }
+}
+
+static int replayAwake(lua_State* L)
+{
+  Replay* replay = (Replay*)lua_touserdata(L, lua_upvalueindex(1));
+  lua_getglobal(L, "CreateWindow");
+  lua_call(L, 0, 0);
+  play(L, &replay->frames[0]);
+  return 0;
+}
+
+static int replayDraw(lua_State* L)
+{
+  Replay* replay = (Replay*)lua_touserdata(L, lua_upvalueindex(1));
+  if (replay->frames.size() < 2)
+  {
+    return 0;
+  }
+
+  play(L, &replay->frames[replay->next]);
+  replay->next = replay->next + 1 < replay->frames.size() ? replay->next + 1 : 1;
+  return 0;
+}
+
+static int replayMissing(lua_State* L)
+{
+  return 0;
+}
+
+// The chunk captureLoadReplay pushes. The gl table is only final once the
+// engine has set up, so functions are looked up by name here.
+static int replayDefine(lua_State* L)
+{
+  Replay* replay = (Replay*)lua_touserdata(L, lua_upvalueindex(1));
+
+  lua_getglobal(L, "gl");
+  int gl = lua_gettop(L);
+  lua_createtable(L, (int)replay->names.size(), 0);
+  for (size_t i = 0; i < replay->names.size(); ++i)
+  {
+    lua_getfield(L, gl, replay->names[i].c_str());
+    if (!lua_isfunction(L, -1))
+    {
+      fprintf(stderr, "replay: no gl.%s in this build, its calls are skipped\n",
+        replay->names[i].c_str());
+      lua_pop(L, 1);
+      lua_pushcfunction(L, replayMissing);
+    }
+    lua_rawseti(L, -2, i + 1);
+  }
+
+  lua_pushvalue(L, lua_upvalueindex(1));
+  lua_pushvalue(L, -2);
+  lua_pushcclosure(L, replayAwake, 2);
+  lua_setglobal(L, "awake");
+  lua_pushvalue(L, lua_upvalueindex(1));
+  lua_pushvalue(L, -2);
+  lua_pushcclosure(L, replayDraw, 2);
+  lua_setglobal(L, "draw");
+  return 0;
+}
+
+static int replayGc(lua_State* L)
+{
+  ((Replay*)lua_touserdata(L, 1))->~Replay();
+  return 0;
+}
+
+template <typename T>
+static bool read(const std::vector<uint8_t>& data, size_t* cursor, T* value)
+{
+  if (data.size() - *cursor < sizeof(T))
+  {
+    return false;
+  }
+  memcpy(value, &data[*cursor], sizeof(T));
+  *cursor += sizeof(T);
+  return true;
+}
+
+static bool parse(Replay* replay, const std::vector<uint8_t>& data)
+{
+  size_t cursor = sizeof(magic);
+  uint16_t version = 0;
+  uint32_t functions = 0;
+  if (data.size() < sizeof(magic) || memcmp(data.data(), magic, sizeof(magic)) != 0
+    || !read(data, &cursor, &version) || version != CAPTURE_VERSION
+    || !read(data, &cursor, &functions) || functions > 0xffff)
+  {
+    return false;
+  }
+
+  for (uint32_t i = 0; i < functions; ++i)
+  {
+    uint16_t length = 0;
+    if (!read(data, &cursor, &length) || data.size() - cursor < length)
+    {
+      return false;
+    }
+    replay->names.push_back(std::string((const char*)&data[cursor], length));
+    cursor += length;
+  }
+
+  while (cursor < data.size())
+  {
+    uint32_t commands = 0;
+    uint32_t bytes = 0;
+    if (!read(data, &cursor, &commands) || !read(data, &cursor, &bytes)
+      || data.size() - cursor < bytes)
+    {
+      return false;
+    }
+
+    replay->frames.push_back(CommandList());
+    CommandList* list = &replay->frames.back();
+    list->data.assign(data.begin() + cursor, data.begin() + cursor + bytes);
+    list->commands = commands;
+    if (!cmdlistCheck(list, commands, (uint16_t)functions))
+    {
+      return false;
+    }
+    cursor += bytes;
+  }
+
+  return !replay->frames.empty();
+}
+
+int captureLoadReplay(lua_State* L, const char* path)
+{
+  FILE* file = fopen(path, "rb");
+  if (file == NULL)
+  {
+    fprintf(stderr, "Unable to open capture %s\n", path);
+    return 1;
+  }
+
+  std::vector<uint8_t> data;
+  uint8_t chunk[64 * 1024];
+  size_t n = 0;
+  while ((n = fread(chunk, 1, sizeof(chunk), file)) > 0)
+  {
+    data.insert(data.end(), chunk, chunk + n);
+  }
+  fclose(file);
+
+  Replay* replay = new (lua_newuserdata(L, sizeof(Replay))) Replay();
+  replay->next = 1;
+  lua_newtable(L);
+  lua_pushcfunction(L, replayGc);
+  lua_setfield(L, -2, "__gc");
+  lua_setmetatable(L, -2);
+
+  if (!parse(replay, data))
+  {
+    lua_pop(L, 1);
+    fprintf(stderr, "%s is not a capture this build can replay\n", path);
+    return 2;
+  }
+
+  lua_pushcclosure(L, replayDefine, 1);
+  return 0;
+}
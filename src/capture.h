@@ -0,0 +1,61 @@
+#ifndef __CAPTURE_H__
+#define __CAPTURE_H__
+
+#include <stdint.h>
+#include "lua/src/lua.h"
+
+// Capture and replay of gl calls, for looking at a frame offline and for
+// benchmarking the bindings with the calls a real script makes.
+//
+// --capture out.glcap wraps every gl function so each call is appended to
+// the frame's command list (the cmdlist.h encoding) before it is made, and
+// captureFrame writes the list out. Everything before the first frame,
+// loading and awake, is written as a setup frame of its own.
+//
+// --replay out.glcap plays a capture through the gl table of a state, so
+// it runs against the real context, the null backend with --headless or
+// the render thread with --render-thread. The setup frame runs in awake
+// and each draw runs the next frame, starting over after the last one so
+// --frames sets the length of a run.
+//
+// Names of GL objects are recorded as the values Gen*/Create* returned.
+// A fresh context hands them out in the same order, so replaying the
+// setup frame recreates them, but nothing is remapped. Writes through
+// mapped or stream buffers aren't gl calls and aren't captured.
+//
+// File layout, little endian:
+//
+//   "GLCAP\0" uint16 version, uint32 functions,
+//   { uint16 length, name } * functions,
+//   { uint32 commands, uint32 bytes, command data } * frames
+
+struct CaptureStats
+{
+  uint64_t frames;
+  uint64_t commands;
+  uint64_t bytes;
+  uint64_t dropped;  // calls with arguments that can't be recorded
+};
+
+struct Capture;
+
+// Wraps the gl table of L, returns NULL when path can't be written.
+Capture* captureStart(lua_State* L, const char* path);
+
+// Writes the calls made since the last frame.
+void captureFrame(Capture* c);
+
+// Writes what is left and closes the file. Returns false if a write failed.
+bool captureStop(Capture* c);
+
+CaptureStats captureStats(Capture* c);
+
+// engine.stats.capture, see profilerAddSource
+int capturePushStats(lua_State* L, void* ud);
+
+// Reads a capture and pushes a chunk that defines awake and draw to play
+// it back, in place of a script. Returns 0, or non zero with a message on
+// stderr when the file can't be read or is malformed.
+int captureLoadReplay(lua_State* L, const char* path);
+
+#endif
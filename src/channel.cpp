@@ -0,0 +1,144 @@
+#include "channel.h"
+
+#include <chrono>
+#include <string.h>
+#include <thread>
+
+Channel* channelCreate(size_t capacity)
+{
+  size_t size = 64;
+  while (size < capacity)
+  {
+    size <<= 1;
+  }
+
+  Channel* c = new Channel();
+  c->data = new uint8_t[size];
+  c->capacity = size;
+  c->head = 0;
+  c->tail = 0;
+  c->waiting = false;
+  c->closed = false;
+  return c;
+}
+
+void channelDestroy(Channel* c)
+{
+  delete[] c->data;
+  delete c;
+}
+
+static void copyIn(Channel* c, size_t at, const void* bytes, size_t size)
+{
+  size_t index = at & (c->capacity - 1);
+  size_t first = c->capacity - index < size ? c->capacity - index : size;
+  memcpy(c->data + index, bytes, first);
+  memcpy(c->data, (const uint8_t*)bytes + first, size - first);
+}
+
+static void copyOut(const Channel* c, size_t at, void* bytes, size_t size)
+{
+  size_t index = at & (c->capacity - 1);
+  size_t first = c->capacity - index < size ? c->capacity - index : size;
+  memcpy(bytes, c->data + index, first);
+  memcpy((uint8_t*)bytes + first, c->data, size - first);
+}
+
+bool channelSend(Channel* c, const void* bytes, size_t size)
+{
+  if (c->closed.load(std::memory_order_relaxed))
+  {
+    return false;
+  }
+
+  size_t need = sizeof(uint32_t) + size;
+  size_t tail = c->tail.load(std::memory_order_relaxed);
+  size_t head = c->head.load(std::memory_order_acquire);
+  if (c->capacity - (tail - head) < need)
+  {
+    return false;
+  }
+
+  uint32_t length = (uint32_t)size;
+  copyIn(c, tail, &length, sizeof(length));
+  copyIn(c, tail + sizeof(length), bytes, size);
+
+  //seq_cst pairs with the receiver publishing waiting before it checks for
+  //messages, one of us always sees the other
+  c->tail.store(tail + need);
+  if (c->waiting.load())
+  {
+    std::lock_guard<std::mutex> lock(c->mutex);
+    c->wake.notify_one();
+  }
+
+  return true;
+}
+
+bool channelReceive(Channel* c, std::vector<uint8_t>* out)
+{
+  size_t head = c->head.load(std::memory_order_relaxed);
+  size_t tail = c->tail.load(std::memory_order_acquire);
+  if (head == tail)
+  {
+    return false;
+  }
+
+  uint32_t length = 0;
+  copyOut(c, head, &length, sizeof(length));
+  out->resize(length);
+  copyOut(c, head + sizeof(length), out->data(), length);
+
+  c->head.store(head + sizeof(length) + length, std::memory_order_release);
+  return true;
+}
+
+static bool ready(Channel* c)
+{
+  return c->head.load(std::memory_order_relaxed) != c->tail.load() || c->closed.load();
+}
+
+bool channelWait(Channel* c, double timeout)
+{
+  //messages usually come in bursts, spin briefly before sleeping
+  for (int i = 0; i < 64; ++i)
+  {
+    if (ready(c))
+    {
+      return c->head.load(std::memory_order_relaxed) != c->tail.load();
+    }
+    std::this_thread::yield();
+  }
+
+  auto deadline = std::chrono::steady_clock::now()
+    + std::chrono::microseconds((long long)(timeout * 1e6));
+
+  std::unique_lock<std::mutex> lock(c->mutex);
+  c->waiting.store(true);
+  while (!ready(c))
+  {
+    if (timeout < 0)
+    {
+      c->wake.wait(lock);
+    }
+    else if (c->wake.wait_until(lock, deadline) == std::cv_status::timeout)
+    {
+      break;
+    }
+  }
+  c->waiting.store(false);
+
+  return c->head.load(std::memory_order_relaxed) != c->tail.load();
+}
+
+void channelClose(Channel* c)
+{
+  c->closed.store(true);
+  std::lock_guard<std::mutex> lock(c->mutex);
+  c->wake.notify_all();
+}
+
+size_t channelMaxMessage(const Channel* c)
+{
+  return c->capacity - sizeof(uint32_t);
+}
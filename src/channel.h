@@ -0,0 +1,53 @@
+#ifndef __CHANNEL_H__
+#define __CHANNEL_H__
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// Single producer, single consumer message queue. Messages are length
+// prefixed byte records in a power of two ring. Sending and receiving are
+// lock free; the mutex is only taken to sleep a receiver that asked to
+// block, and by a sender waking one.
+struct Channel
+{
+  uint8_t* data;
+  size_t capacity;
+
+  //padded so the two ends don't share a cache line
+  std::atomic<size_t> head;  // consumer position
+  char headPad[64];
+  std::atomic<size_t> tail;  // producer position
+  char tailPad[64];
+  std::atomic<bool> waiting;
+  std::atomic<bool> closed;
+
+  std::mutex mutex;
+  std::condition_variable wake;
+};
+
+// capacity is rounded up to a power of two.
+Channel* channelCreate(size_t capacity);
+void channelDestroy(Channel* c);
+
+// Returns false if there is no room, or the channel is closed.
+bool channelSend(Channel* c, const void* bytes, size_t size);
+
+// Takes the oldest message into out. Returns false when there is none.
+bool channelReceive(Channel* c, std::vector<uint8_t>* out);
+
+// Blocks until a message arrives, the channel is closed or timeout seconds
+// pass (a negative timeout waits forever). Returns true if a message is
+// ready.
+bool channelWait(Channel* c, double timeout);
+
+// Wakes a blocked receiver, later sends fail.
+void channelClose(Channel* c);
+
+// Largest message that fits.
+size_t channelMaxMessage(const Channel* c);
+
+#endif
@@ -0,0 +1,246 @@
+#include "cmdlist.h"
+#include "buffer.h"
+#include "lua/src/lauxlib.h"
+
+#include <string.h>
+
+template <typename T>
+static void put(CommandList* list, T value)
+{
+  size_t at = list->data.size();
+  list->data.resize(at + sizeof(T));
+  memcpy(&list->data[at], &value, sizeof(T));
+}
+
+static void putBytes(CommandList* list, const void* bytes, size_t size)
+{
+  size_t at = list->data.size();
+  list->data.resize(at + size);
+  memcpy(&list->data[at], bytes, size);
+}
+
+template <typename T>
+static T get(const CommandList* list, size_t* cursor)
+{
+  T value;
+  memcpy(&value, &list->data[*cursor], sizeof(T));
+  *cursor += sizeof(T);
+  return value;
+}
+
+void cmdlistInit(CommandList* list, size_t reserve)
+{
+  list->data.reserve(reserve);
+  list->commands = 0;
+}
+
+void cmdlistReset(CommandList* list)
+{
+  list->data.clear();
+  list->commands = 0;
+}
+
+int cmdlistAppend(lua_State* L, CommandList* list, uint16_t function, int first)
+{
+  int top = lua_gettop(L);
+  size_t start = list->data.size();
+
+  put<uint16_t>(list, function);
+  put<uint8_t>(list, (uint8_t)(top - first + 1));
+
+  for (int i = first; i <= top; ++i)
+  {
+    switch (lua_type(L, i))
+    {
+    case LUA_TNIL:
+    case LUA_TNONE:
+      put<uint8_t>(list, ARG_NIL);
+      break;
+    case LUA_TBOOLEAN:
+      put<uint8_t>(list, lua_toboolean(L, i) ? ARG_TRUE : ARG_FALSE);
+      break;
+    case LUA_TNUMBER:
+      if (lua_isinteger(L, i))
+      {
+        put<uint8_t>(list, ARG_INTEGER);
+        put<int64_t>(list, lua_tointeger(L, i));
+      }
+      else
+      {
+        put<uint8_t>(list, ARG_NUMBER);
+        put<double>(list, lua_tonumber(L, i));
+      }
+      break;
+    case LUA_TSTRING:
+    {
+      size_t length = 0;
+      const char* s = lua_tolstring(L, i, &length);
+      put<uint8_t>(list, ARG_STRING);
+      put<uint32_t>(list, (uint32_t)length);
+      putBytes(list, s, length);
+      break;
+    }
+    case LUA_TTABLE:
+    {
+      uint32_t count = (uint32_t)lua_rawlen(L, i);
+      put<uint8_t>(list, ARG_ARRAY);
+      put<uint32_t>(list, count);
+      for (uint32_t j = 0; j < count; ++j)
+      {
+        lua_rawgeti(L, i, j + 1);
+        int isnum = 0;
+        double value = lua_tonumberx(L, -1, &isnum);
+        lua_pop(L, 1);
+        if (!isnum)
+        {
+          list->data.resize(start);
+          return i;
+        }
+        put<double>(list, value);
+      }
+      break;
+    }
+    case LUA_TUSERDATA:
+    {
+      //buffers are copied, scripts may write to them before the replay.
+      //The bytes are what gl functions take from a buffer or a string.
+      Buffer* buffer = bufferTest(L, i);
+      if (buffer != NULL)
+      {
+        put<uint8_t>(list, ARG_STRING);
+        put<uint32_t>(list, (uint32_t)buffer->size);
+        putBytes(list, buffer->data, buffer->size);
+        break;
+      }
+    }
+    //fall through
+    default:
+      list->data.resize(start);
+      return i;
+    }
+  }
+
+  list->commands++;
+  return 0;
+}
+
+void cmdlistRecord(lua_State* L, CommandList* list, uint16_t function, int first)
+{
+  int bad = cmdlistAppend(L, list, function, first);
+  if (bad == 0)
+  {
+    return;
+  }
+  if (lua_type(L, bad) == LUA_TTABLE)
+  {
+    luaL_argerror(L, bad, "tables of numbers only can be recorded for the render thread");
+  }
+  luaL_argerror(L, bad, "can't be recorded for the render thread");
+}
+
+size_t cmdlistDecode(lua_State* L, const CommandList* list, size_t cursor,
+  uint16_t* function, int* nargs)
+{
+  *function = get<uint16_t>(list, &cursor);
+  *nargs = get<uint8_t>(list, &cursor);
+
+  luaL_checkstack(L, *nargs, "replaying command");
+  for (int i = 0; i < *nargs; ++i)
+  {
+    switch (get<uint8_t>(list, &cursor))
+    {
+    case ARG_NIL:
+      lua_pushnil(L);
+      break;
+    case ARG_FALSE:
+      lua_pushboolean(L, 0);
+      break;
+    case ARG_TRUE:
+      lua_pushboolean(L, 1);
+      break;
+    case ARG_INTEGER:
+      lua_pushinteger(L, get<int64_t>(list, &cursor));
+      break;
+    case ARG_NUMBER:
+      lua_pushnumber(L, get<double>(list, &cursor));
+      break;
+    case ARG_STRING:
+    {
+      uint32_t length = get<uint32_t>(list, &cursor);
+      lua_pushlstring(L, (const char*)list->data.data() + cursor, length);
+      cursor += length;
+      break;
+    }
+    case ARG_ARRAY:
+    {
+      uint32_t count = get<uint32_t>(list, &cursor);
+      lua_createtable(L, count, 0);
+      for (uint32_t j = 0; j < count; ++j)
+      {
+        lua_pushnumber(L, get<double>(list, &cursor));
+        lua_rawseti(L, -2, j + 1);
+      }
+      break;
+    }
+    }
+  }
+
+  return cursor;
+}
+
+bool cmdlistCheck(const CommandList* list, uint32_t commands, uint16_t functions)
+{
+  size_t size = list->data.size();
+  size_t cursor = 0;
+  for (uint32_t i = 0; i < commands; ++i)
+  {
+    if (size - cursor < 3 || get<uint16_t>(list, &cursor) >= functions)
+    {
+      return false;
+    }
+
+    int nargs = get<uint8_t>(list, &cursor);
+    for (int j = 0; j < nargs; ++j)
+    {
+      if (cursor == size)
+      {
+        return false;
+      }
+
+      size_t payload = 0;
+      uint8_t tag = get<uint8_t>(list, &cursor);
+      switch (tag)
+      {
+      case ARG_NIL:
+      case ARG_FALSE:
+      case ARG_TRUE:
+        break;
+      case ARG_INTEGER:
+      case ARG_NUMBER:
+        payload = 8;
+        break;
+      case ARG_STRING:
+      case ARG_ARRAY:
+        if (size - cursor < 4)
+        {
+          return false;
+        }
+        payload = get<uint32_t>(list, &cursor);
+        if (tag == ARG_ARRAY)
+        {
+          payload *= sizeof(double);
+        }
+        break;
+      default:
+        return false;
+      }
+
+      if (size - cursor < payload)
+      {
+        return false;
+      }
+      cursor += payload;
+    }
+  }
+  return cursor == size;
+}
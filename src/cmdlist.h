@@ -0,0 +1,54 @@
+#ifndef __CMDLIST_H__
+#define __CMDLIST_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "lua/src/lua.h"
+
+// Recorded calls to Lua C functions. Each command is the index of the
+// function followed by its arguments, encoded as a tag byte and an inline
+// payload so strings and numeric arrays are captured by value:
+//
+//   uint16 function, uint8 nargs, { uint8 tag, payload } * nargs
+enum CommandArg
+{
+  ARG_NIL,
+  ARG_FALSE,
+  ARG_TRUE,
+  ARG_INTEGER,  // int64
+  ARG_NUMBER,   // double
+  ARG_STRING,   // uint32 length, bytes, also a buffer's contents
+  ARG_ARRAY     // uint32 count, doubles, a table of numbers
+};
+
+// The storage is kept between frames, once it has grown to the size of a
+// frame recording doesn't allocate.
+struct CommandList
+{
+  std::vector<uint8_t> data;
+  uint32_t commands;
+};
+
+void cmdlistInit(CommandList* list, size_t reserve);
+void cmdlistReset(CommandList* list);
+
+// Records a call to function with the arguments at stack index first up to
+// the top. Raises a Lua error for arguments that can't be captured.
+void cmdlistRecord(lua_State* L, CommandList* list, uint16_t function, int first);
+
+// cmdlistRecord without the error, returns 0 or the index of the first
+// argument that can't be captured, in which case nothing is recorded.
+int cmdlistAppend(lua_State* L, CommandList* list, uint16_t function, int first);
+
+// Pushes the arguments of the command at cursor onto L. Returns the cursor
+// of the next command.
+size_t cmdlistDecode(lua_State* L, const CommandList* list, size_t cursor,
+  uint16_t* function, int* nargs);
+
+// True when data holds exactly commands well formed commands calling
+// functions below functions. Lists read from a file are checked with this
+// before they are decoded.
+bool cmdlistCheck(const CommandList* list, uint32_t commands, uint16_t functions);
+
+#endif
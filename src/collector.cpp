@@ -0,0 +1,179 @@
+#include "collector.h"
+#include "timer.h"
+
+#include <string.h>
+
+// Work a LUA_GCSTEP of 0 does at least, lgc.h's GCSTEPSIZE on 64 bit
+// builds. Lua converts bytes allocated to work at stepmul / 200.
+#define STEP_WORK 2400.0
+#define STEPMUL_BYTES 200.0
+
+static double heapKB(lua_State* L)
+{
+  return lua_gc(L, LUA_GCCOUNT, 0) + lua_gc(L, LUA_GCCOUNTB, 0) / 1024.0;
+}
+
+void collectorInit(Collector* c, lua_State* L, const MemoryStats* memory, bool enabled)
+{
+  memset(c, 0, sizeof(Collector));
+  c->L = L;
+  c->memory = memory;
+  c->enabled = enabled;
+  c->pause = lua_gc(L, LUA_GCSETPAUSE, 0);
+  lua_gc(L, LUA_GCSETPAUSE, c->pause);
+  c->stepmul = lua_gc(L, LUA_GCSETSTEPMUL, 0);
+  lua_gc(L, LUA_GCSETSTEPMUL, c->stepmul);
+}
+
+void collectorStart(Collector* c)
+{
+  if (!c->enabled)
+  {
+    return;
+  }
+
+  lua_gc(c->L, LUA_GCSTOP, 0);
+  c->running = true;
+  c->collecting = false;
+  c->estimate = heapKB(c->L);
+  c->allocated = c->memory->allocated;
+  c->owed = 0;
+}
+
+void collectorSetParams(Collector* c, int pause, int stepmul)
+{
+  if (pause >= 0)
+  {
+    c->pause = pause;
+    lua_gc(c->L, LUA_GCSETPAUSE, pause);
+  }
+  if (stepmul >= 0)
+  {
+    c->stepmul = stepmul;
+    lua_gc(c->L, LUA_GCSETSTEPMUL, stepmul);
+  }
+}
+
+// One small step, true when it finished the cycle
+static bool step(Collector* c)
+{
+  c->stats.steps++;
+  c->owed -= STEP_WORK;
+  if (lua_gc(c->L, LUA_GCSTEP, 0) == 0)
+  {
+    return false;
+  }
+
+  c->stats.cycles++;
+  c->collecting = false;
+  c->owed = 0;
+  c->estimate = heapKB(c->L);
+  return true;
+}
+
+void collectorFrame(Collector* c, uint64_t deadline)
+{
+  if (!c->running)
+  {
+    return;
+  }
+
+  uint64_t allocated = c->memory->allocated - c->allocated;
+  c->allocated = c->memory->allocated;
+  if (!c->collecting)
+  {
+    if (heapKB(c->L) < c->estimate * c->pause / 100.0)
+    {
+      return;
+    }
+    c->collecting = true;
+  }
+  c->owed += allocated * (double)c->stepmul / STEPMUL_BYTES;
+
+  uint64_t steps = c->stats.steps;
+  uint64_t start = timerNow();
+  uint64_t now = start;
+  bool done = false;
+  while (!done && now + c->stepTime + COLLECTOR_MARGIN < deadline)
+  {
+    done = step(c);
+    uint64_t end = timerNow();
+    c->stepTime = c->stepTime == 0 ? end - now : (c->stepTime * 7 + (end - now)) / 8;
+    now = end;
+  }
+  while (!done && c->owed > 0)
+  {
+    done = step(c);
+    c->stats.forced++;
+  }
+  //what idle steps did beyond the debt isn't banked
+  if (c->owed < 0)
+  {
+    c->owed = 0;
+  }
+
+  uint64_t time = timerNow() - start;
+  if (c->stats.steps == steps)
+  {
+    return;
+  }
+
+  int bucket = 0;
+  while (bucket + 1 < COLLECTOR_BUCKETS && time >= collectorBucketLimit(bucket))
+  {
+    bucket++;
+  }
+  c->stats.pauses[bucket]++;
+  c->stats.frames++;
+  c->stats.time += time;
+  c->stats.longest = time > c->stats.longest ? time : c->stats.longest;
+}
+
+uint64_t collectorBucketLimit(int bucket)
+{
+  return bucket + 1 < COLLECTOR_BUCKETS ? 16000ull << bucket : 0;
+}
+
+int collectorPushStats(lua_State* L, void* ud)
+{
+  Collector* c = (Collector*)ud;
+  lua_createtable(L, 0, 9);
+  lua_pushinteger(L, c->pause);
+  lua_setfield(L, -2, "pause");
+  lua_pushinteger(L, c->stepmul);
+  lua_setfield(L, -2, "stepmul");
+  lua_pushinteger(L, (lua_Integer)c->stats.cycles);
+  lua_setfield(L, -2, "cycles");
+  lua_pushinteger(L, (lua_Integer)c->stats.steps);
+  lua_setfield(L, -2, "steps");
+  lua_pushinteger(L, (lua_Integer)c->stats.forced);
+  lua_setfield(L, -2, "forced");
+  lua_pushinteger(L, (lua_Integer)c->stats.frames);
+  lua_setfield(L, -2, "frames");
+  lua_pushnumber(L, c->stats.time * 1e-6);
+  lua_setfield(L, -2, "ms");
+  lua_pushnumber(L, c->stats.longest * 1e-6);
+  lua_setfield(L, -2, "longest");
+
+  //{limit in ms or false for the last, frames}
+  lua_createtable(L, COLLECTOR_BUCKETS, 0);
+  for (int i = 0; i < COLLECTOR_BUCKETS; ++i)
+  {
+    lua_createtable(L, 2, 0);
+    uint64_t limit = collectorBucketLimit(i);
+    if (limit > 0)
+    {
+      lua_pushnumber(L, limit * 1e-6);
+    }
+    else
+    {
+      lua_pushboolean(L, 0);
+    }
+    lua_rawseti(L, -2, 1);
+    lua_pushinteger(L, (lua_Integer)c->stats.pauses[i]);
+    lua_rawseti(L, -2, 2);
+    lua_rawseti(L, -2, i + 1);
+  }
+  lua_setfield(L, -2, "pauses");
+  return 1;
+}
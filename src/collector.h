@@ -0,0 +1,86 @@
+#ifndef __COLLECTOR_H__
+#define __COLLECTOR_H__
+
+#include <stdint.h>
+#include "memory.h"
+#include "lua/src/lua.h"
+
+// Host driven garbage collection. Lua's own pacing runs a collector step
+// whenever an allocation takes the debt over its limit, which can be in the
+// middle of draw(). Once the main loop starts the engine stops that and
+// runs LUA_GCSTEP itself, between draw and the buffer swap, for as long as
+// the frame has time left.
+//
+// The pause and step multiplier keep their meaning. A cycle starts when the
+// heap has grown by pause percent since the last one ended, and while one
+// runs each frame owes the work Lua would have done for what the frame
+// allocated, stepmul percent of it. Steps in idle time pay that off; what is
+// still owed when the time runs out is done anyway, so a frame without
+// spare time, or a run that isn't paced, collects at Lua's usual rate and
+// the heap can't run away.
+//
+// Nothing is collected in the middle of a frame, except the full collection
+// Lua makes when an allocation fails.
+//
+// In Lua's generational mode (collectgarbage "generational") a step is a
+// whole minor collection and ends the cycle, so pause is the growth that
+// starts the next one, 120 for Lua's default of 20 percent.
+
+// Time before the frame's deadline left for the swap.
+#define COLLECTOR_MARGIN 1000000ull  // 1 ms
+
+// Pause histogram, bucket i counts frames whose collection took less than
+// 16 << i microseconds, the last bucket everything longer.
+#define COLLECTOR_BUCKETS 12
+
+struct CollectorStats
+{
+  uint64_t cycles;
+  uint64_t steps;
+  uint64_t forced;   // steps taken after the deadline to pay what was owed
+  uint64_t frames;   // frames that collected
+  uint64_t time;     // ns spent collecting
+  uint64_t longest;  // ns, one frame
+  uint64_t pauses[COLLECTOR_BUCKETS];
+};
+
+struct Collector
+{
+  lua_State* L;
+  const MemoryStats* memory;
+  bool enabled;
+  bool running;     // started and enabled
+  int pause;
+  int stepmul;
+
+  bool collecting;  // a cycle is under way
+  double estimate;  // KB in use when the last cycle ended
+  uint64_t allocated;
+  double owed;      // work units, as Lua counts them
+  uint64_t stepTime; // ns, recent average of one step
+  CollectorStats stats;
+};
+
+// memory is the state's allocator counters. Disabled, Lua keeps collecting
+// on its own and collectorFrame does nothing.
+void collectorInit(Collector* c, lua_State* L, const MemoryStats* memory, bool enabled);
+
+// Stops Lua's automatic collection and starts pacing it from the heap as it
+// is now, call it when the main loop starts.
+void collectorStart(Collector* c);
+
+// Sets the pause and step multiplier, in percent like collectgarbage's,
+// values below 0 keep the current ones.
+void collectorSetParams(Collector* c, int pause, int stepmul);
+
+// Steps the collector until deadline, a timerNow() value, and then until
+// what the frame owes is paid. deadline 0 means there is no idle time.
+void collectorFrame(Collector* c, uint64_t deadline);
+
+// Upper bound of a pause bucket in ns, 0 for the last.
+uint64_t collectorBucketLimit(int bucket);
+
+// Stats source for engine.stats.collector, ud is the Collector.
+int collectorPushStats(lua_State* L, void* ud);
+
+#endif
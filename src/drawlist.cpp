@@ -0,0 +1,179 @@
+#include "drawlist.h"
+#include "lua/src/lauxlib.h"
+
+#include <string.h>
+
+static const char* listName = "engine.drawlist";
+
+static size_t recordSize(bool elements)
+{
+  return elements ? sizeof(DrawElementsRecord) : sizeof(DrawArraysRecord);
+}
+
+void drawlistInit(DrawList* list, bool elements, uint32_t capacity)
+{
+  list->elements = elements;
+  list->count = 0;
+  list->capacity = capacity > 0 ? capacity : 1;
+  list->records = bufferCreate(BUFFER_UINT32, list->capacity * recordSize(elements) / 4);
+}
+
+void drawlistFree(DrawList* list)
+{
+  if (list->records != NULL)
+  {
+    bufferRelease(list->records);
+    list->records = NULL;
+  }
+}
+
+//a records buffer handed to Lua earlier keeps the old contents
+static void grow(DrawList* list)
+{
+  Buffer* records = bufferCreate(BUFFER_UINT32, list->capacity * 2 * recordSize(list->elements) / 4);
+  memcpy(records->data, list->records->data, list->records->size);
+  bufferRelease(list->records);
+  list->records = records;
+  list->capacity *= 2;
+}
+
+void drawlistAddArrays(DrawList* list, const DrawArraysRecord& record)
+{
+  if (list->count == list->capacity)
+  {
+    grow(list);
+  }
+  ((DrawArraysRecord*)list->records->data)[list->count++] = record;
+}
+
+void drawlistAddElements(DrawList* list, const DrawElementsRecord& record)
+{
+  if (list->count == list->capacity)
+  {
+    grow(list);
+  }
+  ((DrawElementsRecord*)list->records->data)[list->count++] = record;
+}
+
+static DrawList* checkList(lua_State* L, int index)
+{
+  return (DrawList*)luaL_checkudata(L, index, listName);
+}
+
+static uint32_t checkField(lua_State* L, int index, lua_Integer def)
+{
+  lua_Integer value = luaL_optinteger(L, index, def);
+  luaL_argcheck(L, value >= 0 && value <= 0xffffffff, index, "out of range");
+  return (uint32_t)value;
+}
+
+// list:add(count, first [, instances [, baseInstance]]) for arrays,
+// list:add(count, firstIndex [, baseVertex [, instances [, baseInstance]]])
+// for elements. Returns the number of records.
+static int drawlistLuaAdd(lua_State* L)
+{
+  DrawList* list = checkList(L, 1);
+  if (list->elements)
+  {
+    lua_Integer baseVertex = luaL_optinteger(L, 4, 0);
+    luaL_argcheck(L, baseVertex >= INT32_MIN && baseVertex <= INT32_MAX, 4, "out of range");
+    DrawElementsRecord record = {
+      checkField(L, 2, 0), checkField(L, 5, 1), checkField(L, 3, 0), (int32_t)baseVertex,
+      checkField(L, 6, 0)
+    };
+    drawlistAddElements(list, record);
+  }
+  else
+  {
+    DrawArraysRecord record = {
+      checkField(L, 2, 0), checkField(L, 4, 1), checkField(L, 3, 0), checkField(L, 5, 0)
+    };
+    drawlistAddArrays(list, record);
+  }
+
+  lua_pushinteger(L, list->count);
+  return 1;
+}
+
+static int drawlistLuaClear(lua_State* L)
+{
+  checkList(L, 1)->count = 0;
+  return 0;
+}
+
+static int drawlistLuaLen(lua_State* L)
+{
+  lua_pushinteger(L, checkList(L, 1)->count);
+  return 1;
+}
+
+// list:records() -> the uint32 gl.Buffer the records are packed in, for
+// uploading to an indirect buffer or filling from workers
+static int drawlistLuaRecords(lua_State* L)
+{
+  DrawList* list = checkList(L, 1);
+  bufferRetain(list->records);
+  bufferPush(L, list->records);
+  return 1;
+}
+
+// list:submit(mode) for arrays, list:submit(mode, type) for elements
+static int drawlistLuaSubmit(lua_State* L)
+{
+  DrawList* list = checkList(L, 1);
+  lua_Integer mode = luaL_checkinteger(L, 2);
+  lua_Integer type = list->elements ? luaL_checkinteger(L, 3) : 0;
+  if (list->count == 0)
+  {
+    return 0;
+  }
+
+  lua_getglobal(L, "gl");
+  lua_getfield(L, -1, list->elements ? "MultiDrawElementsIndirect" : "MultiDrawArraysIndirect");
+  lua_pushinteger(L, mode);
+  if (list->elements)
+  {
+    lua_pushinteger(L, type);
+  }
+  bufferRetain(list->records);
+  bufferPush(L, list->records);
+  lua_pushinteger(L, list->count);
+  lua_call(L, list->elements ? 4 : 3, 0);
+  return 0;
+}
+
+static int drawlistLuaGc(lua_State* L)
+{
+  drawlistFree(checkList(L, 1));
+  return 0;
+}
+
+int drawlistLuaCreate(lua_State* L)
+{
+  static const char* kinds[] = {"arrays", "elements", NULL};
+  static const luaL_Reg methods[] = {
+    {"add", drawlistLuaAdd},
+    {"clear", drawlistLuaClear},
+    {"records", drawlistLuaRecords},
+    {"submit", drawlistLuaSubmit},
+    {"__len", drawlistLuaLen},
+    {"__gc", drawlistLuaGc},
+    {NULL, NULL}
+  };
+
+  lua_Integer capacity = luaL_optinteger(L, 1, 64);
+  luaL_argcheck(L, capacity >= 0 && capacity <= 0x1000000, 1, "invalid capacity");
+  bool elements = luaL_checkoption(L, 2, "arrays", kinds) == 1;
+
+  DrawList* list = (DrawList*)lua_newuserdata(L, sizeof(DrawList));
+  list->records = NULL;
+  if (luaL_newmetatable(L, listName))
+  {
+    luaL_setfuncs(L, methods, 0);
+    lua_pushvalue(L, -1);
+    lua_setfield(L, -2, "__index");
+  }
+  lua_setmetatable(L, -2);
+  drawlistInit(list, elements, (uint32_t)capacity);
+  return 1;
+}
@@ -0,0 +1,57 @@
+#ifndef __DRAWLIST_H__
+#define __DRAWLIST_H__
+
+#include <stdint.h>
+#include "buffer.h"
+#include "lua/src/lua.h"
+
+// Indirect draw lists: draw records packed the way glMultiDraw*Indirect
+// reads them, built with one native call per draw and submitted with one
+// gl call for the whole list.
+//
+//   local list = gl.DrawList(1024, "elements")
+//   for _, mesh in ipairs(meshes) do
+//     list:add(mesh.count, mesh.firstIndex, mesh.baseVertex)
+//   end
+//   list:submit(gl.TRIANGLES, gl.UNSIGNED_INT)
+//   list:clear()
+//
+// submit goes through gl.MultiDrawArraysIndirect or
+// gl.MultiDrawElementsIndirect in the gl table, so the render thread
+// records it like any other draw and contexts without multi draw indirect
+// get the loop fallback there.
+
+struct DrawArraysRecord
+{
+  uint32_t count;
+  uint32_t instances;
+  uint32_t first;
+  uint32_t baseInstance;
+};
+
+struct DrawElementsRecord
+{
+  uint32_t count;
+  uint32_t instances;
+  uint32_t firstIndex;
+  int32_t baseVertex;
+  uint32_t baseInstance;
+};
+
+struct DrawList
+{
+  bool elements;
+  Buffer* records;  // uint32 elements, doubles when full
+  uint32_t count;
+  uint32_t capacity;
+};
+
+void drawlistInit(DrawList* list, bool elements, uint32_t capacity);
+void drawlistFree(DrawList* list);
+void drawlistAddArrays(DrawList* list, const DrawArraysRecord& record);
+void drawlistAddElements(DrawList* list, const DrawElementsRecord& record);
+
+// gl.DrawList(capacity [, "arrays" | "elements"]), registered in the gl table.
+int drawlistLuaCreate(lua_State* L);
+
+#endif
@@ -0,0 +1,366 @@
+#include "glnull.h"
+#include "luagl.h"
+#include "lua/src/lauxlib.h"
+
+#if EMSCRIPTEN
+
+#else
+#define USE_GLEW 1
+#endif
+
+#include "SDL/SDL.h"
+
+#if USE_GLEW
+#include "GL/glew.h"
+#else
+#include "SDL/SDL_opengl.h"
+#endif
+
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+struct NullFunction
+{
+  const char* name;  // interned by the gl table's key, which outlives us
+  lua_CFunction function;
+  long long calls;
+};
+
+struct NullBackend
+{
+  int count;
+  NullFunction functions[1];
+};
+
+static const char* registryKey = "gl.null";
+
+#if USE_GLEW
+
+// GL names handed out by the stubs, only the GL thread calls them
+static GLuint nextName;
+
+template <typename R, typename... Args>
+static R GLAPIENTRY nullCall(Args...)
+{
+  return R();
+}
+
+template <typename R, typename... Args>
+static R GLAPIENTRY nullTrue(Args...)
+{
+  return GL_TRUE;
+}
+
+template <typename... Args>
+static GLuint GLAPIENTRY nullName(Args...)
+{
+  return ++nextName;
+}
+
+static void GLAPIENTRY nullNames(GLsizei n, GLuint* names)
+{
+  for (GLsizei i = 0; i < n; ++i)
+  {
+    names[i] = ++nextName;
+  }
+}
+
+// Queries answer 1, which reads as success for the status ones, and there
+// are no logs
+template <typename A>
+static void GLAPIENTRY nullGet(A, GLenum pname, GLint* params)
+{
+  *params = pname == GL_INFO_LOG_LENGTH ? 0 : 1;
+}
+
+template <typename A, typename B, typename C>
+static void GLAPIENTRY nullGet(A, B, C, GLint* params)
+{
+  *params = 1;
+}
+
+template <typename A>
+static void GLAPIENTRY nullText(A, GLsizei size, GLsizei* length, GLchar* text)
+{
+  if (length != NULL)
+  {
+    *length = 0;
+  }
+  if (size > 0)
+  {
+    text[0] = 0;
+  }
+}
+
+template <typename A, typename B>
+static void GLAPIENTRY nullText(A, B, GLsizei size, GLsizei* length, GLchar* text)
+{
+  nullText<A>(0, size, length, text);
+}
+
+static const GLubyte* GLAPIENTRY nullString(GLenum, GLuint)
+{
+  return (const GLubyte*)"";
+}
+
+static GLenum GLAPIENTRY nullFramebufferStatus(GLenum)
+{
+  return GL_FRAMEBUFFER_COMPLETE;
+}
+
+static GLenum GLAPIENTRY nullWait(GLsync, GLbitfield, GLuint64)
+{
+  return GL_ALREADY_SIGNALED;
+}
+
+template <typename R, typename... Args>
+static void stub(R (GLAPIENTRY*& function)(Args...))
+{
+  function = nullCall<R, Args...>;
+}
+
+// Points GLEW's entry points, which glewInit never filled in without a
+// context, at stubs. GL 1.1 is exported by libGL itself rather than loaded
+// and does nothing without a current context. A GL function above 1.1 that
+// luagl, glstate, the streams, readbacks or uniform rings start calling
+// needs a line here.
+static void stubEntryPoints()
+{
+  __glewGenBuffers = nullNames;
+  __glewGenFramebuffers = nullNames;
+  __glewGenProgramPipelines = nullNames;
+  __glewGenRenderbuffers = nullNames;
+  __glewGenSamplers = nullNames;
+  __glewGenVertexArrays = nullNames;
+  __glewCreateBuffers = nullNames;
+  __glewCreateFramebuffers = nullNames;
+  __glewCreateProgramPipelines = nullNames;
+  __glewCreateRenderbuffers = nullNames;
+  __glewCreateSamplers = nullNames;
+  __glewCreateShader = nullName;
+  __glewCreateProgram = nullName;
+  __glewIsBuffer = nullTrue;
+  __glewIsEnabledi = nullTrue;
+  __glewIsFramebuffer = nullTrue;
+  __glewIsProgramPipeline = nullTrue;
+  __glewIsRenderbuffer = nullTrue;
+  __glewIsSampler = nullTrue;
+  __glewIsShader = nullTrue;
+  __glewIsVertexArray = nullTrue;
+  __glewUnmapBuffer = nullTrue;
+  __glewUnmapNamedBuffer = nullTrue;
+  __glewGetShaderiv = nullGet;
+  __glewGetProgramiv = nullGet;
+  __glewGetBufferParameteriv = nullGet;
+  __glewGetNamedBufferParameteriv = nullGet;
+  __glewGetActiveUniformBlockiv = nullGet;
+  __glewGetShaderInfoLog = nullText;
+  __glewGetProgramInfoLog = nullText;
+  __glewGetActiveUniformBlockName = nullText;
+  __glewGetStringi = nullString;
+  __glewCheckFramebufferStatus = nullFramebufferStatus;
+  __glewClientWaitSync = nullWait;
+
+  //the rest do nothing and return 0
+  stub(__glewActiveShaderProgram); stub(__glewActiveTexture); stub(__glewAttachShader);
+  stub(__glewBeginConditionalRender); stub(__glewBindAttribLocation); stub(__glewBindBuffer);
+  stub(__glewBindBufferBase); stub(__glewBindBufferRange); stub(__glewBindFramebuffer);
+  stub(__glewBindImageTexture); stub(__glewBindRenderbuffer); stub(__glewBindSampler);
+  stub(__glewBindTextureUnit); stub(__glewBindVertexArray); stub(__glewBindVertexBuffer);
+  stub(__glewBlendColor); stub(__glewBlendEquationSeparate); stub(__glewBlendEquationSeparatei);
+  stub(__glewBlendFuncSeparate); stub(__glewBlendFuncSeparatei); stub(__glewBufferData);
+  stub(__glewBufferStorage); stub(__glewBufferSubData); stub(__glewClampColor);
+  stub(__glewClearBufferData); stub(__glewClearBufferSubData); stub(__glewClearDepthf);
+  stub(__glewCompileShader); stub(__glewCopyTexSubImage3D); stub(__glewDeleteBuffers);
+  stub(__glewDeleteFramebuffers); stub(__glewDeleteProgram); stub(__glewDeleteProgramPipelines);
+  stub(__glewDeleteShader); stub(__glewDeleteSync); stub(__glewDeleteVertexArrays);
+  stub(__glewDepthRangeArrayv); stub(__glewDepthRangeIndexed); stub(__glewDepthRangef);
+  stub(__glewDetachShader); stub(__glewDisableVertexAttribArray); stub(__glewDisablei);
+  stub(__glewDrawArraysIndirect); stub(__glewDrawArraysInstanced);
+  stub(__glewDrawArraysInstancedBaseInstance); stub(__glewDrawBuffers);
+  stub(__glewDrawElementsBaseVertex); stub(__glewDrawElementsIndirect);
+  stub(__glewDrawElementsInstanced); stub(__glewDrawElementsInstancedBaseInstance);
+  stub(__glewDrawElementsInstancedBaseVertex);
+  stub(__glewDrawElementsInstancedBaseVertexBaseInstance); stub(__glewDrawRangeElements);
+  stub(__glewDrawRangeElementsBaseVertex); stub(__glewDrawTransformFeedback);
+  stub(__glewEnableVertexAttribArray); stub(__glewEnablei); stub(__glewFenceSync);
+  stub(__glewFlushMappedBufferRange); stub(__glewFlushMappedNamedBufferRange);
+  stub(__glewFramebufferRenderbuffer); stub(__glewFramebufferTexture);
+  stub(__glewFramebufferTexture1D); stub(__glewFramebufferTexture2D);
+  stub(__glewFramebufferTexture3D); stub(__glewGenerateMipmap); stub(__glewGetAttribLocation);
+  stub(__glewGetMultisamplefv); stub(__glewGetUniformBlockIndex); stub(__glewGetUniformLocation);
+  stub(__glewLinkProgram); stub(__glewMapBuffer); stub(__glewMapBufferRange);
+  stub(__glewMapNamedBuffer); stub(__glewMapNamedBufferRange); stub(__glewMinSampleShading);
+  stub(__glewMultiDrawArrays); stub(__glewMultiDrawArraysIndirect); stub(__glewMultiDrawElements);
+  stub(__glewMultiDrawElementsBaseVertex); stub(__glewMultiDrawElementsIndirect);
+  stub(__glewNamedBufferStorage); stub(__glewPointParameterf); stub(__glewPointParameteri);
+  stub(__glewPrimitiveRestartIndex); stub(__glewProgramUniform1dv); stub(__glewProgramUniform1fv);
+  stub(__glewProgramUniform1iv); stub(__glewProgramUniform1uiv); stub(__glewProgramUniform2dv);
+  stub(__glewProgramUniform2fv); stub(__glewProgramUniform2iv); stub(__glewProgramUniform2uiv);
+  stub(__glewProgramUniform3dv); stub(__glewProgramUniform3fv); stub(__glewProgramUniform3iv);
+  stub(__glewProgramUniform3uiv); stub(__glewProgramUniform4dv); stub(__glewProgramUniform4fv);
+  stub(__glewProgramUniform4iv); stub(__glewProgramUniform4uiv);
+  stub(__glewProgramUniformMatrix2dv); stub(__glewProgramUniformMatrix2fv);
+  stub(__glewProgramUniformMatrix2x3dv); stub(__glewProgramUniformMatrix2x3fv);
+  stub(__glewProgramUniformMatrix2x4dv); stub(__glewProgramUniformMatrix2x4fv);
+  stub(__glewProgramUniformMatrix3dv); stub(__glewProgramUniformMatrix3fv);
+  stub(__glewProgramUniformMatrix3x2dv); stub(__glewProgramUniformMatrix3x2fv);
+  stub(__glewProgramUniformMatrix3x4dv); stub(__glewProgramUniformMatrix3x4fv);
+  stub(__glewProgramUniformMatrix4dv); stub(__glewProgramUniformMatrix4fv);
+  stub(__glewProgramUniformMatrix4x2dv); stub(__glewProgramUniformMatrix4x2fv);
+  stub(__glewProgramUniformMatrix4x3dv); stub(__glewProgramUniformMatrix4x3fv);
+  stub(__glewProvokingVertex); stub(__glewReleaseShaderCompiler); stub(__glewRenderbufferStorage);
+  stub(__glewRenderbufferStorageMultisample); stub(__glewSampleCoverage); stub(__glewSampleMaski);
+  stub(__glewScissorArrayv); stub(__glewScissorIndexed); stub(__glewScissorIndexedv);
+  stub(__glewShaderSource); stub(__glewStencilFuncSeparate); stub(__glewStencilMaskSeparate);
+  stub(__glewStencilOpSeparate); stub(__glewTexBuffer); stub(__glewTexBufferRange);
+  stub(__glewTexImage3D); stub(__glewTexStorage1D); stub(__glewTexStorage2D);
+  stub(__glewTexStorage3D); stub(__glewTexSubImage3D); stub(__glewTextureView);
+  stub(__glewUniform1d); stub(__glewUniform1dv); stub(__glewUniform1f); stub(__glewUniform1fv);
+  stub(__glewUniform1i); stub(__glewUniform1iv); stub(__glewUniform1ui); stub(__glewUniform1uiv);
+  stub(__glewUniform2d); stub(__glewUniform2dv); stub(__glewUniform2f); stub(__glewUniform2fv);
+  stub(__glewUniform2i); stub(__glewUniform2iv); stub(__glewUniform2ui); stub(__glewUniform2uiv);
+  stub(__glewUniform3d); stub(__glewUniform3dv); stub(__glewUniform3f); stub(__glewUniform3fv);
+  stub(__glewUniform3i); stub(__glewUniform3iv); stub(__glewUniform3ui); stub(__glewUniform3uiv);
+  stub(__glewUniform4d); stub(__glewUniform4dv); stub(__glewUniform4f); stub(__glewUniform4fv);
+  stub(__glewUniform4i); stub(__glewUniform4iv); stub(__glewUniform4ui); stub(__glewUniform4uiv);
+  stub(__glewUniformBlockBinding); stub(__glewUniformMatrix2dv); stub(__glewUniformMatrix2fv);
+  stub(__glewUniformMatrix2x3dv); stub(__glewUniformMatrix2x3fv); stub(__glewUniformMatrix2x4dv);
+  stub(__glewUniformMatrix2x4fv); stub(__glewUniformMatrix3dv); stub(__glewUniformMatrix3fv);
+  stub(__glewUniformMatrix3x2dv); stub(__glewUniformMatrix3x2fv); stub(__glewUniformMatrix3x4dv);
+  stub(__glewUniformMatrix3x4fv); stub(__glewUniformMatrix4dv); stub(__glewUniformMatrix4fv);
+  stub(__glewUniformMatrix4x2dv); stub(__glewUniformMatrix4x2fv); stub(__glewUniformMatrix4x3dv);
+  stub(__glewUniformMatrix4x3fv); stub(__glewUseProgram); stub(__glewValidateProgram);
+  stub(__glewValidateProgramPipeline); stub(__glewVertexArrayBindingDivisor);
+  stub(__glewVertexAttribDivisor); stub(__glewVertexAttribPointer); stub(__glewViewportArrayv);
+  stub(__glewViewportIndexedf); stub(__glewViewportIndexedfv);
+}
+
+#endif
+
+// Counts the call and runs the luagl function it stands in for
+static int countedFunction(lua_State* L)
+{
+  NullFunction* f = (NullFunction*)lua_touserdata(L, lua_upvalueindex(1));
+  f->calls++;
+  return f->function(L);
+}
+
+// A C function without upvalues, which can be called from another closure
+static bool plainFunction(lua_State* L, int index)
+{
+  if (!lua_iscfunction(L, index))
+  {
+    return false;
+  }
+  if (lua_getupvalue(L, index, 1) == NULL)
+  {
+    return true;
+  }
+  lua_pop(L, 1);
+  return false;
+}
+
+static NullBackend* toBackend(lua_State* L)
+{
+  lua_getfield(L, LUA_REGISTRYINDEX, registryKey);
+  NullBackend* backend = (NullBackend*)lua_touserdata(L, -1);
+  lua_pop(L, 1);
+  return backend;
+}
+
+void glnullInstall(lua_State* L)
+{
+#if USE_GLEW
+  static bool stubbed = false;
+  if (!stubbed)
+  {
+    stubEntryPoints();
+    stubbed = true;
+  }
+#endif
+
+  lua_getglobal(L, "gl");
+  int gl = lua_gettop(L);
+
+  int count = 0;
+  lua_pushnil(L);
+  while (lua_next(L, gl))
+  {
+    if (lua_type(L, -2) == LUA_TSTRING && plainFunction(L, -1)
+      && !luaL_opengl_islocal(lua_tostring(L, -2)))
+    {
+      count++;
+    }
+    lua_pop(L, 1);
+  }
+
+  //the backend is kept alive by the registry, the closures only borrow it
+  size_t size = sizeof(NullBackend) + count * sizeof(NullFunction);
+  NullBackend* backend = (NullBackend*)lua_newuserdata(L, size);
+  memset(backend, 0, size);
+  lua_setfield(L, LUA_REGISTRYINDEX, registryKey);
+
+  //assigning to existing fields is allowed during lua_next
+  lua_pushnil(L);
+  while (lua_next(L, gl))
+  {
+    if (lua_type(L, -2) == LUA_TSTRING && plainFunction(L, -1)
+      && !luaL_opengl_islocal(lua_tostring(L, -2)))
+    {
+      NullFunction* f = &backend->functions[backend->count];
+      f->name = lua_tostring(L, -2);
+      f->function = lua_tocfunction(L, -1);
+
+      lua_pushvalue(L, -2);
+      lua_pushlightuserdata(L, f);
+      lua_pushcclosure(L, countedFunction, 1);
+      lua_rawset(L, gl);
+
+      backend->count++;
+    }
+    lua_pop(L, 1);
+  }
+
+  lua_pop(L, 1);
+}
+
+long long glnullCalls(lua_State* L)
+{
+  NullBackend* backend = toBackend(L);
+  long long total = 0;
+  for (int i = 0; backend && i < backend->count; ++i)
+  {
+    total += backend->functions[i].calls;
+  }
+  return total;
+}
+
+void glnullReport(lua_State* L, int limit)
+{
+  NullBackend* backend = toBackend(L);
+  if (backend == NULL)
+  {
+    return;
+  }
+
+  std::vector<NullFunction*> called;
+  for (int i = 0; i < backend->count; ++i)
+  {
+    if (backend->functions[i].calls > 0)
+    {
+      called.push_back(&backend->functions[i]);
+    }
+  }
+
+  std::sort(called.begin(), called.end(), [](NullFunction* a, NullFunction* b) {
+    return a->calls > b->calls;
+  });
+
+  for (int i = 0; i < (int)called.size() && i < limit; ++i)
+  {
+    fprintf(stdout, "  gl.%-28s %lld\n", called[i]->name, called[i]->calls);
+  }
+}
@@ -0,0 +1,22 @@
+#ifndef __GLNULL_H__
+#define __GLNULL_H__
+
+#include "lua/src/lua.h"
+
+// Runs scripts on machines without a GPU or display. GL's entry points are
+// pointed at stubs that never touch a driver, underneath luagl, so every gl
+// function still checks and converts its arguments and goes through the
+// state cache. The stubs return harmless values: object names from Gen* and
+// Create*, true from Is*, empty strings and logs, and 1 from the status and
+// parameter queries. GL 1.1's functions are libGL's own, and do nothing
+// without a current context. The gl table's functions are wrapped to count
+// their calls. Call it before any GL call, in place of glewInit.
+void glnullInstall(lua_State* L);
+
+// Prints the most called gl functions, at most limit of them.
+void glnullReport(lua_State* L, int limit);
+
+// Total number of gl calls the script made since glnullInstall.
+long long glnullCalls(lua_State* L);
+
+#endif
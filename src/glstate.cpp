@@ -0,0 +1,496 @@
+#include "glstate.h"
+
+#if EMSCRIPTEN
+
+#else
+#define USE_GLEW 1
+#endif
+
+#include "SDL/SDL.h"
+
+#if USE_GLEW
+#include "GL/glew.h"
+#else
+#include "SDL/SDL_opengl.h"
+#endif
+
+#include <atomic>
+
+#define UNKNOWN 0xffffffffu
+#define TEXTURE_UNITS 32
+
+static const GLenum bufferTargets[] = {
+  GL_ARRAY_BUFFER, GL_ELEMENT_ARRAY_BUFFER, GL_UNIFORM_BUFFER, GL_COPY_READ_BUFFER,
+  GL_COPY_WRITE_BUFFER, GL_PIXEL_PACK_BUFFER, GL_PIXEL_UNPACK_BUFFER, GL_DRAW_INDIRECT_BUFFER,
+  GL_TRANSFORM_FEEDBACK_BUFFER
+};
+#define BUFFER_TARGETS (sizeof(bufferTargets) / sizeof(bufferTargets[0]))
+
+// glGetIntegerv names of the bindings, in bufferTargets' order
+static const GLenum bufferBindings[BUFFER_TARGETS] = {
+  GL_ARRAY_BUFFER_BINDING, GL_ELEMENT_ARRAY_BUFFER_BINDING, GL_UNIFORM_BUFFER_BINDING,
+  GL_COPY_READ_BUFFER_BINDING, GL_COPY_WRITE_BUFFER_BINDING, GL_PIXEL_PACK_BUFFER_BINDING,
+  GL_PIXEL_UNPACK_BUFFER_BINDING, GL_DRAW_INDIRECT_BUFFER_BINDING,
+  GL_TRANSFORM_FEEDBACK_BUFFER_BINDING
+};
+
+static const GLenum textureTargets[] = {
+  GL_TEXTURE_2D, GL_TEXTURE_CUBE_MAP, GL_TEXTURE_3D, GL_TEXTURE_2D_ARRAY
+};
+#define TEXTURE_TARGETS (sizeof(textureTargets) / sizeof(textureTargets[0]))
+
+static const GLenum capabilities[] = {
+  GL_BLEND, GL_DEPTH_TEST, GL_CULL_FACE, GL_SCISSOR_TEST, GL_STENCIL_TEST,
+  GL_POLYGON_OFFSET_FILL, GL_SAMPLE_ALPHA_TO_COVERAGE, GL_DITHER
+};
+#define CAPS (sizeof(capabilities) / sizeof(capabilities[0]))
+
+// Every value is UNKNOWN until set through here.
+static struct
+{
+  bool enabled = true;
+  GLuint program;
+  GLuint vertexArray;
+  GLuint buffers[BUFFER_TARGETS];
+  GLenum activeTexture;
+  GLuint textures[TEXTURE_UNITS][TEXTURE_TARGETS];
+  GLuint drawFramebuffer;
+  GLuint readFramebuffer;
+  GLuint caps[CAPS];
+  GLenum blend[4];
+  GLenum equation[2];
+  GLenum depthFunc;
+  GLuint depthMask;
+  GLint viewport[4];
+  bool viewportKnown;
+} state;
+
+// Only the GL thread writes the counters, so a plain load and store is
+// enough and keeps a locked add out of every call.
+static std::atomic<uint64_t> issued(0);
+static std::atomic<uint64_t> elided(0);
+static std::atomic<uint64_t> frameIssued(0);
+static std::atomic<uint64_t> frameElided(0);
+static GLStateStats mark;
+
+static void count(std::atomic<uint64_t>& counter)
+{
+  counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+// True when the call has to be made, and records the new value.
+static bool update(GLuint* cached, GLuint value)
+{
+  if (state.enabled && *cached == value)
+  {
+    count(elided);
+    return false;
+  }
+  *cached = value;
+  count(issued);
+  return true;
+}
+
+template <size_t N>
+static int find(const GLenum (&list)[N], GLenum value)
+{
+  for (size_t i = 0; i < N; ++i)
+  {
+    if (list[i] == value)
+    {
+      return (int)i;
+    }
+  }
+  return -1;
+}
+
+static void forgetTextures()
+{
+  for (int unit = 0; unit < TEXTURE_UNITS; ++unit)
+  {
+    for (size_t target = 0; target < TEXTURE_TARGETS; ++target)
+    {
+      state.textures[unit][target] = UNKNOWN;
+    }
+  }
+}
+
+void glstateReset()
+{
+  state.program = UNKNOWN;
+  state.vertexArray = UNKNOWN;
+  for (size_t i = 0; i < BUFFER_TARGETS; ++i)
+  {
+    state.buffers[i] = UNKNOWN;
+  }
+  state.activeTexture = UNKNOWN;
+  forgetTextures();
+  state.drawFramebuffer = UNKNOWN;
+  state.readFramebuffer = UNKNOWN;
+  for (size_t i = 0; i < CAPS; ++i)
+  {
+    state.caps[i] = UNKNOWN;
+  }
+  for (int i = 0; i < 4; ++i)
+  {
+    state.blend[i] = UNKNOWN;
+  }
+  state.equation[0] = state.equation[1] = UNKNOWN;
+  state.depthFunc = UNKNOWN;
+  state.depthMask = UNKNOWN;
+  state.viewportKnown = false;
+}
+
+static struct Init
+{
+  Init()
+  {
+    glstateReset();
+  }
+} init;
+
+void glstateSetEnabled(bool enabled)
+{
+  state.enabled = enabled;
+}
+
+void glstateUseProgram(unsigned program)
+{
+  if (update(&state.program, program))
+  {
+    glUseProgram(program);
+  }
+}
+
+void glstateBindVertexArray(unsigned array)
+{
+  if (update(&state.vertexArray, array))
+  {
+    glBindVertexArray(array);
+    //the element array binding belongs to the vertex array
+    state.buffers[find(bufferTargets, GL_ELEMENT_ARRAY_BUFFER)] = UNKNOWN;
+  }
+}
+
+void glstateBindBuffer(unsigned target, unsigned buffer)
+{
+  int i = find(bufferTargets, target);
+  if (i < 0)
+  {
+    count(issued);
+    glBindBuffer(target, buffer);
+  }
+  else if (update(&state.buffers[i], buffer))
+  {
+    glBindBuffer(target, buffer);
+  }
+}
+
+unsigned glstateBoundBuffer(unsigned target)
+{
+  int i = find(bufferTargets, target);
+  if (i >= 0 && state.buffers[i] != UNKNOWN)
+  {
+    return state.buffers[i];
+  }
+
+  GLint buffer = 0;
+  glGetIntegerv(i >= 0 ? bufferBindings[i] : target, &buffer);
+  if (i >= 0)
+  {
+    state.buffers[i] = (GLuint)buffer;
+  }
+  return (unsigned)buffer;
+}
+
+//the indexed binding isn't cached, but it binds the generic one too
+void glstateBindBufferBase(unsigned target, unsigned index, unsigned buffer)
+{
+  count(issued);
+  glBindBufferBase(target, index, buffer);
+  int i = find(bufferTargets, target);
+  if (i >= 0)
+  {
+    state.buffers[i] = buffer;
+  }
+}
+
+void glstateBindBufferRange(unsigned target, unsigned index, unsigned buffer, ptrdiff_t offset,
+  ptrdiff_t size)
+{
+  count(issued);
+  glBindBufferRange(target, index, buffer, offset, size);
+  int i = find(bufferTargets, target);
+  if (i >= 0)
+  {
+    state.buffers[i] = buffer;
+  }
+}
+
+void glstateActiveTexture(unsigned unit)
+{
+  if (update(&state.activeTexture, unit))
+  {
+    glActiveTexture(unit);
+  }
+}
+
+void glstateBindTexture(unsigned target, unsigned texture)
+{
+  int i = find(textureTargets, target);
+  unsigned unit = state.activeTexture - GL_TEXTURE0;
+  if (i < 0 || unit >= TEXTURE_UNITS)
+  {
+    count(issued);
+    glBindTexture(target, texture);
+  }
+  else if (update(&state.textures[unit][i], texture))
+  {
+    glBindTexture(target, texture);
+  }
+}
+
+void glstateBindFramebuffer(unsigned target, unsigned framebuffer)
+{
+  bool draw = target == GL_FRAMEBUFFER || target == GL_DRAW_FRAMEBUFFER;
+  bool read = target == GL_FRAMEBUFFER || target == GL_READ_FRAMEBUFFER;
+  if (state.enabled && (!draw || state.drawFramebuffer == framebuffer)
+    && (!read || state.readFramebuffer == framebuffer))
+  {
+    count(elided);
+    return;
+  }
+
+  count(issued);
+  glBindFramebuffer(target, framebuffer);
+  if (draw)
+  {
+    state.drawFramebuffer = framebuffer;
+  }
+  if (read)
+  {
+    state.readFramebuffer = framebuffer;
+  }
+}
+
+void glstateEnable(unsigned cap, bool enable)
+{
+  int i = find(capabilities, cap);
+  if (i >= 0 && !update(&state.caps[i], enable))
+  {
+    return;
+  }
+  if (i < 0)
+  {
+    count(issued);
+  }
+
+  if (enable)
+  {
+    glEnable(cap);
+  }
+  else
+  {
+    glDisable(cap);
+  }
+}
+
+void glstateEnablei(unsigned cap, unsigned index, bool enable)
+{
+  count(issued);
+  if (enable)
+  {
+    glEnablei(cap, index);
+  }
+  else
+  {
+    glDisablei(cap, index);
+  }
+
+  //one index no longer says anything about the whole cap
+  int i = find(capabilities, cap);
+  if (i >= 0)
+  {
+    state.caps[i] = UNKNOWN;
+  }
+}
+
+void glstateBlendFunc(unsigned srcRGB, unsigned dstRGB, unsigned srcAlpha, unsigned dstAlpha)
+{
+  if (state.enabled && state.blend[0] == srcRGB && state.blend[1] == dstRGB
+    && state.blend[2] == srcAlpha && state.blend[3] == dstAlpha)
+  {
+    count(elided);
+    return;
+  }
+
+  count(issued);
+  glBlendFuncSeparate(srcRGB, dstRGB, srcAlpha, dstAlpha);
+  state.blend[0] = srcRGB;
+  state.blend[1] = dstRGB;
+  state.blend[2] = srcAlpha;
+  state.blend[3] = dstAlpha;
+}
+
+void glstateBlendEquation(unsigned rgb, unsigned alpha)
+{
+  if (state.enabled && state.equation[0] == rgb && state.equation[1] == alpha)
+  {
+    count(elided);
+    return;
+  }
+
+  count(issued);
+  glBlendEquationSeparate(rgb, alpha);
+  state.equation[0] = rgb;
+  state.equation[1] = alpha;
+}
+
+//like glstateEnablei, one draw buffer leaves the global state unknown
+void glstateBlendFunci(unsigned buffer, unsigned srcRGB, unsigned dstRGB, unsigned srcAlpha,
+  unsigned dstAlpha)
+{
+  count(issued);
+  glBlendFuncSeparatei(buffer, srcRGB, dstRGB, srcAlpha, dstAlpha);
+  for (int i = 0; i < 4; ++i)
+  {
+    state.blend[i] = UNKNOWN;
+  }
+}
+
+void glstateBlendEquationi(unsigned buffer, unsigned rgb, unsigned alpha)
+{
+  count(issued);
+  glBlendEquationSeparatei(buffer, rgb, alpha);
+  state.equation[0] = state.equation[1] = UNKNOWN;
+}
+
+void glstateDepthFunc(unsigned func)
+{
+  if (update(&state.depthFunc, func))
+  {
+    glDepthFunc(func);
+  }
+}
+
+void glstateDepthMask(bool mask)
+{
+  if (update(&state.depthMask, mask))
+  {
+    glDepthMask(mask ? GL_TRUE : GL_FALSE);
+  }
+}
+
+void glstateViewport(int x, int y, int width, int height)
+{
+  GLint* v = state.viewport;
+  if (state.enabled && state.viewportKnown && v[0] == x && v[1] == y && v[2] == width
+    && v[3] == height)
+  {
+    count(elided);
+    return;
+  }
+
+  count(issued);
+  glViewport(x, y, width, height);
+  v[0] = x;
+  v[1] = y;
+  v[2] = width;
+  v[3] = height;
+  state.viewportKnown = true;
+}
+
+// GL binds 0 in place of a deleted object that is bound
+static void forget(GLuint* cached, int count, const unsigned* names)
+{
+  for (int i = 0; i < count; ++i)
+  {
+    if (*cached == names[i])
+    {
+      *cached = 0;
+    }
+  }
+}
+
+void glstateForgetBuffers(int count, const unsigned* buffers)
+{
+  for (size_t i = 0; i < BUFFER_TARGETS; ++i)
+  {
+    forget(&state.buffers[i], count, buffers);
+  }
+}
+
+void glstateForgetTextures(int count, const unsigned* textures)
+{
+  for (int unit = 0; unit < TEXTURE_UNITS; ++unit)
+  {
+    for (size_t target = 0; target < TEXTURE_TARGETS; ++target)
+    {
+      forget(&state.textures[unit][target], count, textures);
+    }
+  }
+}
+
+void glstateForgetVertexArrays(int count, const unsigned* arrays)
+{
+  GLuint before = state.vertexArray;
+  forget(&state.vertexArray, count, arrays);
+  if (state.vertexArray != before)
+  {
+    state.buffers[find(bufferTargets, GL_ELEMENT_ARRAY_BUFFER)] = UNKNOWN;
+  }
+}
+
+void glstateForgetFramebuffers(int count, const unsigned* framebuffers)
+{
+  forget(&state.drawFramebuffer, count, framebuffers);
+  forget(&state.readFramebuffer, count, framebuffers);
+}
+
+// A program stays in use until another replaces it, even once deleted, so
+// this only has to stop a new program with a reused name from being elided.
+void glstateForgetProgram(unsigned program)
+{
+  if (state.program == program)
+  {
+    state.program = UNKNOWN;
+  }
+}
+
+GLStateStats glstateStats()
+{
+  GLStateStats stats = {issued.load(std::memory_order_relaxed),
+    elided.load(std::memory_order_relaxed)};
+  return stats;
+}
+
+void glstateFrame()
+{
+  GLStateStats now = glstateStats();
+  frameIssued.store(now.issued - mark.issued, std::memory_order_relaxed);
+  frameElided.store(now.elided - mark.elided, std::memory_order_relaxed);
+  mark = now;
+}
+
+GLStateStats glstateLastFrame()
+{
+  GLStateStats stats = {frameIssued.load(std::memory_order_relaxed),
+    frameElided.load(std::memory_order_relaxed)};
+  return stats;
+}
+
+int glstatePushStats(lua_State* L, void* ud)
+{
+  GLStateStats frame = glstateLastFrame();
+  GLStateStats total = glstateStats();
+  lua_createtable(L, 0, 4);
+  lua_pushinteger(L, (lua_Integer)frame.issued);
+  lua_setfield(L, -2, "issued");
+  lua_pushinteger(L, (lua_Integer)frame.elided);
+  lua_setfield(L, -2, "elided");
+  lua_pushinteger(L, (lua_Integer)total.issued);
+  lua_setfield(L, -2, "totalIssued");
+  lua_pushinteger(L, (lua_Integer)total.elided);
+  lua_setfield(L, -2, "totalElided");
+  return 1;
+}
@@ -0,0 +1,74 @@
+#ifndef __GLSTATE_H__
+#define __GLSTATE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include "lua/src/lua.h"
+
+// Shadow of the GL state that scripts set most often: bound program,
+// vertex array, buffers, textures and framebuffers, the active texture
+// unit, common enable flags, blend and depth state and the viewport. The
+// gl wrappers go through these functions, which skip the driver call when
+// the value is already set.
+//
+// Only changes made through here are seen, so engine code binds through
+// these too. A value starts out unknown, and so does everything after
+// glstateReset, so the first call always reaches GL. Deleting an object
+// goes through glstateForget* since GL unbinds it.
+//
+// Everything runs on the thread that owns the context, the counters can be
+// read from any thread.
+
+struct GLStateStats
+{
+  uint64_t issued;  // calls made to GL
+  uint64_t elided;  // calls skipped because nothing would change
+};
+
+void glstateReset();
+
+// false passes every call through, for comparing.
+void glstateSetEnabled(bool enabled);
+
+void glstateUseProgram(unsigned program);
+void glstateBindVertexArray(unsigned array);
+void glstateBindBuffer(unsigned target, unsigned buffer);
+// The buffer bound to target, asked of GL when it isn't known yet.
+unsigned glstateBoundBuffer(unsigned target);
+void glstateBindBufferBase(unsigned target, unsigned index, unsigned buffer);
+void glstateBindBufferRange(unsigned target, unsigned index, unsigned buffer, ptrdiff_t offset,
+  ptrdiff_t size);
+void glstateActiveTexture(unsigned unit);
+void glstateBindTexture(unsigned target, unsigned texture);
+void glstateBindFramebuffer(unsigned target, unsigned framebuffer);
+void glstateEnable(unsigned cap, bool enable);
+void glstateEnablei(unsigned cap, unsigned index, bool enable);
+void glstateBlendFunc(unsigned srcRGB, unsigned dstRGB, unsigned srcAlpha, unsigned dstAlpha);
+void glstateBlendEquation(unsigned rgb, unsigned alpha);
+// Per draw buffer, these aren't cached and make the global blend state
+// unknown so the next glstateBlendFunc or glstateBlendEquation reaches GL.
+void glstateBlendFunci(unsigned buffer, unsigned srcRGB, unsigned dstRGB, unsigned srcAlpha,
+  unsigned dstAlpha);
+void glstateBlendEquationi(unsigned buffer, unsigned rgb, unsigned alpha);
+void glstateDepthFunc(unsigned func);
+void glstateDepthMask(bool mask);
+void glstateViewport(int x, int y, int width, int height);
+
+void glstateForgetBuffers(int count, const unsigned* buffers);
+void glstateForgetTextures(int count, const unsigned* textures);
+void glstateForgetVertexArrays(int count, const unsigned* arrays);
+void glstateForgetFramebuffers(int count, const unsigned* framebuffers);
+void glstateForgetProgram(unsigned program);
+
+// Totals since the start.
+GLStateStats glstateStats();
+
+// Closes a frame, call it once the frame is submitted. glstateLastFrame is
+// what the frame before it issued and elided.
+void glstateFrame();
+GLStateStats glstateLastFrame();
+
+// engine.stats.glstate, see profilerAddSource
+int glstatePushStats(lua_State* L, void* ud);
+
+#endif
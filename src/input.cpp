@@ -0,0 +1,202 @@
+#include "input.h"
+#include "timer.h"
+#include "lua/src/lauxlib.h"
+
+#include "SDL/SDL.h"
+
+static const char* inputName = "engine.input";
+
+static const char* typeNames[INPUT_TYPES] = {
+  "keydown",
+  "keyup",
+  "motion",
+  "buttondown",
+  "buttonup",
+  "resize",
+  "quit"
+};
+
+void inputInit(InputBuffer* input, bool coalesce)
+{
+  input->events.reserve(256);
+  input->coalesce = coalesce;
+  input->stats = InputStats();
+}
+
+void inputClear(InputBuffer* input)
+{
+  input->events.clear();
+}
+
+void inputPush(InputBuffer* input, const SDL_Event& e, uint64_t now)
+{
+  input->stats.events++;
+
+  InputEvent event = InputEvent();
+  event.time = now;
+  event.merged = 1;
+
+  switch (e.type)
+  {
+  case SDL_KEYDOWN:
+  case SDL_KEYUP:
+    event.type = e.type == SDL_KEYDOWN ? INPUT_KEYDOWN : INPUT_KEYUP;
+    event.key = e.key.keysym.sym;
+    event.mod = (uint16_t)e.key.keysym.mod;
+    break;
+  case SDL_MOUSEMOTION:
+    //a run of motion with the same buttons held becomes one event at the
+    //last position carrying the summed movement
+    if (input->coalesce && !input->events.empty())
+    {
+      InputEvent& last = input->events.back();
+      if (last.type == INPUT_MOTION && last.button == e.motion.state)
+      {
+        last.time = now;
+        last.x = e.motion.x;
+        last.y = e.motion.y;
+        last.dx += e.motion.xrel;
+        last.dy += e.motion.yrel;
+        last.merged++;
+        return;
+      }
+    }
+    event.type = INPUT_MOTION;
+    event.button = e.motion.state;
+    event.x = e.motion.x;
+    event.y = e.motion.y;
+    event.dx = e.motion.xrel;
+    event.dy = e.motion.yrel;
+    break;
+  case SDL_MOUSEBUTTONDOWN:
+  case SDL_MOUSEBUTTONUP:
+    event.type = e.type == SDL_MOUSEBUTTONDOWN ? INPUT_BUTTONDOWN : INPUT_BUTTONUP;
+    event.button = e.button.button;
+    event.x = e.button.x;
+    event.y = e.button.y;
+    break;
+  case SDL_VIDEORESIZE:
+    event.type = INPUT_RESIZE;
+    event.x = e.resize.w;
+    event.y = e.resize.h;
+    break;
+  case SDL_QUIT:
+    event.type = INPUT_QUIT;
+    break;
+  default:
+    return;
+  }
+
+  input->events.push_back(event);
+}
+
+static const InputEvent& checkEvent(lua_State* L)
+{
+  InputBuffer* input = *(InputBuffer**)luaL_checkudata(L, 1, inputName);
+  lua_Integer i = luaL_checkinteger(L, 2);
+  luaL_argcheck(L, i >= 1 && (size_t)i <= input->events.size(), 2, "no such event");
+  return input->events[i - 1];
+}
+
+static int inputLen(lua_State* L)
+{
+  InputBuffer* input = *(InputBuffer**)luaL_checkudata(L, 1, inputName);
+  lua_pushinteger(L, (lua_Integer)input->events.size());
+  return 1;
+}
+
+static int inputType(lua_State* L)
+{
+  lua_pushstring(L, typeNames[checkEvent(L).type]);
+  return 1;
+}
+
+static int inputKey(lua_State* L)
+{
+  lua_pushinteger(L, checkEvent(L).key);
+  return 1;
+}
+
+static int inputKeyName(lua_State* L)
+{
+  lua_pushstring(L, SDL_GetKeyName((SDLKey)checkEvent(L).key));
+  return 1;
+}
+
+static int inputMod(lua_State* L)
+{
+  lua_pushinteger(L, checkEvent(L).mod);
+  return 1;
+}
+
+static int inputButton(lua_State* L)
+{
+  lua_pushinteger(L, checkEvent(L).button);
+  return 1;
+}
+
+// events:position(i) -> x, y
+static int inputPosition(lua_State* L)
+{
+  const InputEvent& event = checkEvent(L);
+  lua_pushinteger(L, event.x);
+  lua_pushinteger(L, event.y);
+  return 2;
+}
+
+// events:motion(i) -> dx, dy, number of motion events merged
+static int inputMotion(lua_State* L)
+{
+  const InputEvent& event = checkEvent(L);
+  lua_pushinteger(L, event.dx);
+  lua_pushinteger(L, event.dy);
+  lua_pushinteger(L, event.merged);
+  return 3;
+}
+
+// events:time(i) -> seconds on the engine clock, compare with engine.Time()
+static int inputTime(lua_State* L)
+{
+  lua_pushnumber(L, timerSeconds(checkEvent(L).time));
+  return 1;
+}
+
+int inputRegister(lua_State* L, InputBuffer* input)
+{
+  static const luaL_Reg methods[] = {
+    {"type", inputType},
+    {"key", inputKey},
+    {"keyname", inputKeyName},
+    {"mod", inputMod},
+    {"button", inputButton},
+    {"position", inputPosition},
+    {"motion", inputMotion},
+    {"time", inputTime},
+    {NULL, NULL}
+  };
+
+  InputBuffer** ud = (InputBuffer**)lua_newuserdata(L, sizeof(InputBuffer*));
+  *ud = input;
+
+  luaL_newmetatable(L, inputName);
+  luaL_newlib(L, methods);
+  lua_setfield(L, -2, "__index");
+  lua_pushcfunction(L, inputLen);
+  lua_setfield(L, -2, "__len");
+  lua_setmetatable(L, -2);
+
+  return luaL_ref(L, LUA_REGISTRYINDEX);
+}
+
+int inputPushStats(lua_State* L, void* ud)
+{
+  const InputBuffer* input = (const InputBuffer*)ud;
+  lua_createtable(L, 0, 3);
+  lua_pushinteger(L, (lua_Integer)input->stats.events);
+  lua_setfield(L, -2, "events");
+  lua_pushinteger(L, (lua_Integer)input->stats.delivered);
+  lua_setfield(L, -2, "delivered");
+  lua_pushinteger(L, (lua_Integer)input->stats.batches);
+  lua_setfield(L, -2, "batches");
+  return 1;
+}
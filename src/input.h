@@ -0,0 +1,72 @@
+#ifndef __INPUT_H__
+#define __INPUT_H__
+
+#include <stdint.h>
+#include <vector>
+#include "lua/src/lua.h"
+
+union SDL_Event;
+
+// Input events collected over a frame and handed to the script's
+// input(events) callback in one call. events is a userdata over this buffer
+// with accessors instead of a table per event:
+//
+//   function input(events)
+//     for i = 1, #events do
+//       if events:type(i) == "keydown" then print(events:keyname(i)) end
+//     end
+//   end
+//
+// The userdata is only valid during the callback.
+enum InputType
+{
+  INPUT_KEYDOWN,
+  INPUT_KEYUP,
+  INPUT_MOTION,
+  INPUT_BUTTONDOWN,
+  INPUT_BUTTONUP,
+  INPUT_RESIZE,
+  INPUT_QUIT,
+  INPUT_TYPES
+};
+
+struct InputEvent
+{
+  uint64_t time;    // timerNow() when taken off the SDL queue
+  uint8_t type;
+  uint8_t button;   // mouse button, or motion button state
+  uint16_t mod;     // key modifiers
+  int32_t key;      // SDLKey
+  int32_t x, y;     // mouse position, or resize width and height
+  int32_t dx, dy;   // motion since the previous motion event
+  uint32_t merged;  // motion events folded into this one
+};
+
+struct InputStats
+{
+  uint64_t events;     // SDL events taken
+  uint64_t delivered;  // events handed to Lua
+  uint64_t batches;    // input callbacks
+};
+
+struct InputBuffer
+{
+  std::vector<InputEvent> events;
+  bool coalesce;  // fold runs of mouse motion into one event
+  InputStats stats;
+};
+
+void inputInit(InputBuffer* input, bool coalesce);
+void inputClear(InputBuffer* input);
+
+// Adds an SDL event to the frame, events scripts don't see are ignored.
+void inputPush(InputBuffer* input, const SDL_Event& e, uint64_t now);
+
+// Creates the events userdata and registers its metatable. Returns a
+// registry ref to it, the one object is reused every frame.
+int inputRegister(lua_State* L, InputBuffer* input);
+
+// StatsSource for engine.stats.input, ud is the InputBuffer.
+int inputPushStats(lua_State* L, void* ud);
+
+#endif
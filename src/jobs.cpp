@@ -0,0 +1,414 @@
+#include "jobs.h"
+#include "kernels.h"
+#include "buffer.h"
+#include "lua/src/lauxlib.h"
+
+#include <condition_variable>
+#include <deque>
+#include <new>
+#include <string.h>
+#include <thread>
+
+struct WorkerQueue
+{
+  std::mutex mutex;
+  std::deque<Job> jobs;
+};
+
+// Queue 0 is shared by threads outside the pool, worker n owns queue n.
+static std::vector<WorkerQueue*> queues;
+static std::vector<std::thread> threads;
+static thread_local int queueIndex = 0;
+
+static std::atomic<int> queued(0);
+static std::atomic<bool> running(false);
+static std::mutex sleepMutex;
+static std::condition_variable sleepCond;
+
+static void push(const Job& job)
+{
+  WorkerQueue* queue = queues[queueIndex];
+  {
+    std::lock_guard<std::mutex> lock(queue->mutex);
+    queue->jobs.push_back(job);
+  }
+
+  queued++;
+  //taking the lock orders this against a worker deciding to sleep
+  {
+    std::lock_guard<std::mutex> lock(sleepMutex);
+  }
+  sleepCond.notify_one();
+}
+
+// Own work newest first, then steal the oldest work of the others.
+static bool pop(Job* job)
+{
+  if (queued.load() == 0)
+  {
+    return false;
+  }
+
+  int count = (int)queues.size();
+  for (int i = 0; i < count; ++i)
+  {
+    int index = (queueIndex + i) % count;
+    WorkerQueue* queue = queues[index];
+
+    std::lock_guard<std::mutex> lock(queue->mutex);
+    if (queue->jobs.empty())
+    {
+      continue;
+    }
+
+    if (i == 0)
+    {
+      *job = queue->jobs.back();
+      queue->jobs.pop_back();
+    }
+    else
+    {
+      *job = queue->jobs.front();
+      queue->jobs.pop_front();
+    }
+
+    queued--;
+    return true;
+  }
+
+  return false;
+}
+
+// The count drops under the counter's lock and jobsWait takes that lock
+// before returning, so the owner can't free the counter while we are still
+// in here.
+static void finish(JobCounter* counter)
+{
+  if (counter == NULL)
+  {
+    return;
+  }
+
+  std::vector<Job> released;
+  {
+    std::lock_guard<std::mutex> lock(counter->mutex);
+    if (--counter->pending > 0)
+    {
+      return;
+    }
+    released.swap(counter->waiting);
+  }
+
+  for (const Job& job : released)
+  {
+    if (threads.empty())
+    {
+      job.function(job.data, job.begin, job.end);
+      finish(job.counter);
+    }
+    else
+    {
+      push(job);
+    }
+  }
+}
+
+static void execute(const Job& job)
+{
+  job.function(job.data, job.begin, job.end);
+  finish(job.counter);
+}
+
+static void workerThread(int index)
+{
+  queueIndex = index;
+
+  while (running)
+  {
+    Job job;
+    if (pop(&job))
+    {
+      execute(job);
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(sleepMutex);
+    while (running && queued.load() == 0)
+    {
+      sleepCond.wait(lock);
+    }
+  }
+}
+
+void jobsInit(int workers)
+{
+#if EMSCRIPTEN
+  workers = 0;
+#else
+  if (workers < 0)
+  {
+    workers = (int)std::thread::hardware_concurrency() - 1;
+  }
+#endif
+  if (workers < 0)
+  {
+    workers = 0;
+  }
+
+  running = true;
+  for (int i = 0; i <= workers; ++i)
+  {
+    queues.push_back(new WorkerQueue());
+  }
+  for (int i = 1; i <= workers; ++i)
+  {
+    threads.push_back(std::thread(workerThread, i));
+  }
+}
+
+void jobsShutdown()
+{
+  {
+    std::lock_guard<std::mutex> lock(sleepMutex);
+    running = false;
+  }
+  sleepCond.notify_all();
+
+  for (std::thread& thread : threads)
+  {
+    thread.join();
+  }
+  threads.clear();
+
+  for (WorkerQueue* queue : queues)
+  {
+    delete queue;
+  }
+  queues.clear();
+}
+
+int jobsWorkers()
+{
+  return (int)threads.size();
+}
+
+void jobsRun(JobFunction function, void* data, int begin, int end, JobCounter* counter)
+{
+  Job job = { function, data, begin, end, counter };
+  if (counter)
+  {
+    counter->pending++;
+  }
+
+  if (threads.empty())
+  {
+    execute(job);
+    return;
+  }
+
+  push(job);
+}
+
+void jobsRunAfter(JobCounter* dependency, JobFunction function, void* data, int begin, int end,
+  JobCounter* counter)
+{
+  Job job = { function, data, begin, end, counter };
+  if (counter)
+  {
+    counter->pending++;
+  }
+
+  {
+    //the count only reaches zero under this lock, so a job parked here is
+    //always released
+    std::lock_guard<std::mutex> lock(dependency->mutex);
+    if (dependency->pending.load() > 0)
+    {
+      dependency->waiting.push_back(job);
+      return;
+    }
+  }
+
+  if (threads.empty())
+  {
+    execute(job);
+    return;
+  }
+
+  push(job);
+}
+
+void jobsParallelFor(JobFunction function, void* data, int count, int grain, JobCounter* counter)
+{
+  if (grain <= 0)
+  {
+    //a few chunks per thread so stealing can even out uneven work
+    grain = count / ((jobsWorkers() + 1) * 4);
+    if (grain < 1)
+    {
+      grain = 1;
+    }
+  }
+
+  for (int begin = 0; begin < count; begin += grain)
+  {
+    int end = begin + grain < count ? begin + grain : count;
+    jobsRun(function, data, begin, end, counter);
+  }
+}
+
+void jobsWait(JobCounter* counter)
+{
+  while (counter->pending.load() > 0)
+  {
+    Job job;
+    if (pop(&job))
+    {
+      execute(job);
+    }
+    else
+    {
+      std::this_thread::yield();
+    }
+  }
+
+  //wait out the finish() that brought the count to zero
+  std::lock_guard<std::mutex> lock(counter->mutex);
+}
+
+// Lua side: a handle owns the counter, the kernel arguments and the output,
+// the inputs are kept alive through its user value.
+
+struct JobHandle
+{
+  JobCounter counter;
+  const Kernel* kernel;
+  KernelArgs args;
+  int count;
+  size_t outputSize;
+};
+
+static const char* handleName = "engine.jobs.handle";
+
+static void runKernel(void* data, int begin, int end)
+{
+  JobHandle* handle = (JobHandle*)data;
+  handle->kernel->run(&handle->args, begin, end);
+}
+
+// engine.jobs.run(kernel, count, inputs..., params...) -> handle, inputs
+// are strings or buffers
+static int jobsLuaRun(lua_State* L)
+{
+  const char* name = luaL_checkstring(L, 1);
+  const Kernel* kernel = kernelsFind(name);
+  if (kernel == NULL)
+  {
+    return luaL_argerror(L, 1, lua_pushfstring(L, "unknown kernel '%s'", name));
+  }
+
+  lua_Integer count = luaL_checkinteger(L, 2);
+  luaL_argcheck(L, count >= 0 && count <= 0x7fffffff, 2, "invalid count");
+
+  size_t outputSize = kernel->outputStride * (size_t)count;
+  JobHandle* handle = (JobHandle*)lua_newuserdata(L, sizeof(JobHandle) + outputSize);
+  new (handle) JobHandle();
+  handle->kernel = kernel;
+  handle->count = (int)count;
+  handle->outputSize = outputSize;
+  handle->args.output = (uint8_t*)(handle + 1);
+  luaL_setmetatable(L, handleName);
+
+  lua_createtable(L, kernel->inputs, 0);
+  for (int i = 0; i < kernel->inputs; ++i)
+  {
+    int arg = 3 + i;
+    size_t size = 0;
+    const void* data = bufferCheckBytes(L, arg, &size);
+    size_t stride = kernel->inputStrides[i];
+
+    if (size >= stride * (size_t)count)
+    {
+      handle->args.strides[i] = stride;
+    }
+    else if ((kernel->broadcast & (1u << i)) && size == stride)
+    {
+      handle->args.strides[i] = 0;
+    }
+    else
+    {
+      return luaL_argerror(L, arg, lua_pushfstring(L, "expected %d bytes per item",
+        (int)stride));
+    }
+
+    handle->args.inputs[i] = (const uint8_t*)data;
+    lua_pushvalue(L, arg);
+    lua_rawseti(L, -2, i + 1);
+  }
+  lua_setuservalue(L, -2);
+
+  for (int i = 0; i < kernel->params; ++i)
+  {
+    handle->args.params[i] = luaL_checknumber(L, 3 + kernel->inputs + i);
+  }
+
+  jobsParallelFor(runKernel, handle, handle->count, 0, &handle->counter);
+  return 1;
+}
+
+// handle:wait() -> output as a string of packed floats
+static int jobsLuaWait(lua_State* L)
+{
+  JobHandle* handle = (JobHandle*)luaL_checkudata(L, 1, handleName);
+  jobsWait(&handle->counter);
+  lua_pushlstring(L, (const char*)handle->args.output, handle->outputSize);
+  return 1;
+}
+
+// handle:done() -> true once every chunk has run
+static int jobsLuaDone(lua_State* L)
+{
+  JobHandle* handle = (JobHandle*)luaL_checkudata(L, 1, handleName);
+  lua_pushboolean(L, handle->counter.pending.load() == 0);
+  return 1;
+}
+
+// workers may still be writing into the handle
+static int jobsLuaGc(lua_State* L)
+{
+  JobHandle* handle = (JobHandle*)luaL_checkudata(L, 1, handleName);
+  jobsWait(&handle->counter);
+  handle->~JobHandle();
+  return 0;
+}
+
+static int jobsLuaWorkers(lua_State* L)
+{
+  lua_pushinteger(L, jobsWorkers());
+  return 1;
+}
+
+void jobsRegister(lua_State* L)
+{
+  luaL_newmetatable(L, handleName);
+  lua_pushvalue(L, -1);
+  lua_setfield(L, -2, "__index");
+  lua_pushcfunction(L, jobsLuaWait);
+  lua_setfield(L, -2, "wait");
+  lua_pushcfunction(L, jobsLuaDone);
+  lua_setfield(L, -2, "done");
+  lua_pushcfunction(L, jobsLuaGc);
+  lua_setfield(L, -2, "__gc");
+  lua_pop(L, 1);
+
+  lua_getglobal(L, "engine");
+  lua_createtable(L, 0, 3);
+  lua_pushcfunction(L, jobsLuaRun);
+  lua_setfield(L, -2, "run");
+  lua_pushcfunction(L, jobsLuaWait);
+  lua_setfield(L, -2, "wait");
+  lua_pushcfunction(L, jobsLuaWorkers);
+  lua_setfield(L, -2, "workers");
+  lua_setfield(L, -2, "jobs");
+  lua_pop(L, 1);
+}
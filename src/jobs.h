@@ -0,0 +1,63 @@
+#ifndef __JOBS_H__
+#define __JOBS_H__
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include "lua/src/lua.h"
+
+// Work stealing job system. Every worker thread owns a deque, it pushes and
+// pops its own work at the back and idle workers steal from the front of
+// the others. Threads outside the pool, the main thread included, submit to
+// a shared queue and help run jobs while they wait.
+//
+// Without threads (emscripten, or a pool of 0 workers) jobs run in the
+// caller on submission.
+
+// Runs items [begin, end) of some work.
+typedef void (*JobFunction)(void* data, int begin, int end);
+
+struct Job
+{
+  JobFunction function;
+  void* data;
+  int begin;
+  int end;
+  struct JobCounter* counter;
+};
+
+// Counts outstanding jobs. Jobs can be made to wait on a counter reaching
+// zero, which is how dependencies are expressed.
+struct JobCounter
+{
+  std::atomic<int> pending;
+  std::mutex mutex;
+  std::vector<Job> waiting;  // jobs parked until pending reaches zero
+
+  JobCounter() : pending(0) {}
+};
+
+// workers < 0 picks one per hardware thread, less one for the main thread.
+void jobsInit(int workers);
+void jobsShutdown();
+int jobsWorkers();
+
+// Queues function(data, begin, end), counter (may be NULL) is incremented
+// now and decremented when it has run.
+void jobsRun(JobFunction function, void* data, int begin, int end, JobCounter* counter);
+
+// Like jobsRun but the job is held back until dependency reaches zero.
+void jobsRunAfter(JobCounter* dependency, JobFunction function, void* data, int begin, int end,
+  JobCounter* counter);
+
+// Splits [0, count) into chunks of grain items (grain <= 0 picks one) and
+// queues them all against counter.
+void jobsParallelFor(JobFunction function, void* data, int count, int grain, JobCounter* counter);
+
+// Runs queued jobs until counter reaches zero.
+void jobsWait(JobCounter* counter);
+
+// Sets engine.jobs, the engine table must be a global already.
+void jobsRegister(lua_State* L);
+
+#endif
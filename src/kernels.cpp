@@ -0,0 +1,80 @@
+#include "kernels.h"
+
+#include <string.h>
+
+// Column major, as GL expects.
+static void mat4Mul(const float* a, const float* b, float* out)
+{
+  for (int c = 0; c < 4; ++c)
+  {
+    for (int r = 0; r < 4; ++r)
+    {
+      out[c * 4 + r] =
+        a[0 * 4 + r] * b[c * 4 + 0] +
+        a[1 * 4 + r] * b[c * 4 + 1] +
+        a[2 * 4 + r] * b[c * 4 + 2] +
+        a[3 * 4 + r] * b[c * 4 + 3];
+    }
+  }
+}
+
+// out[i] = a[i] * b[i]
+static void mat4MulKernel(const KernelArgs* args, int begin, int end)
+{
+  for (int i = begin; i < end; ++i)
+  {
+    mat4Mul((const float*)(args->inputs[0] + i * args->strides[0]),
+      (const float*)(args->inputs[1] + i * args->strides[1]),
+      (float*)(args->output + i * 16 * sizeof(float)));
+  }
+}
+
+// out[i] = (m[i] * vec4(p[i], 1)).xyz
+static void transformPointsKernel(const KernelArgs* args, int begin, int end)
+{
+  for (int i = begin; i < end; ++i)
+  {
+    const float* m = (const float*)(args->inputs[0] + i * args->strides[0]);
+    const float* p = (const float*)(args->inputs[1] + i * args->strides[1]);
+    float* out = (float*)(args->output + i * 3 * sizeof(float));
+
+    for (int r = 0; r < 3; ++r)
+    {
+      out[r] = m[0 * 4 + r] * p[0] + m[1 * 4 + r] * p[1] + m[2 * 4 + r] * p[2] + m[3 * 4 + r];
+    }
+  }
+}
+
+// out[i] = position[i] + velocity[i] * dt
+static void integrateKernel(const KernelArgs* args, int begin, int end)
+{
+  float dt = (float)args->params[0];
+  for (int i = begin; i < end; ++i)
+  {
+    const float* p = (const float*)(args->inputs[0] + i * args->strides[0]);
+    const float* v = (const float*)(args->inputs[1] + i * args->strides[1]);
+    float* out = (float*)(args->output + i * 3 * sizeof(float));
+
+    out[0] = p[0] + v[0] * dt;
+    out[1] = p[1] + v[1] * dt;
+    out[2] = p[2] + v[2] * dt;
+  }
+}
+
+static const Kernel kernels[] = {
+  { "mat4_mul", mat4MulKernel, 2, { 64, 64 }, 0x3, 0, 64 },
+  { "transform_points", transformPointsKernel, 2, { 64, 12 }, 0x1, 0, 12 },
+  { "integrate", integrateKernel, 2, { 12, 12 }, 0x2, 1, 12 },
+};
+
+const Kernel* kernelsFind(const char* name)
+{
+  for (size_t i = 0; i < sizeof(kernels) / sizeof(kernels[0]); ++i)
+  {
+    if (strcmp(kernels[i].name, name) == 0)
+    {
+      return &kernels[i];
+    }
+  }
+  return NULL;
+}
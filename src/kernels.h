@@ -0,0 +1,35 @@
+#ifndef __KERNELS_H__
+#define __KERNELS_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Native kernels that scripts can run across the job system through
+// engine.jobs.run. Data is packed float32, a float32 gl.Buffer or the
+// format gl.TableToData makes.
+
+#define KERNEL_MAX_INPUTS 4
+#define KERNEL_MAX_PARAMS 4
+
+struct KernelArgs
+{
+  const uint8_t* inputs[KERNEL_MAX_INPUTS];
+  size_t strides[KERNEL_MAX_INPUTS];  // 0 when one element is shared by all items
+  double params[KERNEL_MAX_PARAMS];
+  uint8_t* output;
+};
+
+struct Kernel
+{
+  const char* name;
+  void (*run)(const KernelArgs* args, int begin, int end);
+  int inputs;
+  size_t inputStrides[KERNEL_MAX_INPUTS];  // bytes per item
+  unsigned broadcast;                      // bit i, input i may hold a single item
+  int params;
+  size_t outputStride;
+};
+
+const Kernel* kernelsFind(const char* name);
+
+#endif
@@ -0,0 +1,163 @@
+#include "libs.h"
+#include "lua/src/lauxlib.h"
+#include "lua/src/lualib.h"
+
+#include <string.h>
+
+struct Library
+{
+  const char* name;
+  lua_CFunction open;
+  bool deferred;
+};
+
+static const Library libraries[] = {
+  {"_G", luaopen_base, false},
+  {LUA_LOADLIBNAME, luaopen_package, false},
+  {LUA_COLIBNAME, luaopen_coroutine, false},
+  {LUA_TABLIBNAME, luaopen_table, false},
+  {LUA_STRLIBNAME, luaopen_string, false},
+  {LUA_MATHLIBNAME, luaopen_math, false},
+  {LUA_IOLIBNAME, luaopen_io, true},
+  {LUA_OSLIBNAME, luaopen_os, true},
+  {LUA_UTF8LIBNAME, luaopen_utf8, true},
+  {LUA_DBLIBNAME, luaopen_debug, true},
+  {NULL, NULL, false}
+};
+
+static const char* deferredName = "engine.libs";
+
+static bool listed(const char* list, const char* name)
+{
+  if (list == NULL)
+  {
+    return true;
+  }
+  if (strcmp(name, "_G") == 0)
+  {
+    name = "base";
+  }
+
+  size_t length = strlen(name);
+  for (const char* at = list; (at = strstr(at, name)) != NULL; at += length)
+  {
+    bool start = at == list || at[-1] == ',';
+    bool end = at[length] == '\0' || at[length] == ',';
+    if (start && end)
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Fills a deferred library's table from its open function the first time
+// it is used, then drops the metatable so later reads are plain
+static void loadDeferred(lua_State* L, int table)
+{
+  lua_getfield(L, LUA_REGISTRYINDEX, deferredName);
+  lua_pushvalue(L, table);
+  if (lua_rawget(L, -2) != LUA_TFUNCTION)
+  {
+    lua_pop(L, 2);
+    return;
+  }
+  lua_pushvalue(L, table);
+  lua_pushnil(L);
+  lua_rawset(L, -4);
+
+  lua_call(L, 0, 1);
+  int lib = lua_gettop(L);
+  lua_pushnil(L);
+  while (lua_next(L, lib))
+  {
+    //fields the script set already win
+    lua_pushvalue(L, -2);
+    if (lua_rawget(L, table) == LUA_TNIL)
+    {
+      lua_pop(L, 1);
+      lua_pushvalue(L, -2);
+      lua_insert(L, -2);
+      lua_rawset(L, table);
+    }
+    else
+    {
+      lua_pop(L, 2);
+    }
+  }
+  lua_pop(L, 2);
+
+  lua_pushnil(L);
+  lua_setmetatable(L, table);
+}
+
+static int deferredIndex(lua_State* L)
+{
+  loadDeferred(L, 1);
+  lua_settop(L, 2);
+  lua_rawget(L, 1);
+  return 1;
+}
+
+static int nextField(lua_State* L)
+{
+  lua_settop(L, 2);
+  if (lua_next(L, 1))
+  {
+    return 2;
+  }
+  lua_pushnil(L);
+  return 1;
+}
+
+static int deferredPairs(lua_State* L)
+{
+  loadDeferred(L, 1);
+  lua_pushcfunction(L, nextField);
+  lua_pushvalue(L, 1);
+  lua_pushnil(L);
+  return 3;
+}
+
+void libsOpen(lua_State* L, const char* list)
+{
+  //deferred libraries by their table, and the metatable those share
+  lua_createtable(L, 0, 4);
+  lua_createtable(L, 0, 2);
+  lua_pushcfunction(L, deferredIndex);
+  lua_setfield(L, -2, "__index");
+  lua_pushcfunction(L, deferredPairs);
+  lua_setfield(L, -2, "__pairs");
+
+  for (const Library* lib = libraries; lib->name != NULL; ++lib)
+  {
+    if (!listed(list, lib->name))
+    {
+      continue;
+    }
+
+    if (!lib->deferred)
+    {
+      luaL_requiref(L, lib->name, lib->open, 1);
+      lua_pop(L, 1);
+      continue;
+    }
+
+    //an empty table stands in for the library as its global and for
+    //require, until it is read from
+    lua_newtable(L);
+    lua_pushvalue(L, -2);
+    lua_setmetatable(L, -2);
+    luaL_getsubtable(L, LUA_REGISTRYINDEX, "_LOADED");
+    lua_pushvalue(L, -2);
+    lua_setfield(L, -2, lib->name);
+    lua_pop(L, 1);
+    lua_pushvalue(L, -1);
+    lua_setglobal(L, lib->name);
+    lua_pushcfunction(L, lib->open);
+    lua_rawset(L, -4);
+  }
+
+  lua_pop(L, 1);
+  lua_setfield(L, LUA_REGISTRYINDEX, deferredName);
+}
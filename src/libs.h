@@ -0,0 +1,14 @@
+#ifndef __LIBS_H__
+#define __LIBS_H__
+
+#include "lua/src/lua.h"
+
+// Opens the standard libraries for the main state. list is a comma separated
+// set of library names to make available ("base,string,table,math"), NULL
+// for all of them; the rest are left out entirely. io, os, utf8 and debug
+// are not opened at startup. Their global, and what require returns, is an
+// empty table that the library is opened into the first time a field is
+// read or it is iterated with pairs.
+void libsOpen(lua_State* L, const char* list);
+
+#endif
@@ -680,6 +680,107 @@ LUA_API int lua_rawgetp (lua_State *L, int idx, const void *p) {
 }
 
 
+/*
+** bulk copies between tables and C arrays (table -> C). Entries in the
+** array part are read in place; only keys past it go through the hash.
+*/
+
+/*
+** Entry 'o' as an integer: floats are truncated as a C cast would (0 when
+** out of range) and strings converted as by 'lua_tonumber'. Anything else
+** is 0 and runs 'bad'.
+*/
+#define arrayint(o,v,bad)  \
+  { lua_Number n_; \
+    if (ttisinteger(o)) v = ivalue(o); \
+    else if (tonumber(o, &n_)) { if (!lua_numbertointeger(n_, &v)) v = 0; } \
+    else { v = 0; bad; } }
+
+/* entry 'o' as a float, likewise */
+#define arraynum(o,v,bad)  \
+  { if (ttisfloat(o)) v = fltvalue(o); \
+    else if (ttisinteger(o)) v = cast_num(ivalue(o)); \
+    else if (!luaV_tonumber_(o, &v)) { v = 0; bad; } }
+
+/*
+** Integer types are stored through their unsigned variant, which wraps
+** the same way for both. 'buff' need not be aligned for 'T' (it can be a
+** view at any offset into a mapped buffer), so elements go through memcpy.
+** The entries in the array part are copied first, in a loop that does not
+** look at the table. When the hash part is not much larger than what is
+** left, it is walked once rather than looking up every key.
+*/
+#define getarray(T,V,conv)  \
+  { char *a = cast(char *, buff); \
+    for (i = 0; i < inarray; i++) { \
+      V v; T e; \
+      conv(&h->array[l_castS2U(first) - 1 + i], v, if (bad == 0) bad = i + 1); \
+      e = cast(T, v); \
+      memcpy(a + i * sizeof(T), &e, sizeof(T)); \
+    } \
+    if (i < n && sizenode(h) <= 2 * (n - i)) { \
+      /* the rest is mostly in the hash: walk its nodes in order */ \
+      size_t found = 0; \
+      Node *node = gnode(h, 0), *limit = gnode(h, sizenode(h)); \
+      for (; node < limit; node++) { \
+        const TValue *key = gkey(node); \
+        lua_Unsigned j; \
+        V v; T e; \
+        if (!ttisinteger(key)) continue; \
+        j = l_castS2U(ivalue(key)) - l_castS2U(first); \
+        if (j < i || j >= n) continue; \
+        conv(gval(node), v, if (bad == 0 || j + 1 < bad) bad = j + 1); \
+        e = cast(T, v); \
+        memcpy(a + j * sizeof(T), &e, sizeof(T)); \
+        found++; \
+      } \
+      if (found == n - i) i = n;  /* else some are missing, look them up */ \
+    } \
+    for (; i < n; i++) { \
+      V v; T e; \
+      conv(luaH_getint(h, first + l_castU2S(i)), v, \
+           if (bad == 0 || i + 1 < bad) bad = i + 1); \
+      e = cast(T, v); \
+      memcpy(a + i * sizeof(T), &e, sizeof(T)); \
+    } }
+
+
+/*
+** Copies entries 'first' to 'first + n - 1' of the table at 'idx' into
+** 'buff', converted to 'type'. Returns 0, or 'i' when entry 'first + i - 1'
+** is the first that is not a number (it and any others are stored as 0).
+*/
+LUA_API size_t lua_getarray (lua_State *L, int idx, int type, void *buff,
+                             lua_Integer first, size_t n) {
+  StkId t;
+  Table *h;
+  size_t i;
+  size_t inarray = 0;
+  size_t bad = 0;
+  lua_lock(L);
+  t = index2addr(L, idx);
+  api_check(L, ttistable(t), "table expected");
+  h = hvalue(t);
+  if (first >= 1 && l_castS2U(first) - 1 < h->sizearray) {
+    inarray = h->sizearray - cast(size_t, first - 1);
+    if (inarray > n) inarray = n;
+  }
+  switch (type) {
+    case LUA_AINT8: case LUA_AUINT8:
+      getarray(unsigned char, lua_Integer, arrayint); break;
+    case LUA_AINT16: case LUA_AUINT16:
+      getarray(unsigned short, lua_Integer, arrayint); break;
+    case LUA_AINT32: case LUA_AUINT32:
+      getarray(unsigned int, lua_Integer, arrayint); break;
+    case LUA_AFLOAT: getarray(float, lua_Number, arraynum); break;
+    case LUA_ADOUBLE: getarray(double, lua_Number, arraynum); break;
+    default: api_check(L, 0, "invalid array type");
+  }
+  lua_unlock(L);
+  return bad;
+}
+
+
 LUA_API void lua_createtable (lua_State *L, int narray, int nrec) {
   Table *t;
   lua_lock(L);
@@ -842,6 +943,61 @@ LUA_API void lua_rawsetp (lua_State *L, int idx, const void *p) {
 }
 
 
+/*
+** bulk copies (C -> table)
+*/
+
+#define setaint(o,x)	setivalue(o, cast(lua_Integer, (x)))
+#define setanum(o,x)	setfltvalue(o, cast_num(x))
+
+/* as in 'getarray', 'buff' may be unaligned */
+#define setarray(T,set)  \
+  { const char *a = cast(const char *, buff); \
+    for (i = 0; i < n; i++) { \
+      lua_Unsigned k = l_castS2U(first) - 1 + i; \
+      T e; \
+      memcpy(&e, a + i * sizeof(T), sizeof(T)); \
+      if (k < h->sizearray) { set(&h->array[k], e); } \
+      else { TValue v; set(&v, e); luaH_setint(L, h, l_castU2S(k + 1), &v); } \
+    } }
+
+
+/*
+** Stores the 'n' values of 'buff', of 'type', as entries 'first' to
+** 'first + n - 1' of the table at 'idx'; integer types as integers. When
+** they start in or just after the array part it is grown to hold them all,
+** so filling a table does not go through its hash. Numbers are not
+** collectable, so there are no barriers.
+*/
+LUA_API void lua_setarray (lua_State *L, int idx, int type,
+                           const void *buff, lua_Integer first, size_t n) {
+  StkId t;
+  Table *h;
+  size_t i;
+  lua_lock(L);
+  t = index2addr(L, idx);
+  api_check(L, ttistable(t), "table expected");
+  h = hvalue(t);
+  if (n > 0 && first >= 1 && l_castS2U(first) - 1 <= h->sizearray) {
+    lua_Unsigned last = l_castS2U(first) - 1 + n;
+    if (last > h->sizearray && last <= cast(lua_Unsigned, MAX_INT))
+      luaH_resizearray(L, h, cast(unsigned int, last));
+  }
+  switch (type) {
+    case LUA_AINT8: setarray(signed char, setaint); break;
+    case LUA_AUINT8: setarray(unsigned char, setaint); break;
+    case LUA_AINT16: setarray(short, setaint); break;
+    case LUA_AUINT16: setarray(unsigned short, setaint); break;
+    case LUA_AINT32: setarray(int, setaint); break;
+    case LUA_AUINT32: setarray(unsigned int, setaint); break;
+    case LUA_AFLOAT: setarray(float, setanum); break;
+    case LUA_ADOUBLE: setarray(double, setanum); break;
+    default: api_check(L, 0, "invalid array type");
+  }
+  lua_unlock(L);
+}
+
+
 LUA_API int lua_setmetatable (lua_State *L, int objindex) {
   TValue *obj;
   Table *mt;
@@ -1078,8 +1234,9 @@ LUA_API int lua_gc (lua_State *L, int what, int data) {
         luaC_checkGC(L);
       }
       g->gcrunning = oldrunning;  /* restore previous state */
-      if (debt > 0 && g->gcstate == GCSpause)  /* end of cycle? */
-        res = 1;  /* signal it */
+      /* every generational step is a whole (minor) collection */
+      if (debt > 0 && (isgenerational(g) || g->gcstate == GCSpause))
+        res = 1;  /* signal end of cycle */
       break;
     }
     case LUA_GCSETPAUSE: {
@@ -1097,6 +1254,25 @@ LUA_API int lua_gc (lua_State *L, int what, int data) {
       res = g->gcrunning;
       break;
     }
+    case LUA_GCGEN: {
+      res = isgenerational(g) ? LUA_GCGEN : LUA_GCINC;  /* previous mode */
+      if (data != 0)
+        g->genminormul = data;
+      luaC_changemode(L, 1);
+      break;
+    }
+    case LUA_GCINC: {
+      res = isgenerational(g) ? LUA_GCGEN : LUA_GCINC;  /* previous mode */
+      if (data != 0)
+        g->gcpause = data;
+      luaC_changemode(L, 0);
+      break;
+    }
+    case LUA_GCSETMAJORMUL: {
+      res = g->genmajormul;
+      g->genmajormul = data;
+      break;
+    }
     default: res = -1;  /* invalid option */
   }
   lua_unlock(L);
@@ -60,10 +60,10 @@
 
 
 /*
-** 'makewhite' erases all color bits then sets only the current white
-** bit
+** 'makewhite' erases all color bits (and the old bit) then sets only
+** the current white bit
 */
-#define maskcolors	(~(bitmask(BLACKBIT) | WHITEBITS))
+#define maskcolors	(~(bitmask(BLACKBIT) | WHITEBITS | bitmask(OLDBIT)))
 #define makewhite(g,x)	\
  (x->marked = cast_byte((x->marked & maskcolors) | luaC_white(g)))
 
@@ -378,6 +378,8 @@ static void traverseweakvalue (global_State *g, Table *h) {
     linkgclist(h, g->grayagain);  /* must retraverse it in atomic phase */
   else if (hasclears)
     linkgclist(h, g->weak);  /* has to be cleared later */
+  else if (isgenerational(g))
+    gray2black(h);  /* nothing to clear; later changes go through barrier */
 }
 
 
@@ -426,6 +428,8 @@ static int traverseephemeron (global_State *g, Table *h) {
     linkgclist(h, g->ephemeron);  /* have to propagate again */
   else if (hasclears)  /* table has white keys? */
     linkgclist(h, g->allweak);  /* may have to clean white keys */
+  else if (isgenerational(g))
+    gray2black(h);  /* nothing to clear; later changes go through barrier */
   return marked;
 }
 
@@ -794,6 +798,7 @@ static GCObject *udata2finalize (global_State *g) {
   o->next = g->allgc;  /* return it to 'allgc' list */
   g->allgc = o;
   resetbit(o->marked, FINALIZEDBIT);  /* object is "normal" again */
+  resetoldbit(o);  /* it is at the head of 'allgc' now */
   if (issweepphase(g))
     makewhite(g, o);  /* "sweep" object */
   return o;
@@ -917,6 +922,7 @@ void luaC_checkfinalizer (lua_State *L, GCObject *o, Table *mt) {
     o->next = g->finobj;  /* link it in 'finobj' list */
     g->finobj = o;
     l_setbit(o->marked, FINALIZEDBIT);  /* mark it as such */
+    resetoldbit(o);  /* it is at the head of 'finobj' now */
   }
 }
 
@@ -987,6 +993,7 @@ static l_mem atomic (lua_State *L) {
   l_mem work;
   GCObject *origweak, *origall;
   GCObject *grayagain = g->grayagain;  /* save original list */
+  g->grayagain = NULL;  /* threads traversed here are linked to it again */
   lua_assert(g->ephemeron == NULL && g->weak == NULL);
   lua_assert(!iswhite(g->mainthread));
   g->gcstate = GCSinsideatomic;
@@ -1112,6 +1119,146 @@ void luaC_runtilstate (lua_State *L, int statesmask) {
 }
 
 
+/*
+** sweep the young objects at the head of list 'p': free the dead ones
+** and make the others old, keeping their colors. Objects are only ever
+** added at the head of a list, so the sweep can stop at the first old
+** object.
+*/
+static void sweepgen (lua_State *L, GCObject **p) {
+  global_State *g = G(L);
+  int ow = otherwhite(g);
+  GCObject *curr;
+  while ((curr = *p) != NULL && !isold(curr)) {
+    if (isdeadm(ow, curr->marked)) {  /* is 'curr' dead? */
+      *p = curr->next;  /* remove 'curr' from list */
+      freeobj(L, curr);  /* erase 'curr' */
+    }
+    else {  /* survivor becomes old */
+      l_setbit(curr->marked, OLDBIT);
+      p = &curr->next;
+    }
+  }
+}
+
+
+/*
+** black the weak tables left in list 'l' by the atomic phase: they were
+** already cleared, and from now on barriers catch changes to them
+*/
+static void blackweak (GCObject *l) {
+  while (l) {
+    Table *h = gco2t(l);
+    l = h->gclist;
+    gray2black(h);
+  }
+}
+
+
+/*
+** A minor collection. The collector rests in the propagate phase, with
+** old objects black (threads gray, in 'grayagain') and 'gray' and
+** 'grayagain' holding what barriers caught since the last collection.
+** Marking from there reaches only young objects, and the sweep visits
+** only young objects.
+*/
+static void youngcollection (lua_State *L, global_State *g) {
+  lu_mem estimate = g->GCestimate;
+  lua_assert(g->gcstate == GCSpropagate);
+  propagateall(g);
+  atomic(L);
+  g->gcstate = GCSswpallgc;  /* free objects, not only mark them */
+  sweepgen(L, &g->allgc);
+  sweepgen(L, &g->finobj);
+  g->gcstate = GCSpropagate;  /* ready for barriers until the next one */
+  blackweak(g->weak);
+  blackweak(g->allweak);
+  blackweak(g->ephemeron);
+  g->weak = g->allweak = g->ephemeron = NULL;
+  checkSizes(L, g);
+  g->GCestimate = estimate;  /* keep the base of the last major collection */
+}
+
+
+/*
+** next minor collection after memory grows 'genminormul' percent
+*/
+static void setminordebt (global_State *g) {
+  luaE_setdebt(g, -(cast(l_mem, (gettotalbytes(g) / 100)) * g->genminormul));
+}
+
+
+/*
+** Enter generational mode: finish the current cycle and mark everything
+** from scratch, so that the first minor collection makes every live
+** object old.
+*/
+static void entergen (lua_State *L, global_State *g) {
+  luaC_runtilstate(L, bitmask(GCSpause));
+  luaC_runtilstate(L, bitmask(GCSpropagate));  /* start new collection */
+  g->gcgen = 1;
+  youngcollection(L, g);
+  g->GCestimate = gettotalbytes(g);  /* base for major collections */
+  setminordebt(g);
+}
+
+
+/*
+** Enter incremental mode: turn all objects white and young and pause,
+** as at the end of an incremental cycle.
+*/
+static void enterinc (global_State *g) {
+  GCObject *o;
+  for (o = g->allgc; o != NULL; o = o->next)
+    makewhite(g, o);
+  for (o = g->finobj; o != NULL; o = o->next)
+    makewhite(g, o);
+  for (o = g->tobefnz; o != NULL; o = o->next)
+    makewhite(g, o);
+  makewhite(g, g->mainthread);
+  g->gray = g->grayagain = NULL;
+  g->weak = g->allweak = g->ephemeron = NULL;
+  g->gcstate = GCSpause;
+  g->gcgen = 0;
+  setpause(g);
+}
+
+
+/*
+** major collection: everything young again, all of it marked and swept
+*/
+static void fullgen (lua_State *L, global_State *g) {
+  enterinc(g);
+  entergen(L, g);
+}
+
+
+/*
+** A generational step: a major collection when memory has grown
+** 'genmajormul' percent since the last one, otherwise a minor one.
+*/
+static void genstep (lua_State *L, global_State *g) {
+  lu_mem majorbase = g->GCestimate;
+  lu_mem majorinc = (majorbase / 100) * g->genmajormul;
+  if (gettotalbytes(g) > majorbase + majorinc)
+    fullgen(L, g);
+  else
+    youngcollection(L, g);
+  setminordebt(g);
+  if (g->gckind != KGC_EMERGENCY)
+    callallpendingfinalizers(L, 1);
+}
+
+
+void luaC_changemode (lua_State *L, int generational) {
+  global_State *g = G(L);
+  if (generational && !isgenerational(g))
+    entergen(L, g);
+  else if (!generational && isgenerational(g))
+    enterinc(g);
+}
+
+
 /*
 ** get GC debt and convert it from Kb to 'work units' (avoid zero debt
 ** and overflows)
@@ -1137,6 +1284,10 @@ void luaC_step (lua_State *L) {
     luaE_setdebt(g, -GCSTEPSIZE * 10);  /* avoid being called too often */
     return;
   }
+  if (isgenerational(g)) {
+    genstep(L, g);
+    return;
+  }
   do {  /* repeat until pause or enough "credit" (negative debt) */
     lu_mem work = singlestep(L);  /* perform one single step */
     debt -= work;
@@ -1158,12 +1309,21 @@ void luaC_step (lua_State *L) {
 ** Before running the collection, check 'keepinvariant'; if it is true,
 ** there may be some objects marked as black, so the collector has
 ** to sweep all objects to turn them back to white (as white has not
-** changed, nothing will be collected).
+** changed, nothing will be collected). In generational mode, it is a
+** major collection.
 */
 void luaC_fullgc (lua_State *L, int isemergency) {
   global_State *g = G(L);
   lua_assert(g->gckind == KGC_NORMAL);
   if (isemergency) g->gckind = KGC_EMERGENCY;  /* set flag */
+  if (isgenerational(g)) {
+    fullgen(L, g);
+    g->gckind = KGC_NORMAL;
+    setminordebt(g);
+    if (!isemergency)
+      callallpendingfinalizers(L, 1);
+    return;
+  }
   if (keepinvariant(g)) {  /* black objects? */
     entersweep(L); /* sweep everything to turn them back to white */
   }
@@ -22,10 +22,34 @@
 ** allweak, ephemeron) so that it can be visited again before finishing
 ** the collection cycle. These lists have no meaning when the invariant
 ** is not being enforced (e.g., sweep phase).
+**
+** In generational mode, objects that survive a collection become old
+** and keep their marks, so a minor collection only traverses and
+** sweeps the young objects created since the previous one. Between
+** minor collections the collector stays in the propagate phase, so
+** barriers keep the invariant: an old (black) object can only point
+** to a young one if it is gray in a gray list (back barrier, threads)
+** or the young object was marked (forward barrier). New objects are
+** linked at the head of their lists, so the young objects of a list
+** come before the old ones and a sweep stops at the first old object;
+** an old object moved to the head of a list loses its old bit.
+** When memory grows past 'genmajormul' percent of what was in use
+** after the last major collection, the next one is a major collection,
+** which makes everything young again and marks it all.
 */
 
 
 
+/* default control values for generational mode */
+#if !defined(LUAI_GENMINORMUL)
+#define LUAI_GENMINORMUL	20  /* minor collection after 20% growth */
+#endif
+
+#if !defined(LUAI_GENMAJORMUL)
+#define LUAI_GENMAJORMUL	100  /* major collection after 100% growth */
+#endif
+
+
 /* how much to allocate before next GC step */
 #if !defined(GCSTEPSIZE)
 /* ~100 small strings */
@@ -46,6 +70,8 @@
 #define GCSpause	7
 
 
+#define isgenerational(g)	((g)->gcgen)
+
 #define issweepphase(g)  \
 	(GCSswpallgc <= (g)->gcstate && (g)->gcstate <= GCSswpend)
 
@@ -79,6 +105,7 @@
 #define WHITE1BIT	1  /* object is white (type 1) */
 #define BLACKBIT	2  /* object is black */
 #define FINALIZEDBIT	3  /* object has been marked for finalization */
+#define OLDBIT		6  /* object is old (only in generational mode) */
 /* bit 7 is currently used by tests (luaL_checkmemory) */
 
 #define WHITEBITS	bit2mask(WHITE0BIT, WHITE1BIT)
@@ -91,6 +118,9 @@
 
 #define tofinalize(x)	testbit((x)->marked, FINALIZEDBIT)
 
+#define isold(x)	testbit((x)->marked, OLDBIT)
+#define resetoldbit(x)	resetbit((x)->marked, OLDBIT)
+
 #define otherwhite(g)	((g)->currentwhite ^ WHITEBITS)
 #define isdeadm(ow,m)	(!(((m) ^ WHITEBITS) & (ow)))
 #define isdead(g,v)	isdeadm(otherwhite(g), (v)->marked)
@@ -142,6 +172,7 @@ LUAI_FUNC void luaC_barrierback_ (lua_State *L, Table *o);
 LUAI_FUNC void luaC_upvalbarrier_ (lua_State *L, UpVal *uv);
 LUAI_FUNC void luaC_checkfinalizer (lua_State *L, GCObject *o, Table *mt);
 LUAI_FUNC void luaC_upvdeccount (lua_State *L, UpVal *uv);
+LUAI_FUNC void luaC_changemode (lua_State *L, int generational);
 
 
 #endif
@@ -235,6 +235,21 @@ LUA_API void  (lua_pushlightuserdata) (lua_State *L, void *p);
 LUA_API int   (lua_pushthread) (lua_State *L);
 
 
+/*
+** element types of lua_getarray/lua_setarray, which copy 'n' entries of a
+** table from index 'first' to or from a C array (which need not be
+** aligned), without metamethods
+*/
+#define LUA_AINT8	0	/* signed char */
+#define LUA_AUINT8	1	/* unsigned char */
+#define LUA_AINT16	2	/* short */
+#define LUA_AUINT16	3	/* unsigned short */
+#define LUA_AINT32	4	/* int */
+#define LUA_AUINT32	5	/* unsigned int */
+#define LUA_AFLOAT	6	/* float */
+#define LUA_ADOUBLE	7	/* double */
+
+
 /*
 ** get functions (Lua -> stack)
 */
@@ -245,6 +260,8 @@ LUA_API int (lua_geti) (lua_State *L, int idx, lua_Integer n);
 LUA_API int (lua_rawget) (lua_State *L, int idx);
 LUA_API int (lua_rawgeti) (lua_State *L, int idx, lua_Integer n);
 LUA_API int (lua_rawgetp) (lua_State *L, int idx, const void *p);
+LUA_API size_t (lua_getarray) (lua_State *L, int idx, int type, void *buff,
+                               lua_Integer first, size_t n);
 
 LUA_API void  (lua_createtable) (lua_State *L, int narr, int nrec);
 LUA_API void *(lua_newuserdata) (lua_State *L, size_t sz);
@@ -262,6 +279,8 @@ LUA_API void  (lua_seti) (lua_State *L, int idx, lua_Integer n);
 LUA_API void  (lua_rawset) (lua_State *L, int idx);
 LUA_API void  (lua_rawseti) (lua_State *L, int idx, lua_Integer n);
 LUA_API void  (lua_rawsetp) (lua_State *L, int idx, const void *p);
+LUA_API void  (lua_setarray) (lua_State *L, int idx, int type,
+                              const void *buff, lua_Integer first, size_t n);
 LUA_API int   (lua_setmetatable) (lua_State *L, int objindex);
 LUA_API void  (lua_setuservalue) (lua_State *L, int idx);
 
@@ -308,6 +327,9 @@ LUA_API int (lua_isyieldable) (lua_State *L);
 #define LUA_GCSETPAUSE		6
 #define LUA_GCSETSTEPMUL	7
 #define LUA_GCISRUNNING		9
+#define LUA_GCGEN		10
+#define LUA_GCINC		11
+#define LUA_GCSETMAJORMUL	12
 
 LUA_API int (lua_gc) (lua_State *L, int what, int data);
 
@@ -28,6 +28,15 @@ SOFTWARE.
 
 LUAMOD_API int luaL_opengl(lua_State *lua);
 
+// True for gl table functions that only convert data and never call GL, so
+// they can run on any thread and without a context.
+LUAMOD_API int luaL_opengl_islocal(const char *name);
+
+// Makes L track buffers mapped through from, for a state that runs gl
+// calls on from's behalf, so deleting or unmapping a buffer in either
+// expires the views the other handed out. from has to outlive L.
+LUAMOD_API void luaL_opengl_sharemapped(lua_State *L, lua_State *from);
+
 #endif
 
 // End of file.
@@ -0,0 +1,248 @@
+#include "memory.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static void countResize(MemoryStats* stats, size_t osize, size_t nsize)
+{
+  if (nsize > osize)
+  {
+    stats->allocs++;
+    stats->allocated += nsize - osize;
+  }
+  else
+  {
+    stats->freed += osize - nsize;
+  }
+
+  stats->current += nsize;
+  stats->current -= osize;
+  if (stats->current > stats->peak)
+  {
+    stats->peak = stats->current;
+  }
+}
+
+static void countFree(MemoryStats* stats, size_t osize)
+{
+  stats->frees++;
+  stats->freed += osize;
+  stats->current -= osize;
+}
+
+void* memoryAlloc(void* ud, void* ptr, size_t osize, size_t nsize)
+{
+  MemoryStats* stats = (MemoryStats*)ud;
+
+  //lua passes the type tag rather than a size for new blocks
+  if (ptr == NULL)
+  {
+    osize = 0;
+  }
+
+  if (nsize == 0)
+  {
+    if (ptr != NULL)
+    {
+      countFree(stats, osize);
+    }
+    free(ptr);
+    return NULL;
+  }
+
+  void* block = realloc(ptr, nsize);
+  if (block == NULL)
+  {
+    return NULL;
+  }
+
+  countResize(stats, osize, nsize);
+  return block;
+}
+
+void memoryPoolInit(MemoryPool* pool)
+{
+  memset(pool, 0, sizeof(MemoryPool));
+}
+
+void memoryPoolRelease(MemoryPool* pool)
+{
+  while (pool->slabList != NULL)
+  {
+    void* slab = pool->slabList;
+    pool->slabList = *(void**)slab;
+    free(slab);
+  }
+  memset(pool->free, 0, sizeof(pool->free));
+  pool->next = NULL;
+  pool->end = NULL;
+  pool->slabs = 0;
+}
+
+static int sizeClass(size_t size)
+{
+  return (int)((size - 1) / MEMORY_GRANULE);
+}
+
+static void poolGive(MemoryPool* pool, void* block, size_t size)
+{
+  int c = sizeClass(size);
+  *(void**)block = pool->free[c];
+  pool->free[c] = block;
+}
+
+static void* poolTake(MemoryPool* pool, int c)
+{
+  void* block = pool->free[c];
+  if (block != NULL)
+  {
+    pool->free[c] = *(void**)block;
+    return block;
+  }
+
+  size_t size = (size_t)(c + 1) * MEMORY_GRANULE;
+  if ((size_t)(pool->end - pool->next) < size)
+  {
+    //the rest of the old slab is a multiple of the granule smaller than
+    //this class, it becomes a block of its own class
+    size_t rest = (size_t)(pool->end - pool->next);
+    if (rest > 0)
+    {
+      poolGive(pool, pool->next, rest);
+    }
+
+    char* slab = (char*)malloc(MEMORY_SLAB);
+    if (slab == NULL)
+    {
+      return NULL;
+    }
+    *(void**)slab = pool->slabList;
+    pool->slabList = slab;
+    pool->slabs++;
+    //the link takes the first granule so blocks stay aligned
+    pool->next = slab + MEMORY_GRANULE;
+    pool->end = slab + MEMORY_SLAB;
+  }
+
+  block = pool->next;
+  pool->next += size;
+  return block;
+}
+
+void* memoryPoolAlloc(void* ud, void* ptr, size_t osize, size_t nsize)
+{
+  MemoryPool* pool = (MemoryPool*)ud;
+
+  if (ptr == NULL)
+  {
+    osize = 0;
+  }
+
+  if (nsize == 0)
+  {
+    if (ptr != NULL)
+    {
+      countFree(&pool->stats, osize);
+      if (osize <= MEMORY_SMALL)
+      {
+        poolGive(pool, ptr, osize);
+      }
+      else
+      {
+        free(ptr);
+      }
+    }
+    return NULL;
+  }
+
+  void* block = NULL;
+  if (nsize > MEMORY_SMALL)
+  {
+    //realloc can grow a large block in place
+    block = realloc(osize > MEMORY_SMALL ? ptr : NULL, nsize);
+    if (block == NULL)
+    {
+      return NULL;
+    }
+    if (ptr != NULL && osize <= MEMORY_SMALL)
+    {
+      memcpy(block, ptr, osize);
+      poolGive(pool, ptr, osize);
+    }
+  }
+  else if (ptr != NULL && sizeClass(osize) == sizeClass(nsize))
+  {
+    block = ptr;
+  }
+  else
+  {
+    block = poolTake(pool, sizeClass(nsize));
+    if (block == NULL)
+    {
+      return NULL;
+    }
+    pool->pooled++;
+    if (ptr != NULL)
+    {
+      memcpy(block, ptr, osize < nsize ? osize : nsize);
+      if (osize <= MEMORY_SMALL)
+      {
+        poolGive(pool, ptr, osize);
+      }
+      else
+      {
+        free(ptr);
+      }
+    }
+  }
+
+  countResize(&pool->stats, osize, nsize);
+  if (pool->stats.current > pool->frame.peak)
+  {
+    pool->frame.peak = pool->stats.current;
+  }
+  return block;
+}
+
+void memoryFrame(MemoryPool* pool, bool worst)
+{
+  MemoryFrame* last = &pool->last;
+  last->allocs = pool->stats.allocs - pool->frameStart.allocs;
+  last->bytes = pool->stats.allocated - pool->frameStart.allocated;
+  last->peak = pool->frame.peak;
+  if (worst)
+  {
+    MemoryFrame* most = &pool->worst;
+    most->allocs = last->allocs > most->allocs ? last->allocs : most->allocs;
+    most->bytes = last->bytes > most->bytes ? last->bytes : most->bytes;
+    most->peak = last->peak > most->peak ? last->peak : most->peak;
+  }
+
+  pool->frameStart = pool->stats;
+  pool->frame.peak = pool->stats.current;
+}
+
+int memoryPushStats(lua_State* L, void* ud)
+{
+  MemoryPool* pool = (MemoryPool*)ud;
+  lua_createtable(L, 0, 9);
+  lua_pushinteger(L, (lua_Integer)pool->last.allocs);
+  lua_setfield(L, -2, "allocs");
+  lua_pushinteger(L, (lua_Integer)pool->last.bytes);
+  lua_setfield(L, -2, "bytes");
+  lua_pushinteger(L, (lua_Integer)pool->last.peak);
+  lua_setfield(L, -2, "peak");
+  lua_pushinteger(L, (lua_Integer)pool->stats.current);
+  lua_setfield(L, -2, "current");
+  lua_pushinteger(L, (lua_Integer)pool->stats.peak);
+  lua_setfield(L, -2, "heapPeak");
+  lua_pushinteger(L, (lua_Integer)pool->stats.allocs);
+  lua_setfield(L, -2, "totalAllocs");
+  lua_pushinteger(L, (lua_Integer)pool->stats.allocated);
+  lua_setfield(L, -2, "totalBytes");
+  lua_pushinteger(L, (lua_Integer)pool->pooled);
+  lua_setfield(L, -2, "pooled");
+  lua_pushinteger(L, (lua_Integer)(pool->slabs * MEMORY_SLAB));
+  lua_setfield(L, -2, "slabBytes");
+  return 1;
+}
@@ -0,0 +1,74 @@
+#ifndef __MEMORY_H__
+#define __MEMORY_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include "lua/src/lua.h"
+
+// Counters kept by the engine's Lua allocator.
+struct MemoryStats
+{
+  uint64_t allocs;     // blocks handed out, including growing reallocs
+  uint64_t frees;
+  uint64_t allocated;  // bytes requested over the lifetime of the state
+  uint64_t freed;
+  size_t current;
+  size_t peak;
+};
+
+// lua_Alloc that behaves like the default one but keeps MemoryStats,
+// ud must point to a MemoryStats.
+void* memoryAlloc(void* ud, void* ptr, size_t osize, size_t nsize);
+
+// Size class pools for the small blocks scripts churn through: tables,
+// closures, upvalues and short strings. Blocks up to MEMORY_SMALL bytes are
+// rounded up to a multiple of MEMORY_GRANULE and come from that class's
+// free list, which is refilled from MEMORY_SLAB byte slabs. Freed blocks go
+// back on the list and slabs are only returned by memoryPoolRelease, so the
+// pool stays at the high water mark of the state. Larger blocks go to
+// realloc and free like memoryAlloc's.
+#define MEMORY_GRANULE 16
+#define MEMORY_CLASSES 16
+#define MEMORY_SMALL (MEMORY_GRANULE * MEMORY_CLASSES)
+#define MEMORY_SLAB (64 * 1024)
+
+struct MemoryFrame
+{
+  uint64_t allocs;
+  uint64_t bytes;  // requested
+  size_t peak;     // the highest the heap got during the frame
+};
+
+struct MemoryPool
+{
+  MemoryStats stats;
+  uint64_t pooled;   // allocs served from the size classes
+  size_t slabs;
+  void* free[MEMORY_CLASSES];
+  char* next;        // the unused end of the newest slab
+  char* end;
+  void* slabList;    // each slab starts with a pointer to the one before
+
+  MemoryFrame frame; // the frame in progress
+  MemoryStats frameStart;
+  MemoryFrame last;  // the last complete frame
+  MemoryFrame worst; // the largest of each since the loop started
+};
+
+void memoryPoolInit(MemoryPool* pool);
+
+// Frees the slabs, once the state using the pool is closed.
+void memoryPoolRelease(MemoryPool* pool);
+
+// lua_Alloc over a pool, ud must point to a MemoryPool. pool->stats counts
+// the same way memoryAlloc does.
+void* memoryPoolAlloc(void* ud, void* ptr, size_t osize, size_t nsize);
+
+// Closes a frame, call it at the start of each one. worst=false leaves the
+// closed frame out of worst, for the ones before the main loop.
+void memoryFrame(MemoryPool* pool, bool worst);
+
+// Stats source for engine.stats.memory, ud is the MemoryPool.
+int memoryPushStats(lua_State* L, void* ud);
+
+#endif
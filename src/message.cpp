@@ -0,0 +1,200 @@
+#include "message.h"
+#include "buffer.h"
+
+#include <string.h>
+#include "lua/src/lauxlib.h"
+
+#define MESSAGE_MAX_DEPTH 32
+
+static void put(std::vector<uint8_t>* out, const void* bytes, size_t size)
+{
+  out->insert(out->end(), (const uint8_t*)bytes, (const uint8_t*)bytes + size);
+}
+
+static void write(lua_State* L, int index, std::vector<uint8_t>* out, int depth)
+{
+  switch (lua_type(L, index))
+  {
+  case LUA_TNIL:
+    out->push_back(MSG_NIL);
+    break;
+  case LUA_TBOOLEAN:
+    out->push_back(lua_toboolean(L, index) ? MSG_TRUE : MSG_FALSE);
+    break;
+  case LUA_TNUMBER:
+    if (lua_isinteger(L, index))
+    {
+      int64_t value = lua_tointeger(L, index);
+      out->push_back(MSG_INTEGER);
+      put(out, &value, sizeof(value));
+    }
+    else
+    {
+      double value = lua_tonumber(L, index);
+      out->push_back(MSG_NUMBER);
+      put(out, &value, sizeof(value));
+    }
+    break;
+  case LUA_TSTRING:
+  {
+    size_t size = 0;
+    const char* bytes = lua_tolstring(L, index, &size);
+    uint32_t length = (uint32_t)size;
+    out->push_back(MSG_STRING);
+    put(out, &length, sizeof(length));
+    put(out, bytes, size);
+    break;
+  }
+  case LUA_TTABLE:
+  {
+    if (depth >= MESSAGE_MAX_DEPTH)
+    {
+      luaL_error(L, "can't send tables nested more than %d deep (or cyclic)", MESSAGE_MAX_DEPTH);
+    }
+    luaL_checkstack(L, 3, "message too deep");
+    index = lua_absindex(L, index);
+    out->push_back(MSG_TABLE);
+    lua_pushnil(L);
+    while (lua_next(L, index) != 0)
+    {
+      write(L, -2, out, depth + 1);
+      write(L, -1, out, depth + 1);
+      lua_pop(L, 1);
+    }
+    out->push_back(MSG_END);
+    break;
+  }
+  case LUA_TUSERDATA:
+  {
+    Buffer* buffer = bufferTest(L, index);
+    if (buffer != NULL)
+    {
+      out->push_back(MSG_BUFFER);
+      put(out, &buffer, sizeof(buffer));
+      break;
+    }
+  }
+  //fall through
+  default:
+    luaL_error(L, "can't send a %s", luaL_typename(L, index));
+  }
+}
+
+// Steps over one value adjusting buffer references by delta.
+static size_t walk(const uint8_t* data, size_t cursor, int delta)
+{
+  uint8_t tag = data[cursor++];
+  switch (tag)
+  {
+  case MSG_INTEGER:
+  case MSG_NUMBER:
+    return cursor + 8;
+  case MSG_STRING:
+  {
+    uint32_t length = 0;
+    memcpy(&length, data + cursor, sizeof(length));
+    return cursor + sizeof(length) + length;
+  }
+  case MSG_TABLE:
+    while (data[cursor] != MSG_END)
+    {
+      cursor = walk(data, cursor, delta);
+      cursor = walk(data, cursor, delta);
+    }
+    return cursor + 1;
+  case MSG_BUFFER:
+  {
+    Buffer* buffer = NULL;
+    memcpy(&buffer, data + cursor, sizeof(buffer));
+    if (delta > 0)
+    {
+      bufferRetain(buffer);
+    }
+    else if (delta < 0)
+    {
+      bufferRelease(buffer);
+    }
+    return cursor + sizeof(buffer);
+  }
+  default:
+    return cursor;
+  }
+}
+
+void messageWrite(lua_State* L, int index, std::vector<uint8_t>* out)
+{
+  //references are only taken once the whole value is written, an error
+  //part way leaves nothing to undo
+  size_t start = out->size();
+  write(L, index, out, 0);
+  walk(out->data(), start, 1);
+}
+
+size_t messageRead(lua_State* L, const uint8_t* data, size_t cursor)
+{
+  luaL_checkstack(L, 3, "message too deep");
+  uint8_t tag = data[cursor++];
+  switch (tag)
+  {
+  case MSG_NIL:
+    lua_pushnil(L);
+    break;
+  case MSG_FALSE:
+  case MSG_TRUE:
+    lua_pushboolean(L, tag == MSG_TRUE);
+    break;
+  case MSG_INTEGER:
+  {
+    int64_t value = 0;
+    memcpy(&value, data + cursor, sizeof(value));
+    lua_pushinteger(L, (lua_Integer)value);
+    cursor += sizeof(value);
+    break;
+  }
+  case MSG_NUMBER:
+  {
+    double value = 0;
+    memcpy(&value, data + cursor, sizeof(value));
+    lua_pushnumber(L, value);
+    cursor += sizeof(value);
+    break;
+  }
+  case MSG_STRING:
+  {
+    uint32_t length = 0;
+    memcpy(&length, data + cursor, sizeof(length));
+    cursor += sizeof(length);
+    lua_pushlstring(L, (const char*)data + cursor, length);
+    cursor += length;
+    break;
+  }
+  case MSG_TABLE:
+    lua_newtable(L);
+    while (data[cursor] != MSG_END)
+    {
+      cursor = messageRead(L, data, cursor);
+      cursor = messageRead(L, data, cursor);
+      lua_rawset(L, -3);
+    }
+    cursor += 1;
+    break;
+  case MSG_BUFFER:
+  {
+    Buffer* buffer = NULL;
+    memcpy(&buffer, data + cursor, sizeof(buffer));
+    bufferPush(L, buffer);
+    cursor += sizeof(buffer);
+    break;
+  }
+  }
+  return cursor;
+}
+
+void messageDiscard(const uint8_t* data, size_t size)
+{
+  size_t cursor = 0;
+  while (cursor < size)
+  {
+    cursor = walk(data, cursor, -1);
+  }
+}
@@ -0,0 +1,39 @@
+#ifndef __MESSAGE_H__
+#define __MESSAGE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "lua/src/lua.h"
+
+// Lua values flattened to bytes so they can move between states. Each value
+// is a tag byte and an inline payload, tables are their key/value pairs
+// closed by MSG_END:
+//
+//   nil, false, true, int64, double, uint32 length + bytes,
+//   table { key, value } * n MSG_END, Buffer pointer (see buffer.h)
+enum MessageTag
+{
+  MSG_NIL,
+  MSG_FALSE,
+  MSG_TRUE,
+  MSG_INTEGER,
+  MSG_NUMBER,
+  MSG_STRING,
+  MSG_TABLE,
+  MSG_END,
+  MSG_BUFFER
+};
+
+// Appends the value at index. Raises a Lua error for functions, userdata
+// other than buffers, threads, and tables nested too deeply (which
+// includes cycles).
+void messageWrite(lua_State* L, int index, std::vector<uint8_t>* out);
+
+// Pushes the value written at cursor, returns the cursor after it.
+size_t messageRead(lua_State* L, const uint8_t* data, size_t cursor);
+
+// Drops the references held by a message that will never be read.
+void messageDiscard(const uint8_t* data, size_t size);
+
+#endif
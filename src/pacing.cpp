@@ -0,0 +1,73 @@
+#include "pacing.h"
+#include "timer.h"
+
+#include <chrono>
+#include <thread>
+
+#define PACING_MIN_MARGIN 200000ull   // 0.2 ms
+#define PACING_MAX_MARGIN 4000000ull  // 4 ms
+
+static const char* names[] = {
+  "unthrottled",
+  "vsync",
+  "fps"
+};
+
+void pacingInit(Pacer* p, PacingMode mode, double fps)
+{
+  p->mode = mode;
+  p->period = fps > 0 ? (uint64_t)(1e9 / fps) : 0;
+  p->next = 0;
+  p->margin = 1000000;
+  p->slept = 0;
+  p->spun = 0;
+}
+
+void pacingWait(Pacer* p)
+{
+  if (p->mode != PACING_FPS || p->period == 0)
+  {
+    return;
+  }
+
+  uint64_t now = timerNow();
+  if (p->next == 0 || now > p->next + p->period)
+  {
+    p->next = now + p->period;
+  }
+
+  if (p->next > now + p->margin)
+  {
+    uint64_t wanted = p->next - now - p->margin;
+    std::this_thread::sleep_for(std::chrono::nanoseconds(wanted));
+
+    uint64_t woke = timerNow();
+    uint64_t late = woke - now > wanted ? woke - now - wanted : 0;
+
+    //widen quickly when a sleep overshoots, narrow slowly
+    uint64_t target = late + late / 2 + PACING_MIN_MARGIN;
+    p->margin = target > p->margin ? target : p->margin - (p->margin - target) / 16;
+    if (p->margin > PACING_MAX_MARGIN)
+    {
+      p->margin = PACING_MAX_MARGIN;
+    }
+
+    p->slept += woke - now;
+    now = woke;
+  }
+
+  uint64_t spinStart = now;
+  while (now < p->next)
+  {
+    std::this_thread::yield();
+    now = timerNow();
+  }
+  p->spun += now - spinStart;
+
+  p->next += p->period;
+}
+
+const char* pacingName(PacingMode mode)
+{
+  return names[mode];
+}
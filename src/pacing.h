@@ -0,0 +1,37 @@
+#ifndef __PACING_H__
+#define __PACING_H__
+
+#include <stdint.h>
+
+// How the main loop waits between frames.
+enum PacingMode
+{
+  PACING_UNTHROTTLED,  // never waits, for benchmarks
+  PACING_VSYNC,        // the buffer swap blocks until the display refreshes
+  PACING_FPS           // sleeps to hold a target rate
+};
+
+// Frame deadlines for PACING_FPS. Sleeping is only accurate to the OS timer
+// slack, so the pacer sleeps until a margin before the deadline and yields
+// for the rest. The margin follows how late recent sleeps woke up.
+struct Pacer
+{
+  PacingMode mode;
+  uint64_t period;  // ns per frame
+  uint64_t next;    // deadline of the frame being waited for, 0 before the first
+  uint64_t margin;  // ns before the deadline that sleeping stops
+
+  uint64_t slept;   // totals, ns
+  uint64_t spun;
+};
+
+void pacingInit(Pacer* p, PacingMode mode, double fps);
+
+// Called at the end of a frame, returns when the next should start. A frame
+// that overruns by more than a period moves the deadlines rather than
+// rushing the following frames to catch up.
+void pacingWait(Pacer* p);
+
+const char* pacingName(PacingMode mode);
+
+#endif
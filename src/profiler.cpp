@@ -0,0 +1,244 @@
+#include "profiler.h"
+#include "timer.h"
+#include "lua/src/lauxlib.h"
+
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+
+static const char* names[PHASE_COUNT + 1] = {
+  "events",
+  "update",
+  "draw",
+  "gc",
+  "swap",
+  "idle",
+  "frame"
+};
+
+void profilerInit(Profiler* p)
+{
+  memset(p, 0, sizeof(Profiler));
+  p->head = -1;
+  p->origin = timerNow();
+}
+
+void profilerBeginFrame(Profiler* p)
+{
+  p->head = (p->head + 1) % PROFILER_FRAMES;
+  if (p->count < PROFILER_FRAMES)
+  {
+    p->count++;
+  }
+
+  FrameTimes* frame = &p->frames[p->head];
+  memset(frame, 0, sizeof(FrameTimes));
+  frame->start = timerNow();
+}
+
+void profilerBegin(Profiler* p, Phase phase)
+{
+  p->open[phase] = timerNow();
+}
+
+void profilerEnd(Profiler* p, Phase phase)
+{
+  if (p->head < 0)
+  {
+    return;
+  }
+
+  FrameTimes* frame = &p->frames[p->head];
+  if (frame->calls[phase] == 0)
+  {
+    frame->begin[phase] = p->open[phase];
+  }
+  frame->duration[phase] += timerNow() - p->open[phase];
+  frame->calls[phase]++;
+}
+
+PhaseStats profilerStats(Profiler* p, int phase)
+{
+  PhaseStats stats = { 0, 0, 0, 0, 0 };
+
+  //frame time is start to start so the newest frame has no length yet
+  int n = 0;
+  int first = (p->head - p->count + 1 + PROFILER_FRAMES) % PROFILER_FRAMES;
+  for (int i = 0; i < p->count; ++i)
+  {
+    int index = (first + i) % PROFILER_FRAMES;
+    if (phase == PHASE_COUNT)
+    {
+      if (i + 1 < p->count)
+      {
+        int next = (index + 1) % PROFILER_FRAMES;
+        p->scratch[n++] = p->frames[next].start - p->frames[index].start;
+      }
+    }
+    else
+    {
+      p->scratch[n++] = p->frames[index].duration[phase];
+    }
+  }
+
+  if (n == 0)
+  {
+    return stats;
+  }
+
+  std::sort(p->scratch, p->scratch + n);
+
+  uint64_t total = 0;
+  for (int i = 0; i < n; ++i)
+  {
+    total += p->scratch[i];
+  }
+
+  const double ms = 1e-6;
+  stats.min = p->scratch[0] * ms;
+  stats.max = p->scratch[n - 1] * ms;
+  stats.avg = (double)total / n * ms;
+  stats.p95 = p->scratch[(n - 1) * 95 / 100] * ms;
+  stats.p99 = p->scratch[(n - 1) * 99 / 100] * ms;
+  return stats;
+}
+
+const char* profilerPhaseName(int phase)
+{
+  return names[phase];
+}
+
+int profilerDumpTrace(const Profiler* p, const char* path)
+{
+  FILE* file = fopen(path, "w");
+  if (file == NULL)
+  {
+    return -1;
+  }
+
+  fprintf(file, "{\"traceEvents\":[\n");
+
+  bool comma = false;
+  int first = (p->head - p->count + 1 + PROFILER_FRAMES) % PROFILER_FRAMES;
+  for (int i = 0; i < p->count; ++i)
+  {
+    const FrameTimes* frame = &p->frames[(first + i) % PROFILER_FRAMES];
+
+    if (i + 1 < p->count)
+    {
+      const FrameTimes* next = &p->frames[(first + i + 1) % PROFILER_FRAMES];
+      fprintf(file, "%s{\"name\":\"frame\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"dur\":%.3f}",
+        comma ? ",\n" : "",
+        (frame->start - p->origin) * 1e-3, (next->start - frame->start) * 1e-3);
+      comma = true;
+    }
+
+    for (int phase = 0; phase < PHASE_COUNT; ++phase)
+    {
+      if (frame->calls[phase] == 0)
+      {
+        continue;
+      }
+
+      fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"calls\":%d}}",
+        comma ? ",\n" : "", names[phase],
+        (frame->begin[phase] - p->origin) * 1e-3, frame->duration[phase] * 1e-3,
+        frame->calls[phase]);
+      comma = true;
+    }
+  }
+
+  fprintf(file, "\n]}\n");
+  fclose(file);
+  return 0;
+}
+
+void profilerAddSource(Profiler* p, const char* name, StatsSource push, void* ud)
+{
+  if (p->sourceCount < PROFILER_SOURCES)
+  {
+    p->sources[p->sourceCount].name = name;
+    p->sources[p->sourceCount].push = push;
+    p->sources[p->sourceCount].ud = ud;
+    p->sourceCount++;
+  }
+}
+
+static Profiler* toProfiler(lua_State* L)
+{
+  return (Profiler*)lua_touserdata(L, lua_upvalueindex(1));
+}
+
+// engine.stats.<phase> -> { min, avg, p95, p99, max } in milliseconds
+static int statsIndex(lua_State* L)
+{
+  const char* name = luaL_checkstring(L, 2);
+  for (int phase = 0; phase <= PHASE_COUNT; ++phase)
+  {
+    if (strcmp(name, names[phase]) == 0)
+    {
+      PhaseStats stats = profilerStats(toProfiler(L), phase);
+
+      lua_createtable(L, 0, 5);
+      lua_pushnumber(L, stats.min);
+      lua_setfield(L, -2, "min");
+      lua_pushnumber(L, stats.avg);
+      lua_setfield(L, -2, "avg");
+      lua_pushnumber(L, stats.p95);
+      lua_setfield(L, -2, "p95");
+      lua_pushnumber(L, stats.p99);
+      lua_setfield(L, -2, "p99");
+      lua_pushnumber(L, stats.max);
+      lua_setfield(L, -2, "max");
+      return 1;
+    }
+  }
+
+  Profiler* p = toProfiler(L);
+  for (int i = 0; i < p->sourceCount; ++i)
+  {
+    if (strcmp(name, p->sources[i].name) == 0)
+    {
+      return p->sources[i].push(L, p->sources[i].ud);
+    }
+  }
+
+  if (strcmp(name, "frames") == 0)
+  {
+    lua_pushinteger(L, toProfiler(L)->count);
+    return 1;
+  }
+
+  lua_pushnil(L);
+  return 1;
+}
+
+// engine.stats.dump(path)
+static int statsDump(lua_State* L)
+{
+  const char* path = luaL_checkstring(L, 1);
+  if (profilerDumpTrace(toProfiler(L), path) != 0)
+  {
+    return luaL_error(L, "unable to write trace to %s", path);
+  }
+  return 0;
+}
+
+void profilerRegister(lua_State* L, Profiler* p)
+{
+  lua_getglobal(L, "engine");
+
+  lua_newtable(L);
+  lua_pushlightuserdata(L, p);
+  lua_pushcclosure(L, statsDump, 1);
+  lua_setfield(L, -2, "dump");
+
+  lua_createtable(L, 0, 1);
+  lua_pushlightuserdata(L, p);
+  lua_pushcclosure(L, statsIndex, 1);
+  lua_setfield(L, -2, "__index");
+  lua_setmetatable(L, -2);
+
+  lua_setfield(L, -2, "stats");
+  lua_pop(L, 1);
+}
@@ -0,0 +1,86 @@
+#ifndef __PROFILER_H__
+#define __PROFILER_H__
+
+#include <stdint.h>
+#include "lua/src/lua.h"
+
+// Parts of a frame we time.
+enum Phase
+{
+  PHASE_EVENTS,
+  PHASE_UPDATE,
+  PHASE_DRAW,
+  PHASE_GC,     // collector steps in the frame's spare time, see collector.h
+  PHASE_SWAP,
+  PHASE_IDLE,   // waiting for the next frame, see pacing.h
+  PHASE_COUNT
+};
+
+// Number of frames kept in the ring, older frames are overwritten.
+#define PROFILER_FRAMES 600
+
+struct FrameTimes
+{
+  uint64_t start;
+  uint64_t begin[PHASE_COUNT];     // first time the phase was entered
+  uint64_t duration[PHASE_COUNT];  // total time spent in the phase
+  uint16_t calls[PHASE_COUNT];
+};
+
+// Pushes one value describing some other part of the engine.
+typedef int (*StatsSource)(lua_State* L, void* ud);
+
+#define PROFILER_SOURCES 8
+
+struct PhaseStats
+{
+  double min;
+  double avg;
+  double p95;
+  double p99;
+  double max;
+};
+
+// Fixed size, recording never allocates so it doesn't disturb what it
+// measures.
+struct Profiler
+{
+  FrameTimes frames[PROFILER_FRAMES];
+  int head;
+  int count;
+  uint64_t origin;
+  uint64_t open[PHASE_COUNT];
+  uint64_t scratch[PROFILER_FRAMES];
+
+  struct
+  {
+    const char* name;
+    StatsSource push;
+    void* ud;
+  } sources[PROFILER_SOURCES];
+  int sourceCount;
+};
+
+void profilerInit(Profiler* p);
+
+void profilerBeginFrame(Profiler* p);
+void profilerBegin(Profiler* p, Phase phase);
+void profilerEnd(Profiler* p, Phase phase);
+
+// Summary in milliseconds over the frames in the ring. phase may be
+// PHASE_COUNT for the whole frame, measured start to start.
+PhaseStats profilerStats(Profiler* p, int phase);
+
+const char* profilerPhaseName(int phase);
+
+// Writes the ring as Chrome trace event JSON (chrome://tracing, Perfetto).
+int profilerDumpTrace(const Profiler* p, const char* path);
+
+// Makes engine.stats.<name> call push, name must be a literal or outlive
+// the profiler.
+void profilerAddSource(Profiler* p, const char* name, StatsSource push, void* ud);
+
+// Sets engine.stats, the engine table must be a global already.
+void profilerRegister(lua_State* L, Profiler* p);
+
+#endif
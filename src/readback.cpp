@@ -0,0 +1,462 @@
+#include "readback.h"
+#include "buffer.h"
+#include "glstate.h"
+#include "timer.h"
+#include "lua/src/lauxlib.h"
+
+#if EMSCRIPTEN
+
+#else
+#define USE_GLEW 1
+#endif
+
+#include "SDL/SDL.h"
+
+#if USE_GLEW
+#include "GL/glew.h"
+#else
+#include "SDL/SDL_opengl.h"
+#endif
+
+#include <string.h>
+#include <vector>
+
+ReadbackPacking readbackPacking()
+{
+  GLint values[4] = {4, 0, 0, 0};
+  glGetIntegerv(GL_PACK_ALIGNMENT, &values[0]);
+  glGetIntegerv(GL_PACK_ROW_LENGTH, &values[1]);
+  glGetIntegerv(GL_PACK_SKIP_ROWS, &values[2]);
+  glGetIntegerv(GL_PACK_SKIP_PIXELS, &values[3]);
+  ReadbackPacking pack = {values[0], values[1], values[2], values[3]};
+  return pack;
+}
+
+size_t readbackSize(unsigned format, unsigned type, int width, int height,
+  const ReadbackPacking* pack)
+{
+  size_t pixel = 0;
+  switch (type)
+  {
+  case GL_UNSIGNED_BYTE_3_3_2:
+    pixel = 1;
+    break;
+  case GL_UNSIGNED_SHORT_5_6_5:
+  case GL_UNSIGNED_SHORT_4_4_4_4:
+  case GL_UNSIGNED_SHORT_5_5_5_1:
+    pixel = 2;
+    break;
+  case GL_UNSIGNED_INT_8_8_8_8:
+  case GL_UNSIGNED_INT_8_8_8_8_REV:
+  case GL_UNSIGNED_INT_10_10_10_2:
+  case GL_UNSIGNED_INT_2_10_10_10_REV:
+  case GL_UNSIGNED_INT_10F_11F_11F_REV:
+  case GL_UNSIGNED_INT_5_9_9_9_REV:
+  case GL_UNSIGNED_INT_24_8:
+    pixel = 4;
+    break;
+  case GL_FLOAT_32_UNSIGNED_INT_24_8_REV:
+    pixel = 8;
+    break;
+  default:
+  {
+    size_t component = 0;
+    switch (type)
+    {
+    case GL_BYTE:
+    case GL_UNSIGNED_BYTE:
+      component = 1;
+      break;
+    case GL_SHORT:
+    case GL_UNSIGNED_SHORT:
+    case GL_HALF_FLOAT:
+      component = 2;
+      break;
+    case GL_INT:
+    case GL_UNSIGNED_INT:
+    case GL_FLOAT:
+      component = 4;
+      break;
+    default:
+      return 0;
+    }
+
+    switch (format)
+    {
+    case GL_RED:
+    case GL_GREEN:
+    case GL_BLUE:
+    case GL_ALPHA:
+    case GL_RED_INTEGER:
+    case GL_DEPTH_COMPONENT:
+    case GL_STENCIL_INDEX:
+      pixel = component;
+      break;
+    case GL_RG:
+    case GL_RG_INTEGER:
+      pixel = component * 2;
+      break;
+    case GL_RGB:
+    case GL_BGR:
+    case GL_RGB_INTEGER:
+      pixel = component * 3;
+      break;
+    case GL_RGBA:
+    case GL_BGRA:
+    case GL_RGBA_INTEGER:
+      pixel = component * 4;
+      break;
+    default:
+      return 0;
+    }
+  }
+  }
+
+  if (width <= 0 || height <= 0)
+  {
+    return 0;
+  }
+  //GL keeps these non-negative, clamp anyway since they size allocations
+  size_t align = pack->alignment > 0 ? (size_t)pack->alignment : 1;
+  size_t length = pack->rowLength > 0 ? (size_t)pack->rowLength : (size_t)width;
+  size_t skipRows = pack->skipRows > 0 ? (size_t)pack->skipRows : 0;
+  size_t skipPixels = pack->skipPixels > 0 ? (size_t)pack->skipPixels : 0;
+
+  //the row stride comes from the row length, the region may be narrower
+  size_t row = (length * pixel + align - 1) / align * align;
+  return row * (skipRows + height - 1) + (skipPixels + width) * pixel;
+}
+
+struct ReadbackSlot
+{
+  GLuint pbo;
+  size_t capacity;  // bytes in the pbo
+#if USE_GLEW
+  GLsync sync;
+#endif
+  Buffer* pixels;   // uint8, replaced only when the size changes
+  lua_Integer id;
+  int width;
+  int height;
+  size_t size;
+};
+
+struct Readback
+{
+  ReadbackMode mode;
+  std::vector<ReadbackSlot> slots;
+  int head;     // oldest pending slot
+  int pending;
+  lua_Integer nextId;
+  ReadbackStats stats;
+};
+
+// The slot's own buffer, sized for what it holds
+static Buffer* slotPixels(ReadbackSlot* slot)
+{
+  if (slot->pixels == NULL || slot->pixels->size != slot->size)
+  {
+    if (slot->pixels != NULL)
+    {
+      bufferRelease(slot->pixels);
+    }
+    slot->pixels = bufferCreate(BUFFER_UINT8, slot->size);
+  }
+  return slot->pixels;
+}
+
+static void request(Readback* r, ReadbackSlot* slot, int x, int y, unsigned format, unsigned type)
+{
+  if (r->mode == READBACK_NULL)
+  {
+    return;
+  }
+
+#if USE_GLEW
+  if (slot->pbo == 0)
+  {
+    glGenBuffers(1, &slot->pbo);
+  }
+  unsigned bound = glstateBoundBuffer(GL_PIXEL_PACK_BUFFER);
+  glstateBindBuffer(GL_PIXEL_PACK_BUFFER, slot->pbo);
+  if (slot->capacity < slot->size)
+  {
+    glBufferData(GL_PIXEL_PACK_BUFFER, slot->size, NULL, GL_STREAM_READ);
+    slot->capacity = slot->size;
+  }
+  glReadPixels(x, y, slot->width, slot->height, format, type, NULL);
+  //the script's own pack buffer, if it bound one
+  glstateBindBuffer(GL_PIXEL_PACK_BUFFER, bound);
+  slot->sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+#else
+  //no pack buffers or fences, read now and hand it over on the next poll
+  glReadPixels(x, y, slot->width, slot->height, format, type, slotPixels(slot)->data);
+#endif
+}
+
+// True once the slot's pixels are in its buffer or into
+static bool complete(Readback* r, ReadbackSlot* slot, bool wait, Buffer* into)
+{
+  Buffer* pixels = into != NULL ? into : slotPixels(slot);
+  if (r->mode == READBACK_NULL)
+  {
+    memset(pixels->data, 0, slot->size);
+    return true;
+  }
+
+#if USE_GLEW
+  GLenum result = glClientWaitSync(slot->sync, 0, 0);
+  if (result == GL_TIMEOUT_EXPIRED)
+  {
+    if (!wait)
+    {
+      return false;
+    }
+    uint64_t start = timerNow();
+    do
+    {
+      result = glClientWaitSync(slot->sync, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+    } while (result == GL_TIMEOUT_EXPIRED);
+    r->stats.waits++;
+    r->stats.waited += timerNow() - start;
+  }
+  glDeleteSync(slot->sync);
+  slot->sync = 0;
+
+  unsigned bound = glstateBoundBuffer(GL_PIXEL_PACK_BUFFER);
+  glstateBindBuffer(GL_PIXEL_PACK_BUFFER, slot->pbo);
+  const void* mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, slot->size, GL_MAP_READ_BIT);
+  if (mapped != NULL)
+  {
+    memcpy(pixels->data, mapped, slot->size);
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+  }
+  glstateBindBuffer(GL_PIXEL_PACK_BUFFER, bound);
+#else
+  if (into != NULL)
+  {
+    memcpy(into->data, slot->pixels->data, slot->size);
+  }
+#endif
+  return true;
+}
+
+static void freeSlot(Readback* r, ReadbackSlot* slot)
+{
+#if USE_GLEW
+  if (slot->sync != 0)
+  {
+    glDeleteSync(slot->sync);
+  }
+  if (slot->pbo != 0)
+  {
+    glDeleteBuffers(1, &slot->pbo);
+    glstateForgetBuffers(1, &slot->pbo);
+  }
+#endif
+  if (slot->pixels != NULL)
+  {
+    bufferRelease(slot->pixels);
+  }
+}
+
+// Lua side, a userdata holding the Readback*
+
+static const char* handleName = "engine.readback";
+
+static Readback* checkReadback(lua_State* L, int index)
+{
+  Readback* r = *(Readback**)luaL_checkudata(L, index, handleName);
+  luaL_argcheck(L, r != NULL, index, "readback has been destroyed");
+  return r;
+}
+
+// readback:request(x, y, width, height [, format [, type]]) -> id, or nil
+// when every slot is still waiting for its pixels. RGBA and UNSIGNED_BYTE
+// by default.
+static int readbackLuaRequest(lua_State* L)
+{
+  Readback* r = checkReadback(L, 1);
+  int x = (int)luaL_checkinteger(L, 2);
+  int y = (int)luaL_checkinteger(L, 3);
+  int width = (int)luaL_checkinteger(L, 4);
+  int height = (int)luaL_checkinteger(L, 5);
+  unsigned format = (unsigned)luaL_optinteger(L, 6, GL_RGBA);
+  unsigned type = (unsigned)luaL_optinteger(L, 7, GL_UNSIGNED_BYTE);
+
+  ReadbackPacking pack = {4, 0, 0, 0};
+  if (r->mode != READBACK_NULL)
+  {
+    pack = readbackPacking();
+  }
+  size_t size = readbackSize(format, type, width, height, &pack);
+  luaL_argcheck(L, size > 0, 4, "empty region or unknown format and type");
+
+  if (r->pending == (int)r->slots.size())
+  {
+    r->stats.dropped++;
+    lua_pushnil(L);
+    return 1;
+  }
+
+  ReadbackSlot* slot = &r->slots[(r->head + r->pending) % r->slots.size()];
+  slot->id = ++r->nextId;
+  slot->width = width;
+  slot->height = height;
+  slot->size = size;
+  request(r, slot, x, y, format, type);
+  r->pending++;
+  r->stats.requests++;
+
+  lua_pushinteger(L, slot->id);
+  return 1;
+}
+
+// Hands over the oldest request if its pixels are in, into being an
+// optional uint8 buffer to copy them to.
+static int finish(lua_State* L, bool wait)
+{
+  Readback* r = checkReadback(L, 1);
+  Buffer* into = NULL;
+  if (!lua_isnoneornil(L, 2))
+  {
+    into = bufferCheck(L, 2);
+    luaL_argcheck(L, into->type == BUFFER_UINT8, 2, "expected a uint8 buffer");
+  }
+  if (r->pending == 0)
+  {
+    lua_pushnil(L);
+    return 1;
+  }
+
+  ReadbackSlot* slot = &r->slots[r->head];
+  luaL_argcheck(L, into == NULL || into->size >= slot->size, 2, "smaller than the pixels");
+  if (!complete(r, slot, wait, into))
+  {
+    lua_pushnil(L);
+    return 1;
+  }
+
+  r->head = (r->head + 1) % r->slots.size();
+  r->pending--;
+  r->stats.completed++;
+
+  lua_pushinteger(L, slot->id);
+  if (into != NULL)
+  {
+    lua_pushvalue(L, 2);
+  }
+  else
+  {
+    bufferRetain(slot->pixels);
+    bufferPush(L, slot->pixels);
+  }
+  lua_pushinteger(L, slot->width);
+  lua_pushinteger(L, slot->height);
+  return 4;
+}
+
+// readback:poll([into]) -> id, pixels, width, height of the oldest request
+// once the GPU has written it, nil before that
+static int readbackLuaPoll(lua_State* L)
+{
+  return finish(L, false);
+}
+
+// readback:wait([into]), poll that blocks until the oldest request is in
+static int readbackLuaWait(lua_State* L)
+{
+  return finish(L, true);
+}
+
+static int readbackLuaPending(lua_State* L)
+{
+  lua_pushinteger(L, checkReadback(L, 1)->pending);
+  return 1;
+}
+
+// readback:stats() -> totals, waited in milliseconds
+static int readbackLuaStats(lua_State* L)
+{
+  ReadbackStats stats = checkReadback(L, 1)->stats;
+  lua_createtable(L, 0, 5);
+  lua_pushinteger(L, (lua_Integer)stats.requests);
+  lua_setfield(L, -2, "requests");
+  lua_pushinteger(L, (lua_Integer)stats.completed);
+  lua_setfield(L, -2, "completed");
+  lua_pushinteger(L, (lua_Integer)stats.dropped);
+  lua_setfield(L, -2, "dropped");
+  lua_pushinteger(L, (lua_Integer)stats.waits);
+  lua_setfield(L, -2, "waits");
+  lua_pushnumber(L, stats.waited * 1e-6);
+  lua_setfield(L, -2, "waited");
+  return 1;
+}
+
+static int readbackLuaGc(lua_State* L)
+{
+  Readback** ud = (Readback**)luaL_checkudata(L, 1, handleName);
+  if (*ud != NULL)
+  {
+    for (ReadbackSlot& slot : (*ud)->slots)
+    {
+      freeSlot(*ud, &slot);
+    }
+    delete *ud;
+    *ud = NULL;
+  }
+  return 0;
+}
+
+// gl.Readback([slots]), the mode is an upvalue. Three slots cover the
+// frames a driver usually queues.
+static int readbackLuaCreate(lua_State* L)
+{
+  ReadbackMode mode = (ReadbackMode)lua_tointeger(L, lua_upvalueindex(1));
+  if (mode == READBACK_NONE)
+  {
+    return luaL_error(L, "Readback needs GL on the main thread, run without --render-thread");
+  }
+
+  lua_Integer slots = luaL_optinteger(L, 1, 3);
+  luaL_argcheck(L, slots > 0 && slots <= 64, 1, "invalid slot count");
+
+  Readback** ud = (Readback**)lua_newuserdata(L, sizeof(Readback*));
+  *ud = NULL;
+  luaL_setmetatable(L, handleName);
+
+  Readback* r = new Readback();
+  r->mode = mode;
+  r->slots.resize((size_t)slots, ReadbackSlot());
+  r->head = 0;
+  r->pending = 0;
+  r->nextId = 0;
+  r->stats = ReadbackStats();
+  *ud = r;
+  return 1;
+}
+
+void readbackRegister(lua_State* L, ReadbackMode mode)
+{
+  static const luaL_Reg methods[] = {
+    {"request", readbackLuaRequest},
+    {"poll", readbackLuaPoll},
+    {"wait", readbackLuaWait},
+    {"pending", readbackLuaPending},
+    {"stats", readbackLuaStats},
+    {"__gc", readbackLuaGc},
+    {NULL, NULL}
+  };
+
+  luaL_newmetatable(L, handleName);
+  luaL_setfuncs(L, methods, 0);
+  lua_pushvalue(L, -1);
+  lua_setfield(L, -2, "__index");
+  lua_pop(L, 1);
+
+  lua_getglobal(L, "gl");
+  lua_pushinteger(L, mode);
+  lua_pushcclosure(L, readbackLuaCreate, 1);
+  lua_setfield(L, -2, "Readback");
+  lua_pop(L, 1);
+}
@@ -0,0 +1,66 @@
+#ifndef __READBACK_H__
+#define __READBACK_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include "lua/src/lua.h"
+
+// Asynchronous pixel readback through pixel buffer objects. A request
+// reads a region of the framebuffer into one of a few pack buffers and
+// fences it, so the call returns once the copy is queued rather than when
+// the GPU has caught up. A few frames later polling finds the fence
+// signalled and copies the pixels into a gl.Buffer that is reused request
+// after request.
+//
+//   local readback = gl.Readback(3)
+//   function draw()
+//     ...
+//     if wantShot then readback:request(0, 0, 640, 480) end
+//     local id, pixels, width, height = readback:poll()
+//     if id then save(pixels, width, height) end
+//   end
+//
+// Results come back in request order. Each slot keeps its buffer, so the
+// pixels poll returns are overwritten when the slot is used again: copy
+// them, or pass poll a uint8 buffer of your own to receive them. The pixels
+// are laid out by the pack state at request time, so with a row length or
+// skips set the buffer holds those too.
+
+enum ReadbackMode
+{
+  READBACK_PBO,   // pack buffers and fences
+  READBACK_NULL,  // no GL, requests complete on the next poll with zeroed pixels
+  READBACK_NONE   // GL isn't current on this thread, gl.Readback raises an error
+};
+
+struct ReadbackStats
+{
+  uint64_t requests;
+  uint64_t completed;
+  uint64_t dropped;  // requests made while every slot was busy
+  uint64_t waits;    // polls that blocked on a fence
+  uint64_t waited;   // ns spent in those polls
+};
+
+// The GL_PACK_* state glReadPixels lays the pixels out by.
+struct ReadbackPacking
+{
+  int alignment;   // rows start on a multiple of this many bytes
+  int rowLength;   // pixels per row, 0 for the region's width
+  int skipRows;    // rows before the region
+  int skipPixels;  // pixels before the region in each row
+};
+
+// Reads the current pack state from GL.
+ReadbackPacking readbackPacking();
+
+// Bytes from the start of the destination to the end of the last pixel
+// glReadPixels writes for a region under pack, skipped rows and pixels
+// included. 0 for an empty region or a format or type it doesn't know.
+size_t readbackSize(unsigned format, unsigned type, int width, int height,
+  const ReadbackPacking* pack);
+
+// Sets gl.Readback(slots), creating queues in mode.
+void readbackRegister(lua_State* L, ReadbackMode mode);
+
+#endif
@@ -0,0 +1,445 @@
+#include "render.h"
+#include "cmdlist.h"
+#include "luagl.h"
+#include "timer.h"
+#include "lua/src/lauxlib.h"
+
+#if EMSCRIPTEN
+
+Renderer* renderStart(lua_State* L, bool headless)
+{
+  return NULL;
+}
+
+void renderFrame(Renderer* r) {}
+void renderStop(Renderer* r) {}
+
+RenderStats renderStats(Renderer* r)
+{
+  RenderStats stats = {};
+  return stats;
+}
+
+int renderPushStats(lua_State* L, void* ud)
+{
+  lua_pushnil(L);
+  return 1;
+}
+
+#else
+
+#include "SDL/SDL.h"
+
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+
+enum RenderItemType
+{
+  ITEM_LIST,   // replay a partial list ahead of a sync call
+  ITEM_FRAME,  // replay a frame's list and swap
+  ITEM_CALL,   // run a C function on the main thread's lua_State
+  ITEM_QUIT
+};
+
+struct RenderItem
+{
+  RenderItemType type;
+  CommandList* list;
+  lua_State* L;
+  int nargs;
+};
+
+// At most one frame, one partial list and one call are ever queued.
+#define RENDER_QUEUE 8
+
+struct Renderer
+{
+  std::thread thread;
+
+  // Everything below is guarded by mutex. The main thread waits on done,
+  // the render thread on wake.
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::condition_variable done;
+  RenderItem queue[RENDER_QUEUE];
+  int head;
+  int count;
+  uint64_t submitted;
+  uint64_t completed;
+  uint64_t busy;
+  uint64_t idle;
+
+  // Main thread only, or handed over through the queue.
+  uint64_t lastFrame;
+  CommandList lists[2];
+  int current;
+  std::exception_ptr error;
+  RenderStats stats;
+
+  // Replays recorded commands, only used by the render thread. Keeping it
+  // apart from the main state means replay never touches the script's heap.
+  lua_State* replay;
+  int functions;
+  bool headless;
+};
+
+// Functions that return nothing and can be recorded instead of called.
+static const char* deferredPrefixes[] = {
+  "Bind", "Uniform", "ProgramUniform", "Enable", "Disable", "Delete",
+  "Draw", "MultiDraw", "Clear", "VertexAttrib", "Blend", "Depth", "Stencil",
+  "Tex", "Framebuffer", "Renderbuffer", "PixelStore", "Polygon", NULL
+};
+
+static const char* deferredNames[] = {
+  "Viewport", "Scissor", "CullFace", "FrontFace", "LineWidth", "PointSize",
+  "ColorMask", "ActiveTexture", "BufferData", "BufferSubData", "ShaderSource",
+  "CompileShader", "LinkProgram", "AttachShader", "DetachShader", "UseProgram",
+  "ValidateProgram", "GenerateMipmap", "Hint", "Flush", "Finish", "ReadBuffer",
+  NULL
+};
+
+static bool deferrable(const char* name)
+{
+  for (int i = 0; deferredPrefixes[i]; ++i)
+  {
+    if (strncmp(name, deferredPrefixes[i], strlen(deferredPrefixes[i])) == 0)
+    {
+      return true;
+    }
+  }
+  for (int i = 0; deferredNames[i]; ++i)
+  {
+    if (strcmp(name, deferredNames[i]) == 0)
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+static uint64_t submit(Renderer* r, RenderItem item)
+{
+  std::unique_lock<std::mutex> lock(r->mutex);
+  while (r->count == RENDER_QUEUE)
+  {
+    r->done.wait(lock);
+  }
+
+  r->queue[(r->head + r->count) % RENDER_QUEUE] = item;
+  r->count++;
+  uint64_t seq = ++r->submitted;
+
+  lock.unlock();
+  r->wake.notify_one();
+  return seq;
+}
+
+static void waitFor(Renderer* r, uint64_t seq)
+{
+  std::unique_lock<std::mutex> lock(r->mutex);
+  while (r->completed < seq)
+  {
+    r->done.wait(lock);
+  }
+}
+
+struct Replay
+{
+  Renderer* r;
+  const CommandList* list;
+  size_t cursor;
+};
+
+// Runs commands until the list ends or one raises an error, the cursor is
+// moved past a command before it runs so a failing one is skipped.
+static int replayCommands(lua_State* R)
+{
+  Replay* replay = (Replay*)lua_touserdata(R, 1);
+  lua_rawgeti(R, LUA_REGISTRYINDEX, replay->r->functions);
+  int functions = lua_gettop(R);
+
+  size_t end = replay->list->data.size();
+  while (replay->cursor < end)
+  {
+    uint16_t function = 0;
+    int nargs = 0;
+    replay->cursor = cmdlistDecode(R, replay->list, replay->cursor, &function, &nargs);
+
+    lua_rawgeti(R, functions, function + 1);
+    lua_insert(R, -(nargs + 1));
+    lua_call(R, nargs, 0);
+  }
+
+  return 0;
+}
+
+static void replayList(Renderer* r, const CommandList* list)
+{
+  Replay replay = { r, list, 0 };
+  while (replay.cursor < list->data.size())
+  {
+    lua_pushcfunction(r->replay, replayCommands);
+    lua_pushlightuserdata(r->replay, &replay);
+    if (lua_pcall(r->replay, 1, 0, 0) != 0)
+    {
+      fprintf(stderr, "render thread: %s\n", lua_tostring(r->replay, -1));
+      lua_pop(r->replay, 1);
+    }
+  }
+}
+
+static void execute(Renderer* r, const RenderItem& item)
+{
+  switch (item.type)
+  {
+  case ITEM_LIST:
+    replayList(r, item.list);
+    break;
+  case ITEM_FRAME:
+    replayList(r, item.list);
+    if (!r->headless)
+    {
+      SDL_GL_SwapBuffers();
+    }
+    //SDL 1.2 wants events pumped on the thread that set the video mode, the
+    //main thread only peeks the queue
+    SDL_PumpEvents();
+    break;
+  case ITEM_CALL:
+    //the main thread is blocked in syncCall so its state is ours for now.
+    //Lua errors are C++ exceptions in this build, carry them back to be
+    //rethrown where the script can catch them.
+    try
+    {
+      lua_call(item.L, item.nargs, LUA_MULTRET);
+    }
+    catch (...)
+    {
+      r->error = std::current_exception();
+    }
+    break;
+  case ITEM_QUIT:
+    break;
+  }
+}
+
+static void renderThread(Renderer* r)
+{
+  for (;;)
+  {
+    uint64_t start = timerNow();
+
+    RenderItem item;
+    {
+      std::unique_lock<std::mutex> lock(r->mutex);
+      while (r->count == 0)
+      {
+        r->wake.wait(lock);
+      }
+      item = r->queue[r->head];
+    }
+
+    uint64_t begin = timerNow();
+    execute(r, item);
+    uint64_t end = timerNow();
+
+    {
+      std::lock_guard<std::mutex> lock(r->mutex);
+      r->head = (r->head + 1) % RENDER_QUEUE;
+      r->count--;
+      r->completed++;
+      r->idle += begin - start;
+      r->busy += end - begin;
+    }
+    r->done.notify_all();
+
+    if (item.type == ITEM_QUIT)
+    {
+      return;
+    }
+  }
+}
+
+static Renderer* toRenderer(lua_State* L)
+{
+  return (Renderer*)lua_touserdata(L, lua_upvalueindex(1));
+}
+
+static int deferredCall(lua_State* L)
+{
+  Renderer* r = toRenderer(L);
+  cmdlistRecord(L, &r->lists[r->current], (uint16_t)lua_tointeger(L, lua_upvalueindex(2)), 1);
+  return 0;
+}
+
+static int syncCall(lua_State* L)
+{
+  Renderer* r = toRenderer(L);
+  uint64_t start = timerNow();
+
+  int nargs = lua_gettop(L);
+  lua_pushvalue(L, lua_upvalueindex(2));
+  lua_insert(L, 1);
+
+  //anything recorded so far has to reach GL before this call
+  CommandList* list = &r->lists[r->current];
+  if (list->commands > 0)
+  {
+    RenderItem flush = { ITEM_LIST, list, NULL, 0 };
+    submit(r, flush);
+    r->stats.flushes++;
+    r->stats.commands += list->commands;
+    r->stats.bytes += list->data.size();
+  }
+
+  RenderItem call = { ITEM_CALL, NULL, L, nargs };
+  waitFor(r, submit(r, call));
+  cmdlistReset(list);
+
+  r->stats.syncCalls++;
+  r->stats.syncWait += timerNow() - start;
+
+  if (r->error)
+  {
+    std::exception_ptr error = r->error;
+    r->error = nullptr;
+    std::rethrow_exception(error);
+  }
+
+  return lua_gettop(L);
+}
+
+static void wrapSync(lua_State* L, Renderer* r, int table, const char* name)
+{
+  lua_pushlightuserdata(L, r);
+  lua_getfield(L, table, name);
+  lua_pushcclosure(L, syncCall, 2);
+  lua_setfield(L, table, name);
+}
+
+Renderer* renderStart(lua_State* L, bool headless)
+{
+  Renderer* r = new Renderer();
+  r->headless = headless;
+  cmdlistInit(&r->lists[0], 64 * 1024);
+  cmdlistInit(&r->lists[1], 64 * 1024);
+
+  r->replay = luaL_newstate();
+  luaL_opengl(r->replay);
+  //deferred deletes run here, the mappings are made through L
+  luaL_opengl_sharemapped(r->replay, L);
+  lua_getglobal(r->replay, "gl");
+  lua_newtable(r->replay);
+
+  //deferred functions become indices into the replay state's function
+  //table, the rest run on the render thread as they are
+  lua_getglobal(L, "gl");
+  int gl = lua_gettop(L);
+  int count = 0;
+
+  lua_pushnil(L);
+  while (lua_next(L, gl))
+  {
+    if (lua_iscfunction(L, -1) && lua_type(L, -2) == LUA_TSTRING
+      && !luaL_opengl_islocal(lua_tostring(L, -2)))
+    {
+      const char* name = lua_tostring(L, -2);
+      if (deferrable(name))
+      {
+        lua_getfield(r->replay, -2, name);
+        lua_rawseti(r->replay, -2, ++count);
+
+        lua_pushvalue(L, -2);
+        lua_pushlightuserdata(L, r);
+        lua_pushinteger(L, count - 1);
+        lua_pushcclosure(L, deferredCall, 2);
+        lua_rawset(L, gl);
+      }
+      else
+      {
+        wrapSync(L, r, gl, name);
+      }
+    }
+    lua_pop(L, 1);
+  }
+  lua_pop(L, 1);
+
+  r->functions = luaL_ref(r->replay, LUA_REGISTRYINDEX);
+  lua_pop(r->replay, 1);
+
+  lua_pushglobaltable(L);
+  wrapSync(L, r, lua_gettop(L), "CreateWindow");
+  lua_pop(L, 1);
+
+  r->thread = std::thread(renderThread, r);
+  return r;
+}
+
+void renderFrame(Renderer* r)
+{
+  CommandList* list = &r->lists[r->current];
+  r->stats.commands += list->commands;
+  r->stats.bytes += list->data.size();
+
+  //one frame in flight, which also frees the other list for recording
+  uint64_t start = timerNow();
+  waitFor(r, r->lastFrame);
+  r->stats.frameWait += timerNow() - start;
+
+  RenderItem frame = { ITEM_FRAME, list, NULL, 0 };
+  r->lastFrame = submit(r, frame);
+  r->stats.frames++;
+
+  r->current ^= 1;
+  cmdlistReset(&r->lists[r->current]);
+}
+
+void renderStop(Renderer* r)
+{
+  RenderItem quit = { ITEM_QUIT, NULL, NULL, 0 };
+  submit(r, quit);
+  r->thread.join();
+
+  lua_close(r->replay);
+  delete r;
+}
+
+RenderStats renderStats(Renderer* r)
+{
+  RenderStats stats = r->stats;
+  std::lock_guard<std::mutex> lock(r->mutex);
+  stats.busy = r->busy;
+  stats.idle = r->idle;
+  return stats;
+}
+
+int renderPushStats(lua_State* L, void* ud)
+{
+  RenderStats stats = renderStats((Renderer*)ud);
+  double frames = stats.frames ? (double)stats.frames : 1.0;
+
+  lua_createtable(L, 0, 8);
+  lua_pushinteger(L, stats.frames);
+  lua_setfield(L, -2, "frames");
+  lua_pushnumber(L, stats.commands / frames);
+  lua_setfield(L, -2, "commands");
+  lua_pushnumber(L, stats.bytes / frames);
+  lua_setfield(L, -2, "bytes");
+  lua_pushnumber(L, stats.syncCalls / frames);
+  lua_setfield(L, -2, "syncCalls");
+  lua_pushnumber(L, stats.frameWait * 1e-6 / frames);
+  lua_setfield(L, -2, "frameWait");
+  lua_pushnumber(L, stats.syncWait * 1e-6 / frames);
+  lua_setfield(L, -2, "syncWait");
+  lua_pushnumber(L, stats.busy * 1e-6 / frames);
+  lua_setfield(L, -2, "busy");
+  lua_pushnumber(L, stats.idle * 1e-6 / frames);
+  lua_setfield(L, -2, "idle");
+  return 1;
+}
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef __RENDER_H__
+#define __RENDER_H__
+
+#include <stdint.h>
+#include "lua/src/lua.h"
+
+// Render thread. Lua keeps running on the main thread while GL is only
+// touched by the render thread:
+//
+// - gl functions that return nothing (binds, uniforms, draws, state...) are
+//   recorded into one of two command lists. While the main thread records
+//   frame N+1 the render thread replays frame N and swaps.
+// - every other gl function, and CreateWindow, runs on the render thread
+//   while the main thread waits. Commands recorded before it are flushed
+//   first so GL sees calls in script order.
+//
+// Not available under emscripten, renderStart returns false there.
+
+struct RenderStats
+{
+  uint64_t frames;
+  uint64_t commands;   // recorded calls
+  uint64_t bytes;      // recorded bytes
+  uint64_t syncCalls;  // calls the main thread had to wait for
+  uint64_t flushes;    // partial command lists sent ahead of a sync call
+  uint64_t frameWait;  // ns the main thread waited for the previous frame
+  uint64_t syncWait;   // ns the main thread waited on sync calls
+  uint64_t busy;       // ns the render thread spent replaying and swapping
+  uint64_t idle;       // ns the render thread spent waiting for work
+};
+
+struct Renderer;
+
+// Moves GL for L onto a new render thread, rewrapping the gl table and
+// CreateWindow. headless skips the swap, GL is stubbed by glnullInstall.
+Renderer* renderStart(lua_State* L, bool headless);
+
+// Ends the frame being recorded: waits for the previous frame to finish,
+// hands this one to the render thread and starts recording the next.
+void renderFrame(Renderer* r);
+
+// Drains outstanding work and joins the render thread.
+void renderStop(Renderer* r);
+
+// Snapshot of the counters, safe to call while the render thread runs.
+RenderStats renderStats(Renderer* r);
+
+// engine.stats.render, see profilerAddSource
+int renderPushStats(lua_State* L, void* ud);
+
+#endif
@@ -0,0 +1,346 @@
+#include "scriptcache.h"
+#include "timer.h"
+#include "lua/src/lauxlib.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+static const char magic[8] = {'L', 'U', 'A', 'C', 'A', 'C', 'H', 'E'};
+#define SCRIPTCACHE_VERSION 1
+
+struct EntryHeader
+{
+  uint64_t sourceHash;
+  uint64_t sourceSize;
+  uint64_t chunkHash;
+  uint32_t nameLength;
+  uint32_t chunkSize;
+};
+
+// FNV-1a's step taken a word at a time, with the high half folded back
+// down so every bit of the word reaches the low bits. Byte at a time it
+// was most of the cost of a cached load.
+static uint64_t hash(const char* data, size_t size)
+{
+  const uint64_t prime = 1099511628211ull;
+  uint64_t h = 14695981039346656037ull;
+  size_t i = 0;
+  for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t))
+  {
+    uint64_t word;
+    memcpy(&word, data + i, sizeof(uint64_t));
+    h = (h ^ word) * prime;
+    h ^= h >> 32;
+  }
+  for (; i < size; ++i)
+  {
+    h = (h ^ (uint8_t)data[i]) * prime;
+  }
+  return h;
+}
+
+static bool readFile(const char* path, std::vector<char>* data)
+{
+  FILE* file = fopen(path, "rb");
+  if (file == NULL)
+  {
+    return false;
+  }
+
+  fseek(file, 0, SEEK_END);
+  long size = ftell(file);
+  rewind(file);
+  bool read = size >= 0;
+  if (read)
+  {
+    data->resize((size_t)size);
+    read = fread(data->data(), 1, data->size(), file) == data->size();
+  }
+  fclose(file);
+  return read;
+}
+
+template <typename T>
+static void append(std::vector<char>* data, T value)
+{
+  const char* bytes = (const char*)&value;
+  data->insert(data->end(), bytes, bytes + sizeof(T));
+}
+
+template <typename T>
+static bool read(const std::vector<char>& data, size_t* cursor, T* value)
+{
+  if (data.size() - *cursor < sizeof(T))
+  {
+    return false;
+  }
+  memcpy(value, &data[*cursor], sizeof(T));
+  *cursor += sizeof(T);
+  return true;
+}
+
+static std::string entryPath(const ScriptCache* c, const char* chunkname)
+{
+  char name[32];
+  snprintf(name, sizeof(name), "/%016llx.luac",
+    (unsigned long long)hash(chunkname, strlen(chunkname)));
+  return c->dir + name;
+}
+
+// Finds the chunk in an entry if it was compiled from this source.
+static bool parse(const std::vector<char>& entry, const char* chunkname,
+  uint64_t sourceHash, size_t sourceSize, const char** chunk, size_t* chunkSize)
+{
+  size_t cursor = sizeof(magic);
+  uint16_t version = 0;
+  EntryHeader header;
+  if (entry.size() < sizeof(magic) || memcmp(entry.data(), magic, sizeof(magic)) != 0
+    || !read(entry, &cursor, &version) || version != SCRIPTCACHE_VERSION
+    || !read(entry, &cursor, &header.sourceHash) || !read(entry, &cursor, &header.sourceSize)
+    || !read(entry, &cursor, &header.chunkHash) || !read(entry, &cursor, &header.nameLength)
+    || !read(entry, &cursor, &header.chunkSize))
+  {
+    return false;
+  }
+
+  size_t nameLength = strlen(chunkname);
+  if (header.sourceHash != sourceHash || header.sourceSize != sourceSize
+    || header.nameLength != nameLength
+    || entry.size() - cursor != (size_t)header.nameLength + header.chunkSize
+    || memcmp(&entry[cursor], chunkname, nameLength) != 0)
+  {
+    return false;
+  }
+  cursor += nameLength;
+
+  //a damaged chunk could crash the undump, it isn't verified
+  if (hash(&entry[cursor], header.chunkSize) != header.chunkHash)
+  {
+    return false;
+  }
+  *chunk = &entry[cursor];
+  *chunkSize = header.chunkSize;
+  return true;
+}
+
+static int writer(lua_State* L, const void* p, size_t size, void* ud)
+{
+  std::vector<char>* chunk = (std::vector<char>*)ud;
+  chunk->insert(chunk->end(), (const char*)p, (const char*)p + size);
+  return 0;
+}
+
+// Dumps the function on top of the stack into the entry at path.
+static bool store(lua_State* L, const std::string& path, const char* chunkname,
+  uint64_t sourceHash, size_t sourceSize)
+{
+  std::vector<char> chunk;
+  if (lua_dump(L, writer, &chunk, 0) != 0 || chunk.size() > UINT32_MAX)
+  {
+    return false;
+  }
+
+  std::vector<char> entry(magic, magic + sizeof(magic));
+  size_t nameLength = strlen(chunkname);
+  entry.reserve(64 + nameLength + chunk.size());
+  append<uint16_t>(&entry, SCRIPTCACHE_VERSION);
+  append<uint64_t>(&entry, sourceHash);
+  append<uint64_t>(&entry, sourceSize);
+  append<uint64_t>(&entry, hash(chunk.data(), chunk.size()));
+  append<uint32_t>(&entry, (uint32_t)nameLength);
+  append<uint32_t>(&entry, (uint32_t)chunk.size());
+  entry.insert(entry.end(), chunkname, chunkname + nameLength);
+  entry.insert(entry.end(), chunk.begin(), chunk.end());
+
+  //per process, so two engines sharing the directory don't write the same
+  //temporary file
+  char suffix[32];
+  snprintf(suffix, sizeof(suffix), ".%ld.tmp", (long)getpid());
+  std::string temporary = path + suffix;
+  FILE* file = fopen(temporary.c_str(), "wb");
+  if (file == NULL)
+  {
+    return false;
+  }
+  bool written = fwrite(entry.data(), 1, entry.size(), file) == entry.size();
+  written = fclose(file) == 0 && written;
+  if (!written || rename(temporary.c_str(), path.c_str()) != 0)
+  {
+    remove(temporary.c_str());
+    return false;
+  }
+  return true;
+}
+
+void scriptCacheInit(ScriptCache* c, const char* dir)
+{
+  c->dir.clear();
+  memset(&c->stats, 0, sizeof(ScriptCacheStats));
+  if (dir == NULL)
+  {
+    return;
+  }
+
+  if (mkdir(dir, 0755) != 0 && errno != EEXIST)
+  {
+    fprintf(stderr, "Unable to create script cache %s, scripts are compiled every run\n", dir);
+    return;
+  }
+  c->dir = dir;
+}
+
+// Where the chunk starts, past a UTF-8 BOM and a first line starting with
+// '#', which luaL_loadfile skips too. The line's newline is kept so line
+// numbers don't change.
+static size_t skipPrefix(const std::vector<char>& source)
+{
+  size_t at = 0;
+  if (source.size() >= 3 && memcmp(source.data(), "\xEF\xBB\xBF", 3) == 0)
+  {
+    at = 3;
+  }
+  if (at < source.size() && source[at] == '#')
+  {
+    while (at < source.size() && source[at] != '\n')
+    {
+      at++;
+    }
+    //a binary chunk has no lines to keep
+    if (at + 1 < source.size() && source[at + 1] == LUA_SIGNATURE[0])
+    {
+      at++;
+    }
+  }
+  return at;
+}
+
+int scriptCacheLoad(ScriptCache* c, lua_State* L, const char* path, const char* chunkname)
+{
+  uint64_t start = timerNow();
+  std::vector<char> source;
+  if (!readFile(path, &source))
+  {
+    lua_pushfstring(L, "cannot open %s: %s", path, strerror(errno));
+    return LUA_ERRFILE;
+  }
+  c->stats.loads++;
+  c->stats.bytes += source.size();
+  size_t skipped = skipPrefix(source);
+  const char* text = source.data() + skipped;
+  size_t size = source.size() - skipped;
+
+  //chunks that are already compiled load as they are
+  bool binary = size > 0 && text[0] == LUA_SIGNATURE[0];
+  if (c->dir.empty() || binary)
+  {
+    int status = luaL_loadbuffer(L, text, size, chunkname);
+    c->stats.time += timerNow() - start;
+    return status;
+  }
+
+  uint64_t sourceHash = hash(text, size);
+  std::string entry = entryPath(c, chunkname);
+  std::vector<char> cached;
+  if (readFile(entry.c_str(), &cached))
+  {
+    const char* chunk = NULL;
+    size_t chunkSize = 0;
+    if (parse(cached, chunkname, sourceHash, size, &chunk, &chunkSize))
+    {
+      if (luaL_loadbufferx(L, chunk, chunkSize, chunkname, "b") == LUA_OK)
+      {
+        c->stats.hits++;
+        c->stats.time += timerNow() - start;
+        return LUA_OK;
+      }
+      lua_pop(L, 1);
+    }
+    c->stats.stale++;
+  }
+
+  int status = luaL_loadbufferx(L, text, size, chunkname, "t");
+  if (status == LUA_OK)
+  {
+    if (store(L, entry, chunkname, sourceHash, size))
+    {
+      c->stats.stored++;
+    }
+    else
+    {
+      c->stats.failed++;
+    }
+  }
+  c->stats.time += timerNow() - start;
+  return status;
+}
+
+static int dofileContinue(lua_State* L, int status, lua_KContext context)
+{
+  return lua_gettop(L) - 1;
+}
+
+// dofile([path]), reading stdin is left to the original
+static int dofile(lua_State* L)
+{
+  ScriptCache* c = (ScriptCache*)lua_touserdata(L, lua_upvalueindex(1));
+  const char* path = luaL_optstring(L, 1, NULL);
+  if (path == NULL)
+  {
+    lua_pushvalue(L, lua_upvalueindex(2));
+    lua_insert(L, 1);
+    lua_call(L, lua_gettop(L) - 1, LUA_MULTRET);
+    return lua_gettop(L);
+  }
+
+  lua_settop(L, 1);
+  lua_pushfstring(L, "@%s", path);
+  int status = scriptCacheLoad(c, L, path, lua_tostring(L, -1));
+  lua_remove(L, -2);
+  if (status != LUA_OK)
+  {
+    return lua_error(L);
+  }
+  lua_callk(L, 0, LUA_MULTRET, 0, dofileContinue);
+  return dofileContinue(L, 0, 0);
+}
+
+void scriptCacheRegister(lua_State* L, ScriptCache* c)
+{
+  lua_getglobal(L, "dofile");
+  if (lua_isnil(L, -1))
+  {
+    lua_pop(L, 1);
+    return;
+  }
+  lua_pushlightuserdata(L, c);
+  lua_insert(L, -2);
+  lua_pushcclosure(L, dofile, 2);
+  lua_setglobal(L, "dofile");
+}
+
+int scriptCachePushStats(lua_State* L, void* ud)
+{
+  ScriptCache* c = (ScriptCache*)ud;
+  lua_createtable(L, 0, 8);
+  lua_pushboolean(L, !c->dir.empty());
+  lua_setfield(L, -2, "enabled");
+  lua_pushinteger(L, (lua_Integer)c->stats.loads);
+  lua_setfield(L, -2, "loads");
+  lua_pushinteger(L, (lua_Integer)c->stats.hits);
+  lua_setfield(L, -2, "hits");
+  lua_pushinteger(L, (lua_Integer)c->stats.stale);
+  lua_setfield(L, -2, "stale");
+  lua_pushinteger(L, (lua_Integer)c->stats.stored);
+  lua_setfield(L, -2, "stored");
+  lua_pushinteger(L, (lua_Integer)c->stats.failed);
+  lua_setfield(L, -2, "failed");
+  lua_pushinteger(L, (lua_Integer)c->stats.bytes);
+  lua_setfield(L, -2, "bytes");
+  lua_pushnumber(L, c->stats.time * 1e-6);
+  lua_setfield(L, -2, "ms");
+  return 1;
+}
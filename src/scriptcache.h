@@ -0,0 +1,63 @@
+#ifndef __SCRIPTCACHE_H__
+#define __SCRIPTCACHE_H__
+
+#include <stdint.h>
+#include <string>
+#include "lua/src/lua.h"
+
+// Compiled script cache. Loading a script still reads its source, but
+// rather than lexing and parsing it the chunk lua_dump wrote the last time
+// that source was compiled is read back through lundump. Debug information
+// is kept so errors and tracebacks are the same either way.
+//
+// There is one entry per chunk name, a file in the cache directory named
+// by the chunk name's hash. It holds the hash and size of the source it
+// was compiled from and only loads when both match the source being
+// loaded, so editing a script invalidates its entry without anything
+// having to notice the edit; the script is compiled from source and the
+// entry rewritten. An entry that doesn't undump, written by a build with a
+// different Lua version or number types for example, is rewritten too.
+// Entries are written to a temporary file and renamed into place, so a
+// reader never sees half of one, and carry a hash of the chunk, as lundump
+// doesn't check the bytecode it loads.
+//
+// Entry layout, little endian, hashes are FNV-1a over 64 bit words:
+//
+//   "LUACACHE" uint16 version, uint64 source hash, uint64 source size,
+//   uint64 chunk hash, uint32 name length, uint32 chunk size, name, chunk
+
+struct ScriptCacheStats
+{
+  uint64_t loads;
+  uint64_t hits;
+  uint64_t stale;   // entries that didn't match their source
+  uint64_t stored;
+  uint64_t failed;  // entries that couldn't be written
+  uint64_t bytes;   // source read
+  uint64_t time;    // ns spent loading
+};
+
+struct ScriptCache
+{
+  std::string dir;  // empty when disabled
+  ScriptCacheStats stats;
+};
+
+// Uses dir for the entries, creating it if it doesn't exist. NULL disables
+// the cache and every script is compiled from source.
+void scriptCacheInit(ScriptCache* c, const char* dir);
+
+// Loads the script at path as luaL_loadfile would, skipping a UTF-8 BOM
+// and a first line starting with '#', but named chunkname and through the
+// cache. Pushes the chunk or an error message and returns the status,
+// LUA_ERRFILE when path can't be read.
+int scriptCacheLoad(ScriptCache* c, lua_State* L, const char* path, const char* chunkname);
+
+// Replaces the base library's dofile with one that loads through the
+// cache, if the base library is open.
+void scriptCacheRegister(lua_State* L, ScriptCache* c);
+
+// Stats source for engine.stats.scripts, ud is the ScriptCache.
+int scriptCachePushStats(lua_State* L, void* ud);
+
+#endif
@@ -0,0 +1,45 @@
+#include "startup.h"
+#include "timer.h"
+
+#include <stdio.h>
+
+void startupInit(Startup* s, const MemoryStats* memory)
+{
+  s->count = 0;
+  s->begin = timerNow();
+  s->last = s->begin;
+  s->memory = memory;
+  s->lastMemory = *memory;
+}
+
+void startupMark(Startup* s, const char* name)
+{
+  uint64_t now = timerNow();
+  if (s->count < STARTUP_STAGES)
+  {
+    StartupStage* stage = &s->stages[s->count++];
+    stage->name = name;
+    stage->time = now - s->last;
+    stage->allocs = s->memory->allocs - s->lastMemory.allocs;
+    stage->bytes = s->memory->allocated - s->lastMemory.allocated;
+  }
+  s->last = now;
+  s->lastMemory = *s->memory;
+}
+
+uint64_t startupElapsed(const Startup* s)
+{
+  return s->last - s->begin;
+}
+
+void startupReport(const Startup* s)
+{
+  fprintf(stdout, "startup       %.2f ms to the end of the first frame\n",
+    startupElapsed(s) * 1e-6);
+  for (int i = 0; i < s->count; ++i)
+  {
+    const StartupStage* stage = &s->stages[i];
+    fprintf(stdout, "  %-14s %8.3f ms %7llu allocs %9.1f KB\n", stage->name, stage->time * 1e-6,
+      (unsigned long long)stage->allocs, stage->bytes / 1024.0);
+  }
+}
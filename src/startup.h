@@ -0,0 +1,40 @@
+#ifndef __STARTUP_H__
+#define __STARTUP_H__
+
+#include <stdint.h>
+#include "memory.h"
+
+#define STARTUP_STAGES 16
+
+// Time and Lua allocations of each step of engine boot, up to the end of
+// the first frame.
+struct StartupStage
+{
+  const char* name;
+  uint64_t time;     // ns
+  uint64_t allocs;
+  uint64_t bytes;
+};
+
+struct Startup
+{
+  StartupStage stages[STARTUP_STAGES];
+  int count;
+  uint64_t begin;
+  uint64_t last;
+  const MemoryStats* memory;
+  MemoryStats lastMemory;
+};
+
+// Starts the clock, memory is the Lua allocator's counters.
+void startupInit(Startup* s, const MemoryStats* memory);
+
+// Closes the stage that ran since the previous mark (or init).
+void startupMark(Startup* s, const char* name);
+
+// Total so far, ns.
+uint64_t startupElapsed(const Startup* s);
+
+void startupReport(const Startup* s);
+
+#endif
@@ -0,0 +1,437 @@
+#include "stream.h"
+#include "buffer.h"
+#include "glstate.h"
+#include "timer.h"
+#include "lua/src/lauxlib.h"
+
+#if EMSCRIPTEN
+
+#else
+#define USE_GLEW 1
+#endif
+
+#include "SDL/SDL.h"
+
+#if USE_GLEW
+#include "GL/glew.h"
+#else
+#include "SDL/SDL_opengl.h"
+#endif
+
+#include <deque>
+#include <stdlib.h>
+#include <vector>
+
+// Positions count bytes over the stream's whole life, so "laps" of the ring
+// never compare equal. Where a position is in the buffer is the remainder by
+// the size.
+
+struct StreamFence
+{
+  uint64_t begin;
+  uint64_t end;
+#if USE_GLEW
+  GLsync sync;
+#endif
+};
+
+struct StreamBuffer
+{
+  StreamMode mode;
+  GLuint name;
+  size_t size;
+  uint8_t* memory;  // the mapping, or system memory
+  void* block;      // system memory as allocated
+  uint64_t head;    // next free position
+  uint64_t frame;   // first position allocated this frame
+  uint64_t dirty;   // first position not yet committed
+  uint64_t lap;     // lap the GL store holds, for orphaning
+  std::deque<StreamFence> fences;
+  std::vector<Buffer*> views;  // handed to Lua since the last commit
+  StreamStats stats;
+};
+
+// Every live stream, for streamFrame. Main thread only.
+static std::vector<StreamBuffer*> streams;
+
+static void allocateStore(StreamBuffer* s)
+{
+  glGenBuffers(1, &s->name);
+  glstateBindBuffer(GL_COPY_WRITE_BUFFER, s->name);
+  glBufferData(GL_COPY_WRITE_BUFFER, s->size, NULL, GL_STREAM_DRAW);
+}
+
+StreamBuffer* streamCreate(size_t size, StreamMode mode)
+{
+  StreamBuffer* s = new StreamBuffer();
+  s->mode = mode;
+  s->size = size;
+
+  //bound to the copy target so the script's bindings are left alone
+#if USE_GLEW
+  if (mode == STREAM_PERSISTENT && (GLEW_ARB_buffer_storage || GLEW_VERSION_4_4))
+  {
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glGenBuffers(1, &s->name);
+    glstateBindBuffer(GL_COPY_WRITE_BUFFER, s->name);
+    glBufferStorage(GL_COPY_WRITE_BUFFER, size, NULL, flags);
+    s->memory = (uint8_t*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, size, flags);
+    if (s->memory == NULL)
+    {
+      //the store is immutable now, start over with a plain one
+      glDeleteBuffers(1, &s->name);
+      glstateForgetBuffers(1, &s->name);
+      s->name = 0;
+    }
+  }
+#endif
+
+  if (s->memory == NULL)
+  {
+    if (s->mode == STREAM_PERSISTENT)
+    {
+      s->mode = STREAM_ORPHAN;
+    }
+    if (s->mode == STREAM_ORPHAN)
+    {
+      allocateStore(s);
+    }
+    s->block = malloc(size + BUFFER_ALIGNMENT);
+    uintptr_t address = (uintptr_t)s->block;
+    s->memory = (uint8_t*)((address + BUFFER_ALIGNMENT - 1) & ~(uintptr_t)(BUFFER_ALIGNMENT - 1));
+  }
+
+  streams.push_back(s);
+  return s;
+}
+
+static void expireViews(StreamBuffer* s)
+{
+  for (Buffer* view : s->views)
+  {
+    bufferExpire(view);
+    bufferRelease(view);
+  }
+  s->views.clear();
+}
+
+void streamDestroy(StreamBuffer* s)
+{
+  for (size_t i = 0; i < streams.size(); ++i)
+  {
+    if (streams[i] == s)
+    {
+      streams.erase(streams.begin() + i);
+      break;
+    }
+  }
+
+  expireViews(s);
+#if USE_GLEW
+  for (const StreamFence& fence : s->fences)
+  {
+    glDeleteSync(fence.sync);
+  }
+#endif
+  if (s->mode != STREAM_NULL)
+  {
+    //deleting a buffer unmaps it
+    glDeleteBuffers(1, &s->name);
+    glstateForgetBuffers(1, &s->name);
+  }
+  free(s->block);
+  delete s;
+}
+
+#if USE_GLEW
+static void waitFence(StreamBuffer* s, const StreamFence& fence)
+{
+  GLenum result = glClientWaitSync(fence.sync, 0, 0);
+  if (result == GL_TIMEOUT_EXPIRED)
+  {
+    uint64_t start = timerNow();
+    do
+    {
+      result = glClientWaitSync(fence.sync, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+    } while (result == GL_TIMEOUT_EXPIRED);
+    s->stats.waits++;
+    s->stats.waited += timerNow() - start;
+  }
+  glDeleteSync(fence.sync);
+}
+#endif
+
+// Fences the draws issued so far against what this frame allocated
+static void fence(StreamBuffer* s)
+{
+#if USE_GLEW
+  if (s->mode == STREAM_PERSISTENT && s->head != s->frame)
+  {
+    StreamFence fence = { s->frame, s->head, glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0) };
+    s->fences.push_back(fence);
+  }
+#endif
+  s->frame = s->head;
+}
+
+static void upload(StreamBuffer* s)
+{
+  if (s->mode != STREAM_ORPHAN || s->dirty == s->head)
+  {
+    return;
+  }
+
+  size_t at = (size_t)(s->dirty % s->size);
+  glstateBindBuffer(GL_COPY_WRITE_BUFFER, s->name);
+  glBufferSubData(GL_COPY_WRITE_BUFFER, at, (GLsizeiptr)(s->head - s->dirty), s->memory + at);
+  s->stats.uploads++;
+  s->dirty = s->head;
+}
+
+// Called before writing positions below reuse into the ring again. A frame
+// that laps itself fences its own draws first, anything it allocated before
+// the wrap has to have been drawn by then.
+static void reclaim(StreamBuffer* s, uint64_t reuse, uint64_t lap)
+{
+  if (s->mode == STREAM_PERSISTENT)
+  {
+#if USE_GLEW
+    if (reuse > s->frame)
+    {
+      fence(s);
+    }
+    while (!s->fences.empty() && s->fences.front().begin < reuse)
+    {
+      waitFence(s, s->fences.front());
+      s->fences.pop_front();
+    }
+#endif
+  }
+  else if (s->mode == STREAM_ORPHAN && lap != s->lap)
+  {
+    //draws already issued keep the old store, the driver hands us a new one
+    upload(s);
+    glstateBindBuffer(GL_COPY_WRITE_BUFFER, s->name);
+    glBufferData(GL_COPY_WRITE_BUFFER, s->size, NULL, GL_STREAM_DRAW);
+    s->stats.orphans++;
+  }
+  s->lap = lap;
+}
+
+void* streamAlloc(StreamBuffer* s, size_t size, size_t align, size_t* offset)
+{
+  if (size > s->size)
+  {
+    return NULL;
+  }
+
+  size_t at = (size_t)(s->head % s->size);
+  size_t aligned = (at + align - 1) & ~(align - 1);
+  uint64_t position = s->head - at;
+  if (aligned + size > s->size)
+  {
+    position += s->size;
+    aligned = 0;
+  }
+  position += aligned;
+
+  if (position + size > s->size)
+  {
+    reclaim(s, position + size - s->size, position / s->size);
+  }
+
+  if (s->dirty == s->head)
+  {
+    s->dirty = position;
+  }
+  s->head = position + size;
+  s->stats.bytes += size;
+  *offset = aligned;
+  return s->memory + aligned;
+}
+
+void streamCommit(StreamBuffer* s)
+{
+  upload(s);
+  s->dirty = s->head;
+  expireViews(s);
+}
+
+unsigned streamName(StreamBuffer* s)
+{
+  return s->name;
+}
+
+StreamMode streamMode(StreamBuffer* s)
+{
+  return s->mode;
+}
+
+static const char* modeNames[] = {"persistent", "orphan", "null", "none", NULL};
+
+const char* streamModeName(StreamMode mode)
+{
+  return modeNames[mode];
+}
+
+StreamStats streamStats(StreamBuffer* s)
+{
+  return s->stats;
+}
+
+void streamFrame()
+{
+  for (StreamBuffer* s : streams)
+  {
+    streamCommit(s);
+    fence(s);
+    //without fences the next frame starts on a fresh store
+    if (s->mode == STREAM_ORPHAN && s->head > s->lap * s->size)
+    {
+      s->head = (s->lap + 1) * s->size;
+      s->dirty = s->head;
+      s->frame = s->head;
+    }
+    s->stats.frames++;
+  }
+}
+
+// Lua side, a userdata holding the StreamBuffer*
+
+static const char* handleName = "engine.stream";
+
+static StreamBuffer* checkStream(lua_State* L, int index)
+{
+  StreamBuffer* s = *(StreamBuffer**)luaL_checkudata(L, index, handleName);
+  luaL_argcheck(L, s != NULL, index, "stream has been destroyed");
+  return s;
+}
+
+// stream:alloc(type, count [, align]) -> view, offset in bytes. align is a
+// power of two and defaults to the element size.
+static int streamLuaAlloc(lua_State* L)
+{
+  StreamBuffer* s = checkStream(L, 1);
+  BufferType type = bufferCheckType(L, 2, NULL);
+  lua_Integer count = luaL_checkinteger(L, 3);
+  lua_Integer align = luaL_optinteger(L, 4, (lua_Integer)bufferElementSize(type));
+  luaL_argcheck(L, count >= 0 && count <= 0x7fffffff, 3, "invalid count");
+  luaL_argcheck(L, align > 0 && (align & (align - 1)) == 0, 4, "not a power of two");
+
+  size_t offset = 0;
+  void* data = streamAlloc(s, (size_t)count * bufferElementSize(type), (size_t)align, &offset);
+  luaL_argcheck(L, data != NULL, 3, "larger than the stream");
+
+  Buffer* view = bufferCreateView(type, data, (size_t)count);
+  bufferRetain(view);
+  s->views.push_back(view);
+  bufferPush(L, view);
+  lua_pushinteger(L, (lua_Integer)offset);
+  return 2;
+}
+
+static int streamLuaCommit(lua_State* L)
+{
+  streamCommit(checkStream(L, 1));
+  return 0;
+}
+
+// stream:name() -> the GL buffer to bind
+static int streamLuaName(lua_State* L)
+{
+  lua_pushinteger(L, streamName(checkStream(L, 1)));
+  return 1;
+}
+
+static int streamLuaSize(lua_State* L)
+{
+  lua_pushinteger(L, (lua_Integer)checkStream(L, 1)->size);
+  return 1;
+}
+
+// stream:mode() -> "persistent", "orphan" or "null"
+static int streamLuaMode(lua_State* L)
+{
+  lua_pushstring(L, streamModeName(streamMode(checkStream(L, 1))));
+  return 1;
+}
+
+// stream:stats() -> totals, waited in milliseconds
+static int streamLuaStats(lua_State* L)
+{
+  StreamStats stats = streamStats(checkStream(L, 1));
+  lua_createtable(L, 0, 6);
+  lua_pushinteger(L, (lua_Integer)stats.frames);
+  lua_setfield(L, -2, "frames");
+  lua_pushinteger(L, (lua_Integer)stats.bytes);
+  lua_setfield(L, -2, "bytes");
+  lua_pushinteger(L, (lua_Integer)stats.waits);
+  lua_setfield(L, -2, "waits");
+  lua_pushnumber(L, stats.waited * 1e-6);
+  lua_setfield(L, -2, "waited");
+  lua_pushinteger(L, (lua_Integer)stats.orphans);
+  lua_setfield(L, -2, "orphans");
+  lua_pushinteger(L, (lua_Integer)stats.uploads);
+  lua_setfield(L, -2, "uploads");
+  return 1;
+}
+
+static int streamLuaGc(lua_State* L)
+{
+  StreamBuffer** ud = (StreamBuffer**)luaL_checkudata(L, 1, handleName);
+  if (*ud != NULL)
+  {
+    streamDestroy(*ud);
+    *ud = NULL;
+  }
+  return 0;
+}
+
+// gl.StreamBuffer(size [, "orphan"]), the mode is an upvalue
+static int streamLuaCreate(lua_State* L)
+{
+  StreamMode mode = (StreamMode)lua_tointeger(L, lua_upvalueindex(1));
+  if (mode == STREAM_NONE)
+  {
+    return luaL_error(L, "StreamBuffer needs GL on the main thread, run without --render-thread");
+  }
+
+  lua_Integer size = luaL_checkinteger(L, 1);
+  luaL_argcheck(L, size > 0 && size <= 0x7fffffff, 1, "invalid size");
+  if (mode == STREAM_PERSISTENT && luaL_checkoption(L, 2, "persistent", modeNames) == STREAM_ORPHAN)
+  {
+    mode = STREAM_ORPHAN;
+  }
+
+  StreamBuffer** ud = (StreamBuffer**)lua_newuserdata(L, sizeof(StreamBuffer*));
+  *ud = NULL;
+  luaL_setmetatable(L, handleName);
+  *ud = streamCreate((size_t)size, mode);
+  return 1;
+}
+
+void streamRegister(lua_State* L, StreamMode mode)
+{
+  static const luaL_Reg methods[] = {
+    {"alloc", streamLuaAlloc},
+    {"commit", streamLuaCommit},
+    {"name", streamLuaName},
+    {"size", streamLuaSize},
+    {"mode", streamLuaMode},
+    {"stats", streamLuaStats},
+    {"__gc", streamLuaGc},
+    {NULL, NULL}
+  };
+
+  luaL_newmetatable(L, handleName);
+  luaL_setfuncs(L, methods, 0);
+  lua_pushvalue(L, -1);
+  lua_setfield(L, -2, "__index");
+  lua_pop(L, 1);
+
+  lua_getglobal(L, "gl");
+  lua_pushinteger(L, mode);
+  lua_pushcclosure(L, streamLuaCreate, 1);
+  lua_setfield(L, -2, "StreamBuffer");
+  lua_pop(L, 1);
+}
@@ -0,0 +1,69 @@
+#ifndef __STREAM_H__
+#define __STREAM_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include "lua/src/lua.h"
+
+// Streaming buffers for data rewritten every frame, like dynamic geometry or
+// per draw uniforms. One large GL buffer is used as a ring: an allocation
+// hands out memory to write into and the byte offset to draw from, and each
+// frame's allocations are fenced once its draws are issued. Allocating only
+// waits when the ring laps a frame the GPU hasn't finished with.
+//
+//   local stream = gl.StreamBuffer(4 * 1024 * 1024)
+//   local verts, offset = stream:alloc("float32", #positions)
+//   verts:set(positions)
+//   stream:commit()
+//   gl.BindBuffer(gl.ARRAY_BUFFER, stream:name())
+//   gl.VertexAttribPointer(0, 3, gl.FLOAT, gl.FALSE, 0, offset)
+//
+// Memory handed out stays writable until the next commit, Lua views read as
+// empty after it.
+enum StreamMode
+{
+  STREAM_PERSISTENT,  // mapped once, persistent and coherent, needs GL 4.4 or ARB_buffer_storage
+  STREAM_ORPHAN,      // written to system memory, commit uploads with glBufferSubData and
+                      // a wrap orphans the store
+  STREAM_NULL,        // system memory only, for runs without GL
+  STREAM_NONE         // GL isn't current on this thread, gl.StreamBuffer raises an error
+};
+
+struct StreamStats
+{
+  uint64_t frames;
+  uint64_t bytes;    // allocated
+  uint64_t waits;    // allocations that had to wait for a fence
+  uint64_t waited;   // ns spent in those waits
+  uint64_t orphans;  // wraps that orphaned the store
+  uint64_t uploads;  // glBufferSubData calls made by commits
+};
+
+struct StreamBuffer;
+
+// A ring of size bytes. STREAM_PERSISTENT falls back to STREAM_ORPHAN when
+// buffer storage is missing or the map fails.
+StreamBuffer* streamCreate(size_t size, StreamMode mode);
+void streamDestroy(StreamBuffer* s);
+
+// size bytes at a multiple of align, which is a power of two. offset is the
+// position in the GL buffer. NULL when size is larger than the ring.
+void* streamAlloc(StreamBuffer* s, size_t size, size_t align, size_t* offset);
+
+// Makes what was written since the last commit visible to GL, call it
+// before drawing from the allocations.
+void streamCommit(StreamBuffer* s);
+
+unsigned streamName(StreamBuffer* s);
+StreamMode streamMode(StreamBuffer* s);
+const char* streamModeName(StreamMode mode);
+StreamStats streamStats(StreamBuffer* s);
+
+// Ends the frame for every stream: commits and fences what it allocated.
+// Called once the frame's draws have been issued.
+void streamFrame();
+
+// Sets gl.StreamBuffer(size [, "orphan"]), creating streams in mode.
+void streamRegister(lua_State* L, StreamMode mode);
+
+#endif
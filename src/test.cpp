@@ -2,6 +2,26 @@
 #include "lua/src/lualib.h"
 #include "lua/src/lauxlib.h"
 #include "luagl.h"
+#include "timer.h"
+#include "timestep.h"
+#include "callbacks.h"
+#include "profiler.h"
+#include "memory.h"
+#include "collector.h"
+#include "glnull.h"
+#include "render.h"
+#include "jobs.h"
+#include "workers.h"
+#include "input.h"
+#include "pacing.h"
+#include "startup.h"
+#include "libs.h"
+#include "stream.h"
+#include "uniforms.h"
+#include "readback.h"
+#include "glstate.h"
+#include "capture.h"
+#include "scriptcache.h"
 
 
 #if EMSCRIPTEN
@@ -18,28 +38,93 @@
 #include "SDL/SDL_opengl.h"
 #endif
 
+#include <algorithm>
 #include <vector>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <iostream>
 #include <assert.h>
+#include <math.h>
+#include <time.h>
+
+struct Engine
+{
+  lua_State* L;
+  Callbacks callbacks;
+  uint64_t resolvedLoads;  // script loads when the callbacks were last resolved
+  FixedStep step;
+  Profiler profiler;
+  MemoryPool memory;  // the Lua state's allocator
+  Collector collector;
+  Renderer* renderer;  // NULL when GL runs on the main thread
+  Capture* capture;    // NULL unless --capture
+  ScriptCache scripts;
+  InputBuffer input;
+  int inputRef;        // the events userdata passed to input()
+  Pacer pacer;
+  Startup startup;
+  bool started;  // the first frame has run
+  bool quit;
+
+  //benchmark runs
+  bool headless;
+  long frameLimit;
+  long frame;
+  std::vector<uint64_t> frameTimes;
+  std::vector<uint64_t> frameIntervals;  // start to start, includes pacing
+  uint64_t lastStart;
+  MemoryStats loopMemory;  // snapshot when the main loop starts
+  uint64_t loopStart;
+  clock_t loopCpu;
+};
+
+static Engine* toEngine(lua_State* L)
+{
+  lua_getfield(L, LUA_REGISTRYINDEX, "engine.host");
+  Engine* engine = (Engine*)lua_touserdata(L, -1);
+  lua_pop(L, 1);
+  return engine;
+}
 
 int CreateWindow(lua_State* L)
 {
+    Engine* engine = toEngine(L);
+
     SDL_Surface *screen;
     if ( SDL_Init(SDL_INIT_VIDEO) != 0 ) {
         printf("Unable to initialize SDL: %s\n", SDL_GetError());
         return 1;
     }
 
+    if (engine->headless)
+    {
+        //SDL's dummy driver can't make a GL context, GL is stubbed instead, see glnull.h
+        screen = SDL_SetVideoMode( 640, 480, 24, 0 );
+        if ( !screen ) {
+            printf("Unable to set video mode: %s\n", SDL_GetError());
+            return 1;
+        }
+        return 0;
+    }
+
     SDL_GL_SetAttribute( SDL_GL_DOUBLEBUFFER, 1 );
+    SDL_GL_SetAttribute( SDL_GL_SWAP_CONTROL, engine->pacer.mode == PACING_VSYNC ? 1 : 0 );
     screen = SDL_SetVideoMode( 640, 480, 24, SDL_OPENGL );
     if ( !screen ) {
         printf("Unable to set video mode: %s\n", SDL_GetError());
         return 1;
     }
 
+    //drivers are free to ignore the swap interval, sleep instead of spinning
+    int swapControl = 0;
+    if (engine->pacer.mode == PACING_VSYNC &&
+      (SDL_GL_GetAttribute(SDL_GL_SWAP_CONTROL, &swapControl) != 0 || swapControl != 1))
+    {
+      fprintf(stderr, "No vsync from the driver, pacing to 60 fps\n");
+      pacingInit(&engine->pacer, PACING_FPS, 60);
+    }
+
 #if USE_GLEW
     glewExperimental = GL_TRUE;
     GLenum err = glewInit();
@@ -53,116 +138,659 @@ int CreateWindow(lua_State* L)
 
 #endif
 
+    //a new context starts from defaults, not from what was shadowed before
+    glstateReset();
     return 0;
 }
 
-int callLua(lua_State* L, char* function)
+
+static void resolveCallbacks(Engine* engine)
+{
+  callbacksResolve(engine->L, &engine->callbacks);
+  engine->resolvedLoads = engine->scripts.stats.loads;
+}
+
+void events(Engine* engine)
 {
-  lua_getglobal(L, function);
+  profilerBegin(&engine->profiler, PHASE_EVENTS);
 
-  if (lua_pcall(L, 0, 0, 0) != 0)
+  //a dofile may have replaced callbacks
+  if (engine->scripts.stats.loads != engine->resolvedLoads)
   {
-   fprintf(stderr, "pcall %s", lua_tostring(L, -1));
-   lua_pop(L, 1);  /* pop error message from the stack */
-   return -1;
+    resolveCallbacks(engine);
   }
 
-  return 0;
+  //scripts without an input callback keep the old quit on any key or click
+  bool scripted = callbacksDefined(engine->L, &engine->callbacks, CALLBACK_INPUT);
+
+  //with a render thread it pumps the events, we only take them off the queue
+  SDL_Event e;
+  while (engine->renderer ? SDL_PeepEvents(&e, 1, SDL_GETEVENT, SDL_ALLEVENTS) > 0 : SDL_PollEvent(&e)){
+      if (e.type == SDL_QUIT){
+          engine->quit = true;
+      }
+      if (scripted){
+          inputPush(&engine->input, e, timerNow());
+          continue;
+      }
+      if (e.type == SDL_KEYDOWN){
+          engine->quit = true;
+      }
+      if (e.type == SDL_MOUSEBUTTONDOWN){
+          engine->quit = true;
+      }
+  }
+
+  //the whole frame's input in one call
+  if (!engine->input.events.empty())
+  {
+    engine->input.stats.delivered += engine->input.events.size();
+    engine->input.stats.batches++;
+    lua_rawgeti(engine->L, LUA_REGISTRYINDEX, engine->inputRef);
+    callbacksCall(engine->L, &engine->callbacks, CALLBACK_INPUT, 1);
+    inputClear(&engine->input);
+  }
+
+  profilerEnd(&engine->profiler, PHASE_EVENTS);
 }
 
-void update(lua_State* L)
+void update(Engine* engine, double dt)
 {
-  callLua(L, "update");
+  profilerBegin(&engine->profiler, PHASE_UPDATE);
+
+  lua_pushnumber(engine->L, dt);
+  callbacksCall(engine->L, &engine->callbacks, CALLBACK_UPDATE, 1);
+
+  profilerEnd(&engine->profiler, PHASE_UPDATE);
 }
 
-void draw(lua_State* L)
+void draw(Engine* engine, double alpha)
 {
-  callLua(L, "draw");
+  profilerBegin(&engine->profiler, PHASE_DRAW);
 
-  SDL_GL_SwapBuffers();
+  lua_pushnumber(engine->L, alpha);
+  callbacksCall(engine->L, &engine->callbacks, CALLBACK_DRAW, 1);
+
+  streamFrame();
+  profilerEnd(&engine->profiler, PHASE_DRAW);
+
+  //whatever is left of the frame, less the swap, is the collector's
+  profilerBegin(&engine->profiler, PHASE_GC);
+  uint64_t deadline = engine->pacer.mode == PACING_UNTHROTTLED ? 0
+    : engine->lastStart + engine->pacer.period;
+  collectorFrame(&engine->collector, deadline);
+  profilerEnd(&engine->profiler, PHASE_GC);
+
+  profilerBegin(&engine->profiler, PHASE_SWAP);
+
+  if (engine->renderer)
+  {
+    renderFrame(engine->renderer);
+  }
+  else if (!engine->headless)
+  {
+    SDL_GL_SwapBuffers();
+  }
+  glstateFrame();
+  if (engine->capture)
+  {
+    captureFrame(engine->capture);
+  }
+
+  profilerEnd(&engine->profiler, PHASE_SWAP);
 }
 
 void tick(void* input)
 {
-  update((lua_State*)input);
-  draw((lua_State*)input);
+  Engine* engine = (Engine*)input;
+  uint64_t start = timerNow();
+
+  profilerBeginFrame(&engine->profiler);
+  memoryFrame(&engine->memory, true);
+  if (engine->frameLimit > 0 && engine->lastStart != 0)
+  {
+    engine->frameIntervals.push_back(start - engine->lastStart);
+  }
+  engine->lastStart = start;
+
+  events(engine);
+
+  if (engine->headless)
+  {
+    //lockstep, one update per frame so runs are reproducible
+    update(engine, timestepSeconds(&engine->step));
+    draw(engine, 0);
+  }
+  else
+  {
+    int steps = timestepAdvance(&engine->step, start);
+    for (int i = 0; i < steps; ++i)
+    {
+      update(engine, timestepSeconds(&engine->step));
+    }
+
+    draw(engine, timestepAlpha(&engine->step));
+  }
+
+  if (engine->frameLimit > 0)
+  {
+    engine->frameTimes.push_back(timerNow() - start);
+    if (++engine->frame >= engine->frameLimit)
+    {
+      engine->quit = true;
+    }
+  }
+
+  if (!engine->started)
+  {
+    startupMark(&engine->startup, "first frame");
+    engine->started = true;
+  }
+
+#if !EMSCRIPTEN
+  //the browser paces the main loop itself
+  if (!engine->quit)
+  {
+    profilerBegin(&engine->profiler, PHASE_IDLE);
+    pacingWait(&engine->pacer);
+    profilerEnd(&engine->profiler, PHASE_IDLE);
+  }
+#endif
 }
 
-static int traceback(lua_State *L) {
-  lua_getglobal(L, "debug");
-    lua_getfield(L, -1, "traceback");
-    lua_pushvalue(L, 1);
-    lua_pushinteger(L, 2);
-    lua_call(L, 2, 1);
-    fprintf(stderr, "%s\n", lua_tostring(L, -1));
-    return 1;
+//the collector's work and how long frames paused for it
+static void reportCollector(Engine* engine, double frames)
+{
+  const Collector* collector = &engine->collector;
+  if (!collector->running)
+  {
+    return;
+  }
+
+  const CollectorStats* stats = &collector->stats;
+  fprintf(stdout, "gc            %llu cycles, %.1f steps per frame (%.1f past the deadline), %.3f ms per frame, longest %.3f ms\n",
+    (unsigned long long)stats->cycles, stats->steps / frames, stats->forced / frames,
+    stats->time * 1e-6 / frames, stats->longest * 1e-6);
+  fprintf(stdout, "gc pauses    ");
+  for (int i = 0; i < COLLECTOR_BUCKETS; ++i)
+  {
+    if (stats->pauses[i] == 0)
+    {
+      continue;
+    }
+    uint64_t limit = collectorBucketLimit(i);
+    if (limit > 0)
+    {
+      fprintf(stdout, " <%gms %llu", limit * 1e-6, (unsigned long long)stats->pauses[i]);
+    }
+    else
+    {
+      fprintf(stdout, " >=%gms %llu", collectorBucketLimit(i - 1) * 1e-6,
+        (unsigned long long)stats->pauses[i]);
+    }
+  }
+  fprintf(stdout, ", %llu of %.0f frames collected\n", (unsigned long long)stats->frames, frames);
 }
 
+static double percentile(const std::vector<uint64_t>& sorted, int p)
+{
+  return sorted[(sorted.size() - 1) * p / 100] * 1e-6;
+}
 
-int loadLua( lua_State* L, const char* path )
+//how evenly frames start, against the target period when there is one and
+//the mean otherwise
+static void reportPacing(Engine* engine)
 {
-  //load lua scripts
-  FILE *file = fopen(path, "rb");
+  const std::vector<uint64_t>& intervals = engine->frameIntervals;
+  if (intervals.empty())
+  {
+    return;
+  }
 
-  if (file==NULL)
+  double mean = 0;
+  for (uint64_t t : intervals)
   {
-    fputs ("File error",stderr);
-    return 1;
+    mean += t;
+  }
+  mean /= intervals.size();
+
+  double variance = 0;
+  for (uint64_t t : intervals)
+  {
+    variance += (t - mean) * (t - mean);
+  }
+  double stddev = sqrt(variance / intervals.size());
+
+  const Pacer* pacer = &engine->pacer;
+  double expected = pacer->mode == PACING_FPS ? (double)pacer->period : mean;
+  std::vector<uint64_t> error;
+  error.reserve(intervals.size());
+  long missed = 0;
+  for (uint64_t t : intervals)
+  {
+    error.push_back((uint64_t)fabs(t - expected));
+    if (t > expected * 1.5)
+    {
+      missed++;
+    }
+  }
+  std::sort(error.begin(), error.end());
+
+  double wall = timerSeconds(timerNow() - engine->loopStart);
+  double cpu = (double)(clock() - engine->loopCpu) / CLOCKS_PER_SEC;
+
+  fprintf(stdout, "pacing        %s", pacingName(pacer->mode));
+  if (pacer->mode == PACING_FPS)
+  {
+    fprintf(stdout, " %.1f fps, %.1f ms slept %.1f ms spun per frame", 1e9 / pacer->period,
+      pacer->slept * 1e-6 / intervals.size(), pacer->spun * 1e-6 / intervals.size());
+  }
+  fprintf(stdout, ", cpu %.0f%% of a core\n", wall > 0 ? cpu / wall * 100 : 0);
+  fprintf(stdout, "interval ms   avg %.3f stddev %.3f, jitter p50 %.3f p99 %.3f max %.3f, %ld over 1.5x\n",
+    mean * 1e-6, stddev * 1e-6, percentile(error, 50), percentile(error, 99), error.back() * 1e-6,
+    missed);
+}
+
+void report(Engine* engine)
+{
+  std::vector<uint64_t> sorted = engine->frameTimes;
+  if (sorted.empty())
+  {
+    return;
+  }
+  std::sort(sorted.begin(), sorted.end());
+
+  uint64_t total = 0;
+  for (uint64_t t : sorted)
+  {
+    total += t;
+  }
+
+  fprintf(stdout, "frames        %ld\n", (long)sorted.size());
+  fprintf(stdout, "frame ms      min %.3f avg %.3f p50 %.3f p95 %.3f p99 %.3f max %.3f\n",
+    sorted.front() * 1e-6, (double)total / sorted.size() * 1e-6,
+    percentile(sorted, 50), percentile(sorted, 95), percentile(sorted, 99),
+    sorted.back() * 1e-6);
+
+  for (int phase = 0; phase < PHASE_COUNT; ++phase)
+  {
+    PhaseStats stats = profilerStats(&engine->profiler, phase);
+    fprintf(stdout, "  %-10s  min %.3f avg %.3f p95 %.3f p99 %.3f max %.3f (last %d frames)\n",
+      profilerPhaseName(phase), stats.min, stats.avg, stats.p95, stats.p99, stats.max,
+      engine->profiler.count);
+  }
+
+  reportPacing(engine);
+  startupReport(&engine->startup);
+
+  const ScriptCacheStats* scripts = &engine->scripts.stats;
+  if (scripts->loads > 0)
+  {
+    fprintf(stdout, "scripts       %llu loaded (%.1f KB) in %.3f ms, %llu from the cache, %llu compiled\n",
+      (unsigned long long)scripts->loads, scripts->bytes / 1024.0, scripts->time * 1e-6,
+      (unsigned long long)scripts->hits, (unsigned long long)(scripts->loads - scripts->hits));
   }
 
-  // obtain file size:
-  fseek (file , 0 , SEEK_END);
-  auto lSize = ftell (file);
-  rewind (file);
+  const MemoryStats* memory = &engine->memory.stats;
+  fprintf(stdout, "lua heap      %.1f KB (peak %.1f KB)\n",
+    lua_gc(engine->L, LUA_GCCOUNT, 0) + lua_gc(engine->L, LUA_GCCOUNTB, 0) / 1024.0,
+    memory->peak / 1024.0);
+  fprintf(stdout, "lua allocs    %llu (%.1f KB), frees %llu (%.1f KB)\n",
+    (unsigned long long)memory->allocs, memory->allocated / 1024.0,
+    (unsigned long long)memory->frees, memory->freed / 1024.0);
+
+  //steady state, startup and awake excluded
+  const MemoryStats* loop = &engine->loopMemory;
+  double frames = (double)sorted.size();
+  fprintf(stdout, "per frame     %.1f allocs (%.2f KB), %.1f frees, %.2f KB collected\n",
+    (memory->allocs - loop->allocs) / frames, (memory->allocated - loop->allocated) / frames / 1024.0,
+    (memory->frees - loop->frees) / frames, (memory->freed - loop->freed) / frames / 1024.0);
+
+  const MemoryPool* pool = &engine->memory;
+  fprintf(stdout, "lua pool      %.1f%% of allocs pooled, %.1f KB in %llu slabs\n",
+    memory->allocs ? pool->pooled * 100.0 / memory->allocs : 0.0,
+    pool->slabs * MEMORY_SLAB / 1024.0, (unsigned long long)pool->slabs);
+  fprintf(stdout, "worst frame   %llu allocs (%.2f KB), heap peak %.1f KB\n",
+    (unsigned long long)pool->worst.allocs, pool->worst.bytes / 1024.0, pool->worst.peak / 1024.0);
+  reportCollector(engine, frames);
+
+  if (engine->renderer)
+  {
+    RenderStats render = renderStats(engine->renderer);
+    fprintf(stdout, "render thread %.1f commands (%.1f KB), %.2f sync calls (%.3f ms), %.3f ms frame wait, %.3f ms busy, %.3f ms idle per frame\n",
+      render.commands / frames, render.bytes / frames / 1024.0,
+      render.syncCalls / frames, render.syncWait * 1e-6 / frames,
+      render.frameWait * 1e-6 / frames, render.busy * 1e-6 / frames,
+      render.idle * 1e-6 / frames);
+  }
 
-  // allocate memory to contain the whole file:
-  auto buffer = (char*) malloc (sizeof(char)*lSize);
-  if (buffer == NULL)
+  if (engine->capture)
   {
-    fputs ("Memory error",stderr);
-    return 2;
+    CaptureStats capture = captureStats(engine->capture);
+    fprintf(stdout, "capture       %llu frames, %.1f commands (%.1f KB) per frame, %llu calls dropped\n",
+      (unsigned long long)capture.frames, (double)capture.commands / capture.frames,
+      capture.bytes / 1024.0 / capture.frames, (unsigned long long)capture.dropped);
   }
 
-  // copy the file into the buffer:
-  auto result = fread (buffer,1,lSize,file);
-  if (result != lSize)
+  GLStateStats glstate = glstateStats();
+  if (glstate.issued + glstate.elided > 0)
   {
-    fputs ("Reading error", stderr);
-    return 3;
+    fprintf(stdout, "gl state      %.1f issued, %.1f elided per frame\n",
+      (double)glstate.issued / sorted.size(), (double)glstate.elided / sorted.size());
   }
 
-  //close the file its now loaded into a memory buffer
-  fclose (file);
+  if (engine->headless)
+  {
+    fprintf(stdout, "gl calls      %lld, %.1f/frame\n", glnullCalls(engine->L),
+      (double)glnullCalls(engine->L) / sorted.size());
+    glnullReport(engine->L, 10);
+  }
+}
+
+// engine.SetFixedUpdate(hz [, maxSteps])
+static int SetFixedUpdate(lua_State* L)
+{
+  Engine* engine = toEngine(L);
+  lua_Number hz = luaL_checknumber(L, 1);
+  luaL_argcheck(L, hz > 0 && hz <= 1e9, 1, "rate must be above 0 and at most 1e9 Hz");
+  timestepInit(&engine->step, hz, luaL_optinteger(L, 2, 5));
+  return 0;
+}
 
-  int error = luaL_loadbuffer(L, buffer, strlen(buffer), path);
+// engine.Time() -> seconds on the clock input events are stamped with
+static int Time(lua_State* L)
+{
+  lua_pushnumber(L, timerSeconds(timerNow()));
+  return 1;
+}
+
+// engine.SetMotionCoalescing(enabled), on by default. Off, input() sees
+// every mouse motion event SDL reports.
+static int SetMotionCoalescing(lua_State* L)
+{
+  toEngine(L)->input.coalesce = lua_toboolean(L, 1) != 0;
+  return 0;
+}
+
+// engine.SetCollector(pause, stepmul) -> the previous pause and stepmul.
+// Percentages like collectgarbage("setpause"), nil keeps a value as it is.
+static int SetCollector(lua_State* L)
+{
+  Collector* collector = &toEngine(L)->collector;
+  lua_pushinteger(L, collector->pause);
+  lua_pushinteger(L, collector->stepmul);
+  collectorSetParams(collector, (int)luaL_optinteger(L, 1, -1), (int)luaL_optinteger(L, 2, -1));
+  return 2;
+}
+
+// engine.ResolveCallbacks() picks up callbacks the script has assigned
+// since it was loaded, they are otherwise only read after a script load
+static int ResolveCallbacks(lua_State* L)
+{
+  resolveCallbacks(toEngine(L));
+  return 0;
+}
+
+// engine.Quit() leaves the main loop after this frame
+static int Quit(lua_State* L)
+{
+  toEngine(L)->quit = true;
+  return 0;
+}
+
+static int panic(lua_State *L)
+{
+  fprintf(stderr, "PANIC: unprotected error in call to Lua API (%s)\n", lua_tostring(L, -1));
+  return 0;
+}
+
+//message handler for every call into Lua, the caller reports the result.
+//luaL_traceback rather than debug.traceback, the debug library may not be
+//open
+static int traceback(lua_State *L) {
+  const char* message = lua_tostring(L, 1);
+  if (message == NULL && !lua_isnoneornil(L, 1))
+  {
+    return 1;
+  }
+  luaL_traceback(L, L, message, 1);
+  return 1;
+}
+
+
+int loadLua(lua_State* L, ScriptCache* cache, const char* path)
+{
+  int error = scriptCacheLoad(cache, L, path, path);
   if (error)
   {
     fprintf(stderr, "loadbuffer %s", lua_tostring(L, -1));
     lua_pop(L, 1);  /* pop error message from the stack */
-    return -1;
+    return error == LUA_ERRFILE ? 1 : -1;
   }
-
-  //The buffer has been handed off to lua now
-  free(buffer);
   return 0;
 }
 
 int main (int argc, char *argv[])
 {
+  //emscripten unwinds main's stack when the main loop starts so the engine
+  //state can't live there
+  static Engine engine;
+
+  const char* script = "lua/draw.lua";
+  const char* tracePath = NULL;
+  const char* capturePath = NULL;
+  const char* replayPath = NULL;
+#if EMSCRIPTEN
+  //the file system is in memory, nothing would survive to the next run
+  const char* scriptCachePath = NULL;
+#else
+  const char* scriptCachePath = ".scriptcache";
+#endif
+  bool renderThread = false;
+  bool gcBudget = true;
+  int workers = -1;
+  const char* libs = NULL;
+  PacingMode pacing = PACING_VSYNC;
+  bool pacingSet = false;
+  double fps = 60;
+  for (int i = 1; i < argc; ++i)
+  {
+    if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+    {
+      tracePath = argv[++i];
+    }
+    else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+    {
+      engine.frameLimit = atol(argv[++i]);
+    }
+    else if (strcmp(argv[i], "--headless") == 0)
+    {
+      engine.headless = true;
+    }
+    else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc)
+    {
+      workers = atoi(argv[++i]);
+    }
+    else if (strcmp(argv[i], "--render-thread") == 0)
+    {
+      renderThread = true;
+    }
+    else if (strcmp(argv[i], "--libs") == 0 && i + 1 < argc)
+    {
+      libs = argv[++i];
+    }
+    else if (strcmp(argv[i], "--vsync") == 0)
+    {
+      pacing = PACING_VSYNC;
+      pacingSet = true;
+    }
+    else if (strcmp(argv[i], "--fps") == 0 && i + 1 < argc)
+    {
+      pacing = PACING_FPS;
+      pacingSet = true;
+      fps = atof(argv[++i]);
+    }
+    else if (strcmp(argv[i], "--unthrottled") == 0)
+    {
+      pacing = PACING_UNTHROTTLED;
+      pacingSet = true;
+    }
+    else if (strcmp(argv[i], "--capture") == 0 && i + 1 < argc)
+    {
+      capturePath = argv[++i];
+    }
+    else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc)
+    {
+      replayPath = argv[++i];
+    }
+    else if (strcmp(argv[i], "--no-gl-cache") == 0)
+    {
+      glstateSetEnabled(false);
+    }
+    else if (strcmp(argv[i], "--no-gc-budget") == 0)
+    {
+      gcBudget = false;
+    }
+    else if (strcmp(argv[i], "--script-cache") == 0 && i + 1 < argc)
+    {
+      scriptCachePath = argv[++i];
+    }
+    else if (strcmp(argv[i], "--no-script-cache") == 0)
+    {
+      scriptCachePath = NULL;
+    }
+    else
+    {
+      script = argv[i];
+    }
+  }
+
+  startupInit(&engine.startup, &engine.memory.stats);
+
+  if (engine.headless)
+  {
+    SDL_putenv((char*)"SDL_VIDEODRIVER=dummy");
+    if (SDL_Init(SDL_INIT_VIDEO) != 0)
+    {
+      fprintf(stderr, "Unable to initialize SDL: %s\n", SDL_GetError());
+      return 1;
+    }
+  }
+  //headless runs are benchmarks unless told otherwise, and never swap
+  if (engine.headless && !pacingSet)
+  {
+    pacing = PACING_UNTHROTTLED;
+  }
+  else if (engine.headless && pacing == PACING_VSYNC)
+  {
+    pacing = PACING_FPS;
+  }
+  pacingInit(&engine.pacer, pacing, fps);
+  engine.frameTimes.reserve(engine.frameLimit);
+  engine.frameIntervals.reserve(engine.frameLimit);
+  startupMark(&engine.startup, "sdl");
+  jobsInit(workers);
+  startupMark(&engine.startup, "jobs");
+
   fprintf(stdout, "Starting Application\n" );
-  lua_State *L = luaL_newstate();   /* opens Lua */
-  luaL_openlibs(L); /*open the lua libs*/
+  memoryPoolInit(&engine.memory);
+  lua_State *L = lua_newstate(memoryPoolAlloc, &engine.memory);   /* opens Lua */
+  lua_atpanic(L, panic);
+  startupMark(&engine.startup, "lua state");
+  libsOpen(L, libs); /*open the lua libs*/
+  startupMark(&engine.startup, "libraries");
   luaL_opengl(L);
+  if (engine.headless)
+  {
+    glnullInstall(L);
+  }
+  startupMark(&engine.startup, "gl bindings");
   lua_pushcfunction(L, traceback);
 
+  engine.L = L;
+  callbacksInit(L, &engine.callbacks, -1);
+  timestepInit(&engine.step, 60, 5);
+  profilerInit(&engine.profiler);
+  collectorInit(&engine.collector, L, &engine.memory.stats, gcBudget);
+  scriptCacheInit(&engine.scripts, scriptCachePath);
+  scriptCacheRegister(L, &engine.scripts);
+
+  lua_pushlightuserdata(L, &engine);
+  lua_setfield(L, LUA_REGISTRYINDEX, "engine.host");
+
+  //Register the engine table
+  lua_createtable(L, 0, 8);
+  lua_pushcfunction(L, SetFixedUpdate);
+  lua_setfield(L, -2, "SetFixedUpdate");
+  lua_pushcfunction(L, Time);
+  lua_setfield(L, -2, "Time");
+  lua_pushcfunction(L, Quit);
+  lua_setfield(L, -2, "Quit");
+  lua_pushcfunction(L, SetMotionCoalescing);
+  lua_setfield(L, -2, "SetMotionCoalescing");
+  lua_pushcfunction(L, SetCollector);
+  lua_setfield(L, -2, "SetCollector");
+  lua_pushcfunction(L, ResolveCallbacks);
+  lua_setfield(L, -2, "ResolveCallbacks");
+  lua_setglobal(L, "engine");
+  profilerRegister(L, &engine.profiler);
+  inputInit(&engine.input, true);
+  engine.inputRef = inputRegister(L, &engine.input);
+  profilerAddSource(&engine.profiler, "input", inputPushStats, &engine.input);
+  profilerAddSource(&engine.profiler, "glstate", glstatePushStats, NULL);
+  profilerAddSource(&engine.profiler, "memory", memoryPushStats, &engine.memory);
+  profilerAddSource(&engine.profiler, "collector", collectorPushStats, &engine.collector);
+  profilerAddSource(&engine.profiler, "scripts", scriptCachePushStats, &engine.scripts);
+  jobsRegister(L);
+  workersRegister(L);
+
   //Register Create Window Function
   lua_register(L, "CreateWindow", CreateWindow);
+  startupMark(&engine.startup, "engine api");
+
+  if (renderThread)
+  {
+    engine.renderer = renderStart(L, engine.headless);
+    if (engine.renderer)
+    {
+      profilerAddSource(&engine.profiler, "render", renderPushStats, engine.renderer);
+    }
+    else
+    {
+      fprintf(stderr, "No render thread support in this build\n");
+    }
+  }
+
+  //outside the render thread's wrappers so sync calls are captured as well
+  if (capturePath)
+  {
+    engine.capture = captureStart(L, capturePath);
+    if (engine.capture)
+    {
+      profilerAddSource(&engine.profiler, "capture", capturePushStats, engine.capture);
+    }
+    else
+    {
+      fprintf(stderr, "Unable to write capture %s\n", capturePath);
+    }
+  }
+
+  //after the render thread so it doesn't get wrapped, GL isn't ours then
+  StreamMode streams = engine.headless ? STREAM_NULL
+    : engine.renderer ? STREAM_NONE : STREAM_PERSISTENT;
+  streamRegister(L, streams);
+  uniformsRegister(L, streams);
+  readbackRegister(L, engine.headless ? READBACK_NULL
+    : engine.renderer ? READBACK_NONE : READBACK_PBO);
+
+  startupMark(&engine.startup, "render thread");
 
-  int error =   loadLua(L,"lua/draw.lua");
+  int error = replayPath ? captureLoadReplay(L, replayPath) : loadLua(L, &engine.scripts, script);
   if (error)
   {
     return error;
   }
+  startupMark(&engine.startup, "load script");
 
   error = lua_pcall(L, 0, 0, lua_gettop(L) - 1);
   if (error)
@@ -171,41 +799,73 @@ int main (int argc, char *argv[])
    lua_pop(L, 1);  /* pop error message from the stack */
    return error;
   }
+  startupMark(&engine.startup, "run script");
 
-  error = callLua(L, "awake");
+  resolveCallbacks(&engine);
+  error = callbacksCall(L, &engine.callbacks, CALLBACK_AWAKE);
 
   if (error)
   {
     return error;
   }
+  //awake may have set the others
+  resolveCallbacks(&engine);
+  startupMark(&engine.startup, "awake");
+
+  //loading and awake are the capture's setup frame
+  if (engine.capture)
+  {
+    captureFrame(engine.capture);
+  }
+
 
 
+  engine.loopMemory = engine.memory.stats;
+  memoryFrame(&engine.memory, false);
+  collectorStart(&engine.collector);
+  engine.loopStart = timerNow();
+  engine.loopCpu = clock();
 
 #if EMSCRIPTEN
-	  emscripten_set_main_loop_arg(tick, L, 0, 1);
+	  emscripten_set_main_loop_arg(tick, &engine, engine.pacer.mode == PACING_FPS ? (int)fps : 0, 1);
 #else
-  SDL_Event e;
-  bool quit = false;
-
-  while (!quit){
-      tick(L);
-      while (SDL_PollEvent(&e)){
-          if (e.type == SDL_QUIT){
-              quit = true;
-          }
-          if (e.type == SDL_KEYDOWN){
-              quit = true;
-          }
-          if (e.type == SDL_MOUSEBUTTONDOWN){
-              quit = true;
-          }
-      }
+  while (!engine.quit){
+      tick(&engine);
   }
 #endif
 
+  if (engine.capture && !captureStop(engine.capture))
+  {
+    fprintf(stderr, "Unable to write capture %s\n", capturePath);
+  }
+
+  if (engine.frameLimit > 0)
+  {
+    report(&engine);
+  }
+
+  if (tracePath)
+  {
+    if (profilerDumpTrace(&engine.profiler, tracePath) == 0)
+    {
+      fprintf(stdout, "Wrote frame trace to %s\n", tracePath);
+    }
+    else
+    {
+      fprintf(stderr, "Unable to write frame trace to %s\n", tracePath);
+    }
+  }
+
+  if (engine.renderer)
+  {
+    renderStop(engine.renderer);
+  }
+
   fprintf(stdout, "Exiting Application\n" );
   SDL_Quit();
 
   lua_close(L);
+  memoryPoolRelease(&engine.memory);
+  jobsShutdown();
   return 0;
 }
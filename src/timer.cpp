@@ -0,0 +1,9 @@
+#include "timer.h"
+
+#include <chrono>
+
+uint64_t timerNow()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
@@ -0,0 +1,14 @@
+#ifndef __TIMER_H__
+#define __TIMER_H__
+
+#include <stdint.h>
+
+// Monotonic time in nanoseconds, suitable for measuring intervals.
+uint64_t timerNow();
+
+inline double timerSeconds(uint64_t ns)
+{
+  return ns * 1e-9;
+}
+
+#endif
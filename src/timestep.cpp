@@ -0,0 +1,51 @@
+#include "timestep.h"
+
+void timestepInit(FixedStep* fs, double hz, int maxSteps)
+{
+  //also catches NaN
+  if (!(hz > 0))
+  {
+    hz = 60;
+  }
+  if (maxSteps < 1)
+  {
+    maxSteps = 1;
+  }
+
+  //at least 1 ns, timestepAdvance divides by it
+  fs->step = hz < 1e9 ? (uint64_t)(1e9 / hz) : 1;
+  fs->maxSteps = maxSteps;
+  //bank a full step so the first frame updates before it draws
+  fs->accumulator = fs->step;
+  fs->last = 0;
+}
+
+int timestepAdvance(FixedStep* fs, uint64_t now)
+{
+  if (fs->last != 0)
+  {
+    fs->accumulator += now - fs->last;
+  }
+  fs->last = now;
+
+  int steps = (int)(fs->accumulator / fs->step);
+  if (steps > fs->maxSteps)
+  {
+    //we can't keep up, drop the backlog rather than spiral
+    steps = fs->maxSteps;
+    fs->accumulator = fs->step * steps;
+  }
+
+  fs->accumulator -= fs->step * steps;
+  return steps;
+}
+
+double timestepAlpha(const FixedStep* fs)
+{
+  return (double)fs->accumulator / (double)fs->step;
+}
+
+double timestepSeconds(const FixedStep* fs)
+{
+  return fs->step * 1e-9;
+}
@@ -0,0 +1,28 @@
+#ifndef __TIMESTEP_H__
+#define __TIMESTEP_H__
+
+#include <stdint.h>
+
+// Accumulator driven fixed update. Real time is banked every frame and spent
+// in whole steps; the remainder becomes the interpolation alpha for drawing.
+struct FixedStep
+{
+  uint64_t step;        // nanoseconds per update
+  int maxSteps;         // catch-up cap, excess time is dropped
+  uint64_t accumulator;
+  uint64_t last;
+};
+
+// hz that isn't above 0 means 60, steps are at least 1 ns.
+void timestepInit(FixedStep* fs, double hz, int maxSteps);
+
+// Banks the time elapsed since the previous call and returns how many
+// updates should run this frame.
+int timestepAdvance(FixedStep* fs, uint64_t now);
+
+// Fraction of a step left in the accumulator, in [0, 1).
+double timestepAlpha(const FixedStep* fs);
+
+double timestepSeconds(const FixedStep* fs);
+
+#endif
@@ -0,0 +1,317 @@
+#include "uniforms.h"
+#include "buffer.h"
+#include "glstate.h"
+#include "lua/src/lauxlib.h"
+
+#if EMSCRIPTEN
+
+#else
+#define USE_GLEW 1
+#endif
+
+#include "SDL/SDL.h"
+
+#if USE_GLEW
+#include "GL/glew.h"
+#else
+#include "SDL/SDL_opengl.h"
+#endif
+
+#include <string.h>
+
+// std140 puts vec3s, vec4s, matrix columns and array elements on 16 bytes
+#define STD140_ALIGNMENT 16
+
+struct UniformRing
+{
+  StreamBuffer* stream;
+  size_t alignment;  // GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+  UniformStats stats;
+};
+
+UniformRing* uniformsCreate(size_t size, StreamMode mode)
+{
+  UniformRing* u = new UniformRing();
+  u->stream = streamCreate(size, mode);
+  u->alignment = 256;  // the largest drivers ask for, used without GL
+  if (mode != STREAM_NULL)
+  {
+    GLint alignment = 0;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    if (alignment > 0)
+    {
+      u->alignment = (size_t)alignment;
+    }
+  }
+  return u;
+}
+
+void uniformsDestroy(UniformRing* u)
+{
+  streamDestroy(u->stream);
+  delete u;
+}
+
+void* uniformsAlloc(UniformRing* u, size_t size, size_t* offset)
+{
+  return streamAlloc(u->stream, size, u->alignment, offset);
+}
+
+void uniformsBind(UniformRing* u, unsigned binding, size_t offset, size_t size)
+{
+  streamCommit(u->stream);
+  if (streamMode(u->stream) != STREAM_NULL)
+  {
+    glstateBindBufferRange(GL_UNIFORM_BUFFER, binding, streamName(u->stream), offset, size);
+  }
+  u->stats.pushes++;
+}
+
+UniformStats uniformsStats(UniformRing* u)
+{
+  return u->stats;
+}
+
+static size_t alignUp(size_t size, size_t alignment)
+{
+  return (size + alignment - 1) & ~(alignment - 1);
+}
+
+size_t uniformsPlace(size_t at, size_t size, size_t* end)
+{
+  // a scalar or a vec2 aligns on its size, a vec3 on a vec4's
+  size_t offset = alignUp(at, size == 4 || size == 8 ? size : STD140_ALIGNMENT);
+  // matrices, arrays and structs also pad the member after them to a vec4
+  *end = size > STD140_ALIGNMENT ? alignUp(offset + size, STD140_ALIGNMENT) : offset + size;
+  return offset;
+}
+
+// Lua side, a userdata holding the UniformRing*
+
+static const char* handleName = "engine.uniforms";
+
+static UniformRing* checkRing(lua_State* L, int index)
+{
+  UniformRing* u = *(UniformRing**)luaL_checkudata(L, index, handleName);
+  luaL_argcheck(L, u != NULL, index, "uniform ring has been destroyed");
+  return u;
+}
+
+// Bytes a value takes before padding
+static size_t valueSize(lua_State* L, int index)
+{
+  Buffer* buffer = bufferTest(L, index);
+  if (buffer != NULL)
+  {
+    return buffer->size;
+  }
+  switch (lua_type(L, index))
+  {
+  case LUA_TSTRING:
+    return lua_rawlen(L, index);
+  case LUA_TTABLE:
+    return lua_rawlen(L, index) * sizeof(float);
+  default:
+    luaL_argerror(L, index, lua_pushfstring(L, "buffer, string or table expected, got %s",
+      luaL_typename(L, index)));
+    return 0;
+  }
+}
+
+static void copyValue(lua_State* L, int index, uint8_t* to, size_t size)
+{
+  if (lua_type(L, index) != LUA_TTABLE)
+  {
+    Buffer* buffer = bufferTest(L, index);
+    memcpy(to, buffer != NULL ? (const void*)buffer->data : lua_tostring(L, index), size);
+    return;
+  }
+
+  float* floats = (float*)to;
+  for (size_t i = 0; i < size / sizeof(float); ++i)
+  {
+    int isnum = 0;
+    lua_rawgeti(L, index, (lua_Integer)i + 1);
+    floats[i] = (float)lua_tonumberx(L, -1, &isnum);
+    if (!isnum)
+    {
+      luaL_error(L, "invalid entry #%d in argument #%d (expected number, got %s)",
+        (int)i + 1, index, luaL_typename(L, -1));
+    }
+    lua_pop(L, 1);
+  }
+}
+
+// ring:push(binding, value...) -> offset, size. Copies the values into the
+// ring at their std140 offsets, see uniformsPlace, and binds them to
+// binding. The gaps between them are zeroed.
+static int uniformsLuaPush(lua_State* L)
+{
+  UniformRing* u = checkRing(L, 1);
+  lua_Integer binding = luaL_checkinteger(L, 2);
+  luaL_argcheck(L, binding >= 0, 2, "invalid binding");
+  int top = lua_gettop(L);
+
+  size_t total = 0;
+  for (int i = 3; i <= top; ++i)
+  {
+    uniformsPlace(total, valueSize(L, i), &total);
+  }
+  luaL_argcheck(L, total > 0, 3, "nothing to push");
+
+  size_t offset = 0;
+  uint8_t* data = (uint8_t*)uniformsAlloc(u, total, &offset);
+  luaL_argcheck(L, data != NULL, 3, "larger than the uniform ring");
+
+  size_t at = 0;
+  for (int i = 3; i <= top; ++i)
+  {
+    size_t size = valueSize(L, i);
+    size_t end = 0;
+    size_t place = uniformsPlace(at, size, &end);
+    memset(data + at, 0, place - at);
+    copyValue(L, i, data + place, size);
+    memset(data + place + size, 0, end - place - size);
+    at = end;
+    u->stats.bytes += size;
+  }
+
+  uniformsBind(u, (unsigned)binding, offset, total);
+  lua_pushinteger(L, (lua_Integer)offset);
+  lua_pushinteger(L, (lua_Integer)total);
+  return 2;
+}
+
+// ring:block(program, name [, binding]) -> binding, size in bytes, or nil
+// when the program has no active block of that name. With a binding the
+// block is pointed at it, otherwise the one it has is returned.
+static int uniformsLuaBlock(lua_State* L)
+{
+  UniformRing* u = checkRing(L, 1);
+  GLuint program = (GLuint)luaL_checkinteger(L, 2);
+  const char* name = luaL_checkstring(L, 3);
+  lua_Integer binding = luaL_optinteger(L, 4, -1);
+
+  if (streamMode(u->stream) == STREAM_NULL)
+  {
+    lua_pushinteger(L, binding >= 0 ? binding : 0);
+    lua_pushinteger(L, 0);
+    return 2;
+  }
+
+  GLuint index = glGetUniformBlockIndex(program, name);
+  if (index == GL_INVALID_INDEX)
+  {
+    lua_pushnil(L);
+    return 1;
+  }
+
+  GLint value = 0;
+  if (binding >= 0)
+  {
+    glUniformBlockBinding(program, index, (GLuint)binding);
+  }
+  else
+  {
+    glGetActiveUniformBlockiv(program, index, GL_UNIFORM_BLOCK_BINDING, &value);
+    binding = value;
+  }
+  glGetActiveUniformBlockiv(program, index, GL_UNIFORM_BLOCK_DATA_SIZE, &value);
+
+  lua_pushinteger(L, binding);
+  lua_pushinteger(L, value);
+  return 2;
+}
+
+// ring:alignment() -> the offset alignment of a push
+static int uniformsLuaAlignment(lua_State* L)
+{
+  lua_pushinteger(L, (lua_Integer)checkRing(L, 1)->alignment);
+  return 1;
+}
+
+// ring:name() -> the GL buffer pushes are bound from
+static int uniformsLuaName(lua_State* L)
+{
+  lua_pushinteger(L, streamName(checkRing(L, 1)->stream));
+  return 1;
+}
+
+// ring:stats() -> pushes and bytes pushed, then the stream's totals
+static int uniformsLuaStats(lua_State* L)
+{
+  UniformRing* u = checkRing(L, 1);
+  StreamStats stream = streamStats(u->stream);
+  lua_createtable(L, 0, 5);
+  lua_pushinteger(L, (lua_Integer)u->stats.pushes);
+  lua_setfield(L, -2, "pushes");
+  lua_pushinteger(L, (lua_Integer)u->stats.bytes);
+  lua_setfield(L, -2, "bytes");
+  lua_pushinteger(L, (lua_Integer)stream.waits);
+  lua_setfield(L, -2, "waits");
+  lua_pushinteger(L, (lua_Integer)stream.orphans);
+  lua_setfield(L, -2, "orphans");
+  lua_pushinteger(L, (lua_Integer)stream.uploads);
+  lua_setfield(L, -2, "uploads");
+  return 1;
+}
+
+static int uniformsLuaGc(lua_State* L)
+{
+  UniformRing** ud = (UniformRing**)luaL_checkudata(L, 1, handleName);
+  if (*ud != NULL)
+  {
+    uniformsDestroy(*ud);
+    *ud = NULL;
+  }
+  return 0;
+}
+
+// gl.UniformRing(size [, "orphan"]), the mode is an upvalue
+static int uniformsLuaCreate(lua_State* L)
+{
+  static const char* modes[] = {"persistent", "orphan", NULL};
+  StreamMode mode = (StreamMode)lua_tointeger(L, lua_upvalueindex(1));
+  if (mode == STREAM_NONE)
+  {
+    return luaL_error(L, "UniformRing needs GL on the main thread, run without --render-thread");
+  }
+
+  lua_Integer size = luaL_checkinteger(L, 1);
+  luaL_argcheck(L, size > 0 && size <= 0x7fffffff, 1, "invalid size");
+  if (mode == STREAM_PERSISTENT && luaL_checkoption(L, 2, "persistent", modes) == 1)
+  {
+    mode = STREAM_ORPHAN;
+  }
+
+  UniformRing** ud = (UniformRing**)lua_newuserdata(L, sizeof(UniformRing*));
+  *ud = NULL;
+  luaL_setmetatable(L, handleName);
+  *ud = uniformsCreate((size_t)size, mode);
+  return 1;
+}
+
+void uniformsRegister(lua_State* L, StreamMode mode)
+{
+  static const luaL_Reg methods[] = {
+    {"push", uniformsLuaPush},
+    {"block", uniformsLuaBlock},
+    {"alignment", uniformsLuaAlignment},
+    {"name", uniformsLuaName},
+    {"stats", uniformsLuaStats},
+    {"__gc", uniformsLuaGc},
+    {NULL, NULL}
+  };
+
+  luaL_newmetatable(L, handleName);
+  luaL_setfuncs(L, methods, 0);
+  lua_pushvalue(L, -1);
+  lua_setfield(L, -2, "__index");
+  lua_pop(L, 1);
+
+  lua_getglobal(L, "gl");
+  lua_pushinteger(L, mode);
+  lua_pushcclosure(L, uniformsLuaCreate, 1);
+  lua_setfield(L, -2, "UniformRing");
+  lua_pop(L, 1);
+}
@@ -0,0 +1,63 @@
+#ifndef __UNIFORMS_H__
+#define __UNIFORMS_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include "stream.h"
+#include "lua/src/lua.h"
+
+// Per draw uniforms through a uniform buffer ring. A push copies the values
+// into the next slice of a stream buffer, at the offset alignment the
+// context asks for, and binds that range to a uniform block binding. A
+// draw's uniforms then cost one memcpy and one glBindBufferRange instead of
+// a glUniform* call per value.
+//
+//   local uniforms = gl.UniformRing(1024 * 1024)
+//   local binding = uniforms:block(program, "Object", 1)
+//   for _, object in ipairs(objects) do
+//     uniforms:push(binding, object.model, object.color)
+//     gl.DrawArrays(gl.TRIANGLES, object.first, object.count)
+//   end
+//
+// block looks the block up with GetActiveUniformBlockiv and gives it a
+// binding. push lays values out as the block's members in order, by the
+// std140 rules for the member a value's size says it is: 4 bytes is a
+// scalar, 8 a vec2, 12 a vec3 and 16 a vec4, each aligned like std140 does
+// them, so a float can follow a vec3 in the same 16 bytes. Anything larger
+// is a matrix, an array or a struct already laid out for std140, like a
+// mat4 or a vec4 array, and it and the member after it start on 16 bytes.
+// A float[] or mat3 has to be given padded to 16 byte elements or columns.
+// Values are gl.Buffers or strings as bytes, or tables of numbers as
+// floats.
+//
+// Like gl.StreamBuffer it needs GL on the main thread.
+
+struct UniformStats
+{
+  uint64_t pushes;
+  uint64_t bytes;  // copied, without padding
+};
+
+struct UniformRing;
+
+UniformRing* uniformsCreate(size_t size, StreamMode mode);
+void uniformsDestroy(UniformRing* u);
+
+// Room for size bytes in the ring, aligned for binding. NULL when size is
+// larger than the ring.
+void* uniformsAlloc(UniformRing* u, size_t size, size_t* offset);
+
+// Uploads what was allocated, if the stream needs it, and binds size bytes
+// at offset to the uniform block binding.
+void uniformsBind(UniformRing* u, unsigned binding, size_t offset, size_t size);
+
+UniformStats uniformsStats(UniformRing* u);
+
+// Where a value of size bytes goes, as above, in a block that has at bytes
+// used. end is set to where the next value can start.
+size_t uniformsPlace(size_t at, size_t size, size_t* end);
+
+// Sets gl.UniformRing(size [, "orphan"]), creating rings in mode.
+void uniformsRegister(lua_State* L, StreamMode mode);
+
+#endif
@@ -0,0 +1,304 @@
+#include "workers.h"
+
+#include "channel.h"
+#include "jobs.h"
+#include "message.h"
+#include "buffer.h"
+#include "lua/src/lauxlib.h"
+#include "lua/src/lualib.h"
+
+#include <atomic>
+#include <chrono>
+#include <stdio.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define WORKER_CHANNEL_SIZE (256 * 1024)
+
+struct Worker
+{
+  int index;
+  std::string script;
+  std::vector<uint8_t> args;
+
+  Channel* inbox;   // to the worker
+  Channel* outbox;  // from the worker
+  std::vector<uint8_t> scratch;        // owning state's side
+  std::vector<uint8_t> workerScratch;  // worker's side
+
+  std::thread thread;
+  std::atomic<bool> running;
+};
+
+static const char* workerName = "engine.workers.handle";
+static std::atomic<int> spawned(0);
+
+static void checkSize(lua_State* L, Channel* c, const std::vector<uint8_t>& message)
+{
+  if (message.size() > channelMaxMessage(c))
+  {
+    messageDiscard(message.data(), message.size());
+    luaL_error(L, "message of %d bytes is larger than the channel", (int)message.size());
+  }
+}
+
+// Pushes the next message, or nil and why there isn't one.
+static int receive(lua_State* L, Channel* c, std::vector<uint8_t>* scratch, double timeout)
+{
+  if (!channelReceive(c, scratch))
+  {
+    if (timeout == 0 || !channelWait(c, timeout) || !channelReceive(c, scratch))
+    {
+      //messages sent before closing are still delivered
+      lua_pushnil(L);
+      lua_pushstring(L, c->closed.load() ? "closed" : timeout == 0 ? "empty" : "timeout");
+      return 2;
+    }
+  }
+
+  messageRead(L, scratch->data(), 0);
+  return 1;
+}
+
+// engine.send(value) in a worker, waits while the channel is full. Returns
+// false once the owner has closed it.
+static int workerSend(lua_State* L)
+{
+  Worker* w = (Worker*)lua_touserdata(L, lua_upvalueindex(1));
+  luaL_checkany(L, 1);
+  luaL_argcheck(L, !lua_isnil(L, 1), 1, "can't send nil");
+
+  w->workerScratch.clear();
+  messageWrite(L, 1, &w->workerScratch);
+  checkSize(L, w->outbox, w->workerScratch);
+
+  while (!channelSend(w->outbox, w->workerScratch.data(), w->workerScratch.size()))
+  {
+    if (w->outbox->closed.load())
+    {
+      messageDiscard(w->workerScratch.data(), w->workerScratch.size());
+      lua_pushboolean(L, 0);
+      return 1;
+    }
+    std::this_thread::sleep_for(std::chrono::microseconds(100));
+  }
+
+  lua_pushboolean(L, 1);
+  return 1;
+}
+
+// engine.receive([timeout]) in a worker, waits forever by default
+static int workerReceive(lua_State* L)
+{
+  Worker* w = (Worker*)lua_touserdata(L, lua_upvalueindex(1));
+  return receive(L, w->inbox, &w->workerScratch, luaL_optnumber(L, 1, -1));
+}
+
+static int traceback(lua_State* L)
+{
+  luaL_traceback(L, L, lua_tostring(L, 1), 1);
+  return 1;
+}
+
+// Runs the script, inside a pcall so loading and argument errors are caught
+static int workerRun(lua_State* L)
+{
+  Worker* w = (Worker*)lua_touserdata(L, 1);
+
+  lua_newtable(L);
+  lua_pushinteger(L, w->index);
+  lua_setfield(L, -2, "worker");
+  lua_pushlightuserdata(L, w);
+  lua_pushcclosure(L, workerSend, 1);
+  lua_setfield(L, -2, "send");
+  lua_pushlightuserdata(L, w);
+  lua_pushcclosure(L, workerReceive, 1);
+  lua_setfield(L, -2, "receive");
+  lua_setglobal(L, "engine");
+  jobsRegister(L);
+  bufferRegister(L);
+
+  if (luaL_loadfile(L, w->script.c_str()) != LUA_OK)
+  {
+    return lua_error(L);
+  }
+
+  messageRead(L, w->args.data(), 0);
+  w->args.clear();
+  lua_getfield(L, -1, "n");
+  int nargs = (int)lua_tointeger(L, -1);
+  lua_pop(L, 1);
+  luaL_checkstack(L, nargs, "too many arguments");
+  for (int i = 1; i <= nargs; ++i)
+  {
+    lua_rawgeti(L, -i, i);
+  }
+  lua_remove(L, -nargs - 1);
+
+  lua_call(L, nargs, 0);
+  return 0;
+}
+
+static void workerThread(Worker* w)
+{
+  lua_State* L = luaL_newstate();
+  luaL_openlibs(L);
+
+  lua_pushcfunction(L, traceback);
+  lua_pushcfunction(L, workerRun);
+  lua_pushlightuserdata(L, w);
+  if (lua_pcall(L, 1, 0, 1) != LUA_OK)
+  {
+    fprintf(stderr, "worker %d (%s): %s\n", w->index, w->script.c_str(), lua_tostring(L, -1));
+  }
+
+  lua_close(L);
+  channelClose(w->outbox);
+  w->running.store(false);
+}
+
+static Worker* checkWorker(lua_State* L)
+{
+  Worker* w = *(Worker**)luaL_checkudata(L, 1, workerName);
+  luaL_argcheck(L, w != NULL, 1, "worker is closed");
+  return w;
+}
+
+// engine.workers.spawn(script, ...) -> worker, the extra arguments are
+// copied to the script's ...
+static int workersLuaSpawn(lua_State* L)
+{
+#ifdef EMSCRIPTEN
+  return luaL_error(L, "workers need threads, which this build doesn't have");
+#else
+  const char* script = luaL_checkstring(L, 1);
+
+  //the arguments go as one message, {n = count, ...}
+  int count = lua_gettop(L) - 1;
+  lua_createtable(L, count, 1);
+  for (int i = 1; i <= count; ++i)
+  {
+    lua_pushvalue(L, i + 1);
+    lua_rawseti(L, -2, i);
+  }
+  lua_pushinteger(L, count);
+  lua_setfield(L, -2, "n");
+
+  std::vector<uint8_t> args;
+  messageWrite(L, -1, &args);
+
+  Worker** ud = (Worker**)lua_newuserdata(L, sizeof(Worker*));
+  *ud = NULL;
+  luaL_setmetatable(L, workerName);
+
+  Worker* w = new Worker();
+  w->index = ++spawned;
+  w->script = script;
+  w->args.swap(args);
+  w->inbox = channelCreate(WORKER_CHANNEL_SIZE);
+  w->outbox = channelCreate(WORKER_CHANNEL_SIZE);
+  w->running = true;
+  w->thread = std::thread(workerThread, w);
+  *ud = w;
+  return 1;
+#endif
+}
+
+// worker:send(value) -> false when the channel is full or the worker has
+// finished, never waits
+static int workersLuaSend(lua_State* L)
+{
+  Worker* w = checkWorker(L);
+  luaL_checkany(L, 2);
+  luaL_argcheck(L, !lua_isnil(L, 2), 2, "can't send nil");
+
+  w->scratch.clear();
+  messageWrite(L, 2, &w->scratch);
+  checkSize(L, w->inbox, w->scratch);
+
+  bool sent = w->running.load() && channelSend(w->inbox, w->scratch.data(), w->scratch.size());
+  if (!sent)
+  {
+    messageDiscard(w->scratch.data(), w->scratch.size());
+  }
+  lua_pushboolean(L, sent);
+  return 1;
+}
+
+// worker:receive([timeout]) -> value, or nil and "empty", "timeout" or
+// "closed". Doesn't wait unless given a timeout.
+static int workersLuaReceive(lua_State* L)
+{
+  Worker* w = checkWorker(L);
+  return receive(L, w->outbox, &w->scratch, luaL_optnumber(L, 2, 0));
+}
+
+static int workersLuaRunning(lua_State* L)
+{
+  Worker* w = *(Worker**)luaL_checkudata(L, 1, workerName);
+  lua_pushboolean(L, w != NULL && w->running.load());
+  return 1;
+}
+
+static void drain(Channel* c, std::vector<uint8_t>* scratch)
+{
+  while (channelReceive(c, scratch))
+  {
+    messageDiscard(scratch->data(), scratch->size());
+  }
+}
+
+// worker:close(), the worker's receive returns nil and its sends fail. Waits
+// for the script to return. Also the __gc.
+static int workersLuaClose(lua_State* L)
+{
+  Worker** ud = (Worker**)luaL_checkudata(L, 1, workerName);
+  Worker* w = *ud;
+  if (w == NULL)
+  {
+    return 0;
+  }
+  *ud = NULL;
+
+  channelClose(w->inbox);
+  channelClose(w->outbox);
+  w->thread.join();
+
+  drain(w->inbox, &w->scratch);
+  drain(w->outbox, &w->scratch);
+  //the script never started
+  messageDiscard(w->args.data(), w->args.size());
+
+  channelDestroy(w->inbox);
+  channelDestroy(w->outbox);
+  delete w;
+  return 0;
+}
+
+void workersRegister(lua_State* L)
+{
+  luaL_newmetatable(L, workerName);
+  lua_pushvalue(L, -1);
+  lua_setfield(L, -2, "__index");
+  lua_pushcfunction(L, workersLuaSend);
+  lua_setfield(L, -2, "send");
+  lua_pushcfunction(L, workersLuaReceive);
+  lua_setfield(L, -2, "receive");
+  lua_pushcfunction(L, workersLuaRunning);
+  lua_setfield(L, -2, "running");
+  lua_pushcfunction(L, workersLuaClose);
+  lua_setfield(L, -2, "close");
+  lua_pushcfunction(L, workersLuaClose);
+  lua_setfield(L, -2, "__gc");
+  lua_pop(L, 1);
+
+  bufferRegister(L);
+
+  lua_getglobal(L, "engine");
+  lua_createtable(L, 0, 1);
+  lua_pushcfunction(L, workersLuaSpawn);
+  lua_setfield(L, -2, "spawn");
+  lua_setfield(L, -2, "workers");
+  lua_pop(L, 1);
+}
@@ -0,0 +1,33 @@
+#ifndef __WORKERS_H__
+#define __WORKERS_H__
+
+#include "lua/src/lua.h"
+
+// Scripts running on their own threads in their own lua_State, for AI,
+// pathfinding and other work that can run alongside update. A worker has
+// the standard libraries and the thread safe part of the engine table
+// (jobs, buffers) but no gl or callbacks. It talks to the state that
+// spawned it through a pair of lock free channels:
+//
+//   local w = engine.workers.spawn("lua/path.lua", grid)
+//   w:send({from = a, to = b})
+//   local path = w:receive()        -- nil, "empty" until it has replied
+//
+// and in lua/path.lua:
+//
+//   local grid = ...
+//   while true do
+//     local request = engine.receive()
+//     if request == nil then break end  -- closed
+//     engine.send(search(grid, request))
+//   end
+//
+// Values are copied (see message.h), buffers (gl.Buffer, engine.shared) are
+// passed by reference.
+
+// Sets engine.workers, the engine table must be a global already. Workers
+// are stopped when their handle is collected, so at the latest by
+// lua_close.
+void workersRegister(lua_State* L);
+
+#endif